@@ -0,0 +1,124 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * ck-database-format.h : On-disk layout of the binary session database
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CK_DATABASE_FORMAT_H
+#define CK_DATABASE_FORMAT_H
+
+#include <stdint.h>
+
+/* The daemon writes the snapshot to a temporary file and renames it
+ * into place so readers always map a complete file.  Everything is in
+ * host byte order; a reader that sees a different magic must not use
+ * the file.
+ *
+ *   header
+ *   session records        n_sessions * CkDatabaseSessionRecord
+ *   seat records           n_seats * CkDatabaseSeatRecord
+ *   uid buckets            n_buckets * uint32_t
+ *   session id buckets     n_buckets * uint32_t
+ *   local active sessions  n_local_active * uint32_t
+ *   string table           NUL terminated strings, offset 0 is ""
+ *
+ * Buckets and the next_* fields hold session indexes and chain the
+ * sessions that hash to the same bucket.
+ */
+
+#define CK_DATABASE_MAGIC   0x42444b43 /* "CKDB" */
+#define CK_DATABASE_VERSION 1
+#define CK_DATABASE_NONE    0xffffffff
+
+#define CK_DATABASE_SESSION_ACTIVE (1 << 0)
+#define CK_DATABASE_SESSION_LOCAL  (1 << 1)
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t version;
+        uint64_t generation;
+        uint32_t file_size;
+        uint32_t n_sessions;
+        uint32_t sessions_offset;
+        uint32_t n_seats;
+        uint32_t seats_offset;
+        uint32_t n_buckets;
+        uint32_t uid_buckets_offset;
+        uint32_t id_buckets_offset;
+        uint32_t n_local_active;
+        uint32_t local_active_offset;
+        uint32_t strings_offset;
+        uint32_t strings_size;
+        uint32_t reserved;
+} CkDatabaseHeader;
+
+typedef struct
+{
+        /* string table offsets */
+        uint32_t id;
+        uint32_t seat_id;
+        uint32_t type;
+        uint32_t login_session_id;
+        uint32_t display_device;
+        uint32_t x11_display_device;
+        uint32_t x11_display;
+        uint32_t remote_host_name;
+
+        uint32_t uid;
+        uint32_t flags;
+        int64_t  creation_time;
+
+        uint32_t next_for_uid;
+        uint32_t next_for_id;
+} CkDatabaseSessionRecord;
+
+typedef struct
+{
+        uint32_t id;
+        uint32_t kind;
+        uint32_t active_session;
+        uint32_t n_sessions;
+} CkDatabaseSeatRecord;
+
+static inline uint32_t
+ck_database_hash_string (const char *str)
+{
+        uint32_t h;
+
+        h = 5381;
+        while (*str != '\0') {
+                h = (h << 5) + h + (unsigned char) *str;
+                str++;
+        }
+
+        return h;
+}
+
+static inline uint32_t
+ck_database_hash_uid (uint32_t uid)
+{
+        return uid * 2654435761u;
+}
+
+#endif /* CK_DATABASE_FORMAT_H */
@@ -0,0 +1,354 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * ck-database.c : Read only access to the ConsoleKit session database
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "ck-database.h"
+#include "ck-database-format.h"
+
+#define CK_DATABASE_FILE LOCALSTATEDIR "/run/ConsoleKit/database.bin"
+
+struct _CkDatabase
+{
+        char                          *filename;
+        const char                    *data;
+        size_t                         size;
+        dev_t                          dev;
+        ino_t                          ino;
+        const CkDatabaseHeader        *header;
+        const CkDatabaseSessionRecord *sessions;
+        const uint32_t                *uid_buckets;
+        const uint32_t                *id_buckets;
+        const uint32_t                *local_active;
+        const char                    *strings;
+};
+
+static int
+range_is_valid (size_t   file_size,
+                uint32_t offset,
+                uint32_t n,
+                size_t   element_size)
+{
+        if (offset > file_size) {
+                return 0;
+        }
+        if (n != 0 && (file_size - offset) / element_size < n) {
+                return 0;
+        }
+        return 1;
+}
+
+static int
+header_is_valid (const CkDatabaseHeader *header,
+                 size_t                  size)
+{
+        if (size < sizeof (CkDatabaseHeader)) {
+                return 0;
+        }
+        if (header->magic != CK_DATABASE_MAGIC
+            || header->version != CK_DATABASE_VERSION
+            || header->file_size != size) {
+                return 0;
+        }
+        if (header->n_buckets == 0
+            || header->sessions_offset % 8 != 0
+            || header->seats_offset % 4 != 0
+            || header->uid_buckets_offset % 4 != 0
+            || header->id_buckets_offset % 4 != 0
+            || header->local_active_offset % 4 != 0) {
+                return 0;
+        }
+        if (! range_is_valid (size, header->sessions_offset, header->n_sessions, sizeof (CkDatabaseSessionRecord))
+            || ! range_is_valid (size, header->seats_offset, header->n_seats, sizeof (CkDatabaseSeatRecord))
+            || ! range_is_valid (size, header->uid_buckets_offset, header->n_buckets, sizeof (uint32_t))
+            || ! range_is_valid (size, header->id_buckets_offset, header->n_buckets, sizeof (uint32_t))
+            || ! range_is_valid (size, header->local_active_offset, header->n_local_active, sizeof (uint32_t))
+            || ! range_is_valid (size, header->strings_offset, header->strings_size, 1)) {
+                return 0;
+        }
+        /* string 0 is "" and the table must end with a terminator */
+        if (header->strings_size == 0
+            || ((const char *) header)[header->strings_offset] != '\0'
+            || ((const char *) header)[header->strings_offset + header->strings_size - 1] != '\0') {
+                return 0;
+        }
+
+        return 1;
+}
+
+CkDatabase *
+ck_database_open (const char *filename)
+{
+        CkDatabase  *db;
+        struct stat  st;
+        void        *data;
+        int          fd;
+
+        if (filename == NULL) {
+                filename = CK_DATABASE_FILE;
+        }
+
+        fd = open (filename, O_RDONLY);
+        if (fd == -1) {
+                return NULL;
+        }
+
+        if (fstat (fd, &st) == -1 || st.st_size <= 0) {
+                close (fd);
+                return NULL;
+        }
+
+        data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close (fd);
+        if (data == MAP_FAILED) {
+                return NULL;
+        }
+
+        if (! header_is_valid (data, st.st_size)) {
+                munmap (data, st.st_size);
+                return NULL;
+        }
+
+        db = calloc (1, sizeof (CkDatabase));
+        if (db == NULL) {
+                munmap (data, st.st_size);
+                return NULL;
+        }
+
+        db->filename = strdup (filename);
+        db->data = data;
+        db->size = st.st_size;
+        db->dev = st.st_dev;
+        db->ino = st.st_ino;
+        db->header = data;
+        db->sessions = (const void *) (db->data + db->header->sessions_offset);
+        db->uid_buckets = (const void *) (db->data + db->header->uid_buckets_offset);
+        db->id_buckets = (const void *) (db->data + db->header->id_buckets_offset);
+        db->local_active = (const void *) (db->data + db->header->local_active_offset);
+        db->strings = db->data + db->header->strings_offset;
+
+        return db;
+}
+
+void
+ck_database_close (CkDatabase *db)
+{
+        if (db == NULL) {
+                return;
+        }
+
+        munmap ((void *) db->data, db->size);
+        free (db->filename);
+        free (db);
+}
+
+/* The daemon replaces the file on every update so a mapping never
+ * changes under us; this tells the caller to open it again. */
+int
+ck_database_is_stale (CkDatabase *db)
+{
+        struct stat st;
+
+        if (db == NULL) {
+                return 1;
+        }
+
+        if (stat (db->filename, &st) == -1) {
+                return 1;
+        }
+
+        return st.st_dev != db->dev || st.st_ino != db->ino;
+}
+
+uint64_t
+ck_database_get_generation (CkDatabase *db)
+{
+        if (db == NULL) {
+                return 0;
+        }
+
+        return db->header->generation;
+}
+
+int
+ck_database_get_n_sessions (CkDatabase *db)
+{
+        if (db == NULL) {
+                return 0;
+        }
+
+        return db->header->n_sessions;
+}
+
+static const char *
+get_string (CkDatabase *db,
+            uint32_t    offset)
+{
+        if (offset >= db->header->strings_size) {
+                return "";
+        }
+
+        return db->strings + offset;
+}
+
+static int
+session_index_is_valid (CkDatabase *db,
+                        uint32_t    index)
+{
+        return index < db->header->n_sessions;
+}
+
+int
+ck_database_get_session (CkDatabase        *db,
+                         int                index,
+                         CkDatabaseSession *session)
+{
+        const CkDatabaseSessionRecord *record;
+
+        if (db == NULL || session == NULL || index < 0 || ! session_index_is_valid (db, index)) {
+                return 0;
+        }
+
+        record = &db->sessions[index];
+
+        session->id = get_string (db, record->id);
+        session->seat_id = get_string (db, record->seat_id);
+        session->type = get_string (db, record->type);
+        session->login_session_id = get_string (db, record->login_session_id);
+        session->display_device = get_string (db, record->display_device);
+        session->x11_display_device = get_string (db, record->x11_display_device);
+        session->x11_display = get_string (db, record->x11_display);
+        session->remote_host_name = get_string (db, record->remote_host_name);
+        session->uid = record->uid;
+        session->is_active = (record->flags & CK_DATABASE_SESSION_ACTIVE) != 0;
+        session->is_local = (record->flags & CK_DATABASE_SESSION_LOCAL) != 0;
+        session->creation_time = record->creation_time;
+
+        return 1;
+}
+
+int
+ck_database_lookup_session (CkDatabase *db,
+                            const char *ssid)
+{
+        uint32_t index;
+        uint32_t n;
+
+        if (db == NULL || ssid == NULL) {
+                return -1;
+        }
+
+        index = db->id_buckets[ck_database_hash_string (ssid) % db->header->n_buckets];
+
+        /* bound the walk in case the chains are corrupt */
+        for (n = 0; session_index_is_valid (db, index) && n < db->header->n_sessions; n++) {
+                if (strcmp (get_string (db, db->sessions[index].id), ssid) == 0) {
+                        return index;
+                }
+                index = db->sessions[index].next_for_id;
+        }
+
+        return -1;
+}
+
+static int
+find_uid_from (CkDatabase *db,
+               uint32_t    index,
+               uid_t       uid)
+{
+        uint32_t n;
+
+        for (n = 0; session_index_is_valid (db, index) && n < db->header->n_sessions; n++) {
+                if (db->sessions[index].uid == uid) {
+                        return index;
+                }
+                index = db->sessions[index].next_for_uid;
+        }
+
+        return -1;
+}
+
+int
+ck_database_first_session_for_uid (CkDatabase *db,
+                                   uid_t       uid)
+{
+        if (db == NULL) {
+                return -1;
+        }
+
+        return find_uid_from (db,
+                              db->uid_buckets[ck_database_hash_uid (uid) % db->header->n_buckets],
+                              uid);
+}
+
+int
+ck_database_next_session_for_uid (CkDatabase *db,
+                                  int         index)
+{
+        if (db == NULL || index < 0 || ! session_index_is_valid (db, index)) {
+                return -1;
+        }
+
+        return find_uid_from (db,
+                              db->sessions[index].next_for_uid,
+                              db->sessions[index].uid);
+}
+
+int
+ck_database_get_n_local_active (CkDatabase *db)
+{
+        if (db == NULL) {
+                return 0;
+        }
+
+        return db->header->n_local_active;
+}
+
+int
+ck_database_get_local_active_session (CkDatabase *db,
+                                      int         n)
+{
+        uint32_t index;
+
+        if (db == NULL || n < 0 || (uint32_t) n >= db->header->n_local_active) {
+                return -1;
+        }
+
+        index = db->local_active[n];
+        if (! session_index_is_valid (db, index)) {
+                return -1;
+        }
+
+        return index;
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * ck-database.h : Read only access to the ConsoleKit session database
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CK_DATABASE_H
+#define CK_DATABASE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _CkDatabase;
+typedef struct _CkDatabase CkDatabase;
+
+/* Points into the mapped file; valid until ck_database_close() */
+typedef struct
+{
+        const char *id;
+        const char *seat_id;
+        const char *type;
+        const char *login_session_id;
+        const char *display_device;
+        const char *x11_display_device;
+        const char *x11_display;
+        const char *remote_host_name;
+        uid_t       uid;
+        int         is_active;
+        int         is_local;
+        int64_t     creation_time;
+} CkDatabaseSession;
+
+CkDatabase   *ck_database_open                      (const char        *filename);
+void          ck_database_close                     (CkDatabase        *db);
+int           ck_database_is_stale                  (CkDatabase        *db);
+uint64_t      ck_database_get_generation            (CkDatabase        *db);
+
+int           ck_database_get_n_sessions            (CkDatabase        *db);
+int           ck_database_get_session               (CkDatabase        *db,
+                                                     int                index,
+                                                     CkDatabaseSession *session);
+int           ck_database_lookup_session            (CkDatabase        *db,
+                                                     const char        *ssid);
+int           ck_database_first_session_for_uid     (CkDatabase        *db,
+                                                     uid_t              uid);
+int           ck_database_next_session_for_uid      (CkDatabase        *db,
+                                                     int                index);
+int           ck_database_get_n_local_active        (CkDatabase        *db);
+int           ck_database_get_local_active_session  (CkDatabase        *db,
+                                                     int                n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CK_DATABASE_H */
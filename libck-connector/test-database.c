@@ -0,0 +1,296 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Writes session databases with the daemon's writer and reads them
+ * back with the library, checking that every field and index comes
+ * out as it went in and that damaged files are refused.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ck-database.h"
+#include "ck-database-format.h"
+#include "ck-database-writer.h"
+
+static const CkDatabaseWriterSession sessions[] = {
+        { "/org/freedesktop/ConsoleKit/Session1", "/org/freedesktop/ConsoleKit/Seat1",
+          "x11", "1", "/dev/tty7", "/dev/tty7", ":0", NULL,
+          500, TRUE, TRUE, 1200000000 },
+        { "/org/freedesktop/ConsoleKit/Session2", "/org/freedesktop/ConsoleKit/Seat1",
+          NULL, "2", "/dev/tty2", NULL, NULL, NULL,
+          500, FALSE, TRUE, 1200000100 },
+        { "/org/freedesktop/ConsoleKit/Session3", "/org/freedesktop/ConsoleKit/Seat2",
+          NULL, NULL, NULL, NULL, NULL, "remote.example.org",
+          501, TRUE, FALSE, 1200000200 },
+};
+
+static const CkDatabaseWriterSeat seats[] = {
+        { "/org/freedesktop/ConsoleKit/Seat1", 0, "/org/freedesktop/ConsoleKit/Session1" },
+        { "/org/freedesktop/ConsoleKit/Seat2", 1, "/org/freedesktop/ConsoleKit/Session3" },
+};
+
+static int n_failed = 0;
+
+static void
+check (int         condition,
+       const char *what)
+{
+        if (! condition) {
+                printf ("FAILED: %s\n", what);
+                n_failed++;
+        }
+}
+
+/* The writer stores NULL and "" the same way */
+static int
+string_equal (const char *written,
+              const char *read)
+{
+        return strcmp (written != NULL ? written : "", read) == 0;
+}
+
+static void
+check_session (CkDatabase                    *db,
+               const CkDatabaseWriterSession *expected)
+{
+        CkDatabaseSession session;
+        int               index;
+
+        index = ck_database_lookup_session (db, expected->id);
+        check (index >= 0, "session is found by id");
+        if (index < 0) {
+                return;
+        }
+
+        check (ck_database_get_session (db, index, &session), "session can be read");
+        check (string_equal (expected->id, session.id), "id");
+        check (string_equal (expected->seat_id, session.seat_id), "seat id");
+        check (string_equal (expected->type, session.type), "session type");
+        check (string_equal (expected->login_session_id, session.login_session_id), "login session id");
+        check (string_equal (expected->display_device, session.display_device), "display device");
+        check (string_equal (expected->x11_display_device, session.x11_display_device), "x11 display device");
+        check (string_equal (expected->x11_display, session.x11_display), "x11 display");
+        check (string_equal (expected->remote_host_name, session.remote_host_name), "remote host name");
+        check (session.uid == expected->uid, "uid");
+        check (! session.is_active == ! expected->is_active, "active flag");
+        check (! session.is_local == ! expected->is_local, "local flag");
+        check (session.creation_time == expected->creation_time, "creation time");
+}
+
+static int
+count_sessions_for_uid (CkDatabase *db,
+                        uid_t       uid)
+{
+        int index;
+        int n;
+
+        n = 0;
+        for (index = ck_database_first_session_for_uid (db, uid);
+             index >= 0;
+             index = ck_database_next_session_for_uid (db, index)) {
+                n++;
+        }
+
+        return n;
+}
+
+static void
+test_round_trip (const char *filename)
+{
+        CkDatabase        *db;
+        CkDatabaseSession  session;
+        guint              i;
+
+        if (! ck_database_writer_write (filename, 1,
+                                        sessions, G_N_ELEMENTS (sessions),
+                                        seats, G_N_ELEMENTS (seats))) {
+                check (FALSE, "database is written");
+                return;
+        }
+
+        db = ck_database_open (filename);
+        check (db != NULL, "database is opened");
+        if (db == NULL) {
+                return;
+        }
+
+        check (ck_database_get_generation (db) == 1, "generation");
+        check (ck_database_get_n_sessions (db) == G_N_ELEMENTS (sessions), "number of sessions");
+        check (! ck_database_is_stale (db), "database is current");
+
+        for (i = 0; i < G_N_ELEMENTS (sessions); i++) {
+                check_session (db, &sessions[i]);
+        }
+
+        check (ck_database_lookup_session (db, "/org/freedesktop/ConsoleKit/Session4") == -1,
+               "unknown session is not found");
+        check (count_sessions_for_uid (db, 500) == 2, "two sessions for uid 500");
+        check (count_sessions_for_uid (db, 501) == 1, "one session for uid 501");
+        check (count_sessions_for_uid (db, 502) == 0, "no session for uid 502");
+
+        check (ck_database_get_n_local_active (db) == 1, "one local active session");
+        check (ck_database_get_session (db, ck_database_get_local_active_session (db, 0), &session)
+               && strcmp (session.id, sessions[0].id) == 0,
+               "local active session");
+        check (ck_database_get_local_active_session (db, 1) == -1, "local active list ends");
+
+        /* a new snapshot replaces the file and leaves the old mapping intact */
+        check (ck_database_writer_write (filename, 2, sessions, 1, seats, 1), "database is rewritten");
+        check (ck_database_is_stale (db), "old mapping is stale");
+        check (ck_database_get_n_sessions (db) == G_N_ELEMENTS (sessions), "old mapping is unchanged");
+        ck_database_close (db);
+
+        db = ck_database_open (filename);
+        check (db != NULL, "rewritten database is opened");
+        if (db != NULL) {
+                check (ck_database_get_generation (db) == 2, "new generation");
+                check (ck_database_get_n_sessions (db) == 1, "new number of sessions");
+                check (ck_database_lookup_session (db, sessions[2].id) == -1, "removed session is gone");
+                ck_database_close (db);
+        }
+}
+
+static void
+test_empty (const char *filename)
+{
+        CkDatabase *db;
+
+        check (ck_database_writer_write (filename, 3, NULL, 0, NULL, 0), "empty database is written");
+
+        db = ck_database_open (filename);
+        check (db != NULL, "empty database is opened");
+        if (db != NULL) {
+                check (ck_database_get_n_sessions (db) == 0, "no sessions");
+                check (ck_database_lookup_session (db, sessions[0].id) == -1, "nothing is found");
+                check (ck_database_first_session_for_uid (db, 500) == -1, "no session for uid");
+                check (ck_database_get_n_local_active (db) == 0, "no local active session");
+                ck_database_close (db);
+        }
+}
+
+static void
+write_damaged (const char *filename,
+               const char *contents,
+               gsize       len,
+               const char *what)
+{
+        CkDatabase *db;
+        GError     *error;
+
+        error = NULL;
+        if (! g_file_set_contents (filename, contents, len, &error)) {
+                printf ("Unable to write %s: %s\n", filename, error->message);
+                g_error_free (error);
+                n_failed++;
+                return;
+        }
+
+        db = ck_database_open (filename);
+        check (db == NULL, what);
+        ck_database_close (db);
+}
+
+static void
+test_damaged (const char *filename)
+{
+        CkDatabaseHeader *header;
+        char             *contents;
+        gsize             len;
+
+        if (! ck_database_writer_write (filename, 4,
+                                        sessions, G_N_ELEMENTS (sessions),
+                                        seats, G_N_ELEMENTS (seats))
+            || ! g_file_get_contents (filename, &contents, &len, NULL)) {
+                check (FALSE, "database is written and read back");
+                return;
+        }
+
+        write_damaged (filename, contents, len / 2, "truncated file is refused");
+        write_damaged (filename, contents, sizeof (CkDatabaseHeader) - 1, "short header is refused");
+
+        header = (CkDatabaseHeader *) contents;
+
+        header->magic++;
+        write_damaged (filename, contents, len, "bad magic is refused");
+        header->magic--;
+
+        header->version++;
+        write_damaged (filename, contents, len, "unknown version is refused");
+        header->version--;
+
+        header->n_sessions += 1000;
+        write_damaged (filename, contents, len, "sessions past the end are refused");
+        header->n_sessions -= 1000;
+
+        header->strings_size++;
+        write_damaged (filename, contents, len, "string table past the end is refused");
+        header->strings_size--;
+
+        contents[len - 1] = 'x';
+        write_damaged (filename, contents, len, "unterminated string table is refused");
+
+        g_free (contents);
+}
+
+int
+main (int argc, char *argv[])
+{
+        char   *filename;
+        GError *error;
+        int     fd;
+
+        error = NULL;
+        fd = g_file_open_tmp ("test-database-XXXXXX", &filename, &error);
+        if (fd == -1) {
+                printf ("Unable to create a temporary file: %s\n", error->message);
+                g_error_free (error);
+                return 1;
+        }
+        close (fd);
+
+        test_round_trip (filename);
+        test_empty (filename);
+        test_damaged (filename);
+
+        g_unlink (filename);
+        g_free (filename);
+
+        if (n_failed > 0) {
+                printf ("%d checks failed\n", n_failed);
+                return 1;
+        }
+
+        printf ("All checks passed\n");
+
+        return 0;
+}
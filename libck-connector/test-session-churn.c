@@ -0,0 +1,550 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Session churn benchmark.
+ *
+ * Starts a private dbus-daemon and console-kit-daemon in test mode,
+ * then has a number of concurrent clients open, look up and close
+ * sessions through libck-connector as fast as they can.  Prints the
+ * overall throughput and latency percentiles for each method.
+ *
+ * Must be run as an unprivileged user.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dbus/dbus.h>
+
+#include "ck-connector.h"
+
+#ifndef CK_DAEMON_PATH
+#define CK_DAEMON_PATH "../src/console-kit-daemon"
+#endif
+
+#define CK_NAME      "org.freedesktop.ConsoleKit"
+#define CK_MANAGER_PATH      "/org/freedesktop/ConsoleKit/Manager"
+#define CK_MANAGER_INTERFACE "org.freedesktop.ConsoleKit.Manager"
+
+enum {
+        OP_OPEN_SESSION,
+        OP_GET_SESSION_FOR_COOKIE,
+        OP_CLOSE_SESSION,
+        N_OPS
+};
+
+static const char *op_names[N_OPS] = {
+        "OpenSession",
+        "GetSessionForCookie",
+        "CloseSession",
+};
+
+/* latency in microseconds, or a negative value for a failed call */
+static double *latencies;
+
+static double
+now_usec (void)
+{
+        struct timeval tv;
+
+        gettimeofday (&tv, NULL);
+
+        return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static pid_t
+spawn (char * const argv[])
+{
+        pid_t pid;
+
+        pid = fork ();
+        if (pid == 0) {
+                execvp (argv[0], argv);
+                fprintf (stderr, "Unable to run %s: %s\n", argv[0], strerror (errno));
+                _exit (127);
+        }
+
+        return pid;
+}
+
+static void
+stop (pid_t pid)
+{
+        if (pid > 0) {
+                kill (pid, SIGTERM);
+                waitpid (pid, NULL, 0);
+        }
+}
+
+static int
+write_bus_config (const char *path,
+                  const char *socket_path)
+{
+        FILE *f;
+
+        f = fopen (path, "w");
+        if (f == NULL) {
+                return 0;
+        }
+
+        fprintf (f,
+                 "<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-BUS Bus Configuration 1.0//EN\"\n"
+                 " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+                 "<busconfig>\n"
+                 "  <type>system</type>\n"
+                 "  <listen>unix:path=%s</listen>\n"
+                 "  <auth>EXTERNAL</auth>\n"
+                 "  <policy context=\"default\">\n"
+                 "    <allow user=\"*\"/>\n"
+                 "    <allow own=\"*\"/>\n"
+                 "    <allow send_destination=\"*\"/>\n"
+                 "  </policy>\n"
+                 "</busconfig>\n",
+                 socket_path);
+
+        return fclose (f) == 0;
+}
+
+static int
+wait_for_socket (const char *path)
+{
+        struct stat st;
+        int         i;
+
+        for (i = 0; i < 500; i++) {
+                if (stat (path, &st) == 0) {
+                        return 1;
+                }
+                usleep (10000);
+        }
+
+        return 0;
+}
+
+static int
+wait_for_daemon (void)
+{
+        DBusConnection *connection;
+        DBusError       error;
+        int             ret;
+        int             i;
+
+        ret = 0;
+
+        dbus_error_init (&error);
+        connection = dbus_bus_get_private (DBUS_BUS_SYSTEM, &error);
+        if (connection == NULL) {
+                fprintf (stderr, "Unable to connect to the test bus: %s\n", error.message);
+                dbus_error_free (&error);
+                return 0;
+        }
+
+        for (i = 0; i < 1000 && ! ret; i++) {
+                ret = dbus_bus_name_has_owner (connection, CK_NAME, NULL);
+                if (! ret) {
+                        usleep (10000);
+                }
+        }
+
+        dbus_connection_close (connection);
+        dbus_connection_unref (connection);
+
+        return ret;
+}
+
+static int
+get_session_for_cookie (DBusConnection *connection,
+                        const char     *cookie)
+{
+        DBusMessage *message;
+        DBusMessage *reply;
+        DBusError    error;
+
+        message = dbus_message_new_method_call (CK_NAME,
+                                                CK_MANAGER_PATH,
+                                                CK_MANAGER_INTERFACE,
+                                                "GetSessionForCookie");
+        if (message == NULL) {
+                return 0;
+        }
+
+        if (! dbus_message_append_args (message,
+                                        DBUS_TYPE_STRING, &cookie,
+                                        DBUS_TYPE_INVALID)) {
+                dbus_message_unref (message);
+                return 0;
+        }
+
+        dbus_error_init (&error);
+        reply = dbus_connection_send_with_reply_and_block (connection, message, -1, &error);
+        dbus_message_unref (message);
+        if (reply == NULL) {
+                dbus_error_free (&error);
+                return 0;
+        }
+
+        dbus_message_unref (reply);
+
+        return 1;
+}
+
+/* one client process; fills in the latencies for sessions [first, last) */
+static int
+run_client (int first,
+            int last)
+{
+        DBusConnection *connection;
+        DBusError       error;
+        int             user;
+        const char     *session_type;
+        int             i;
+
+        dbus_error_init (&error);
+        connection = dbus_bus_get_private (DBUS_BUS_SYSTEM, &error);
+        if (connection == NULL) {
+                fprintf (stderr, "Unable to connect to the test bus: %s\n", error.message);
+                dbus_error_free (&error);
+                return 1;
+        }
+
+        user = getuid ();
+        session_type = "bench";
+
+        for (i = first; i < last; i++) {
+                CkConnector *connector;
+                double       start;
+                double      *slot;
+                int          res;
+
+                slot = &latencies[i * N_OPS];
+
+                connector = ck_connector_new ();
+                if (connector == NULL) {
+                        return 1;
+                }
+
+                start = now_usec ();
+                dbus_error_init (&error);
+                res = ck_connector_open_session_with_parameters (connector,
+                                                                 &error,
+                                                                 "unix-user", &user,
+                                                                 "session-type", &session_type,
+                                                                 NULL);
+                slot[OP_OPEN_SESSION] = res ? now_usec () - start : -1;
+                if (! res) {
+                        dbus_error_free (&error);
+                        slot[OP_GET_SESSION_FOR_COOKIE] = -1;
+                        slot[OP_CLOSE_SESSION] = -1;
+                        ck_connector_unref (connector);
+                        continue;
+                }
+
+                start = now_usec ();
+                res = get_session_for_cookie (connection, ck_connector_get_cookie (connector));
+                slot[OP_GET_SESSION_FOR_COOKIE] = res ? now_usec () - start : -1;
+
+                start = now_usec ();
+                dbus_error_init (&error);
+                res = ck_connector_close_session (connector, &error);
+                slot[OP_CLOSE_SESSION] = res ? now_usec () - start : -1;
+                if (! res) {
+                        dbus_error_free (&error);
+                }
+
+                ck_connector_unref (connector);
+        }
+
+        dbus_connection_close (connection);
+        dbus_connection_unref (connection);
+
+        return 0;
+}
+
+static int
+compare_double (const void *a,
+                const void *b)
+{
+        double da = *(const double *) a;
+        double db = *(const double *) b;
+
+        return (da > db) - (da < db);
+}
+
+static double
+percentile (const double *sorted,
+            int           n,
+            double        p)
+{
+        int index;
+
+        index = (int) (p * n + 0.999999) - 1;
+        if (index < 0) {
+                index = 0;
+        }
+        if (index >= n) {
+                index = n - 1;
+        }
+
+        return sorted[index];
+}
+
+static void
+report (int    n_sessions,
+        double elapsed_usec)
+{
+        double *values;
+        int     op;
+
+        printf ("%d sessions in %.3f s: %.1f sessions/s\n",
+                n_sessions,
+                elapsed_usec / 1000000.0,
+                n_sessions / (elapsed_usec / 1000000.0));
+        printf ("%-20s %8s %8s %10s %10s %10s\n",
+                "method", "ok", "failed", "p50 (ms)", "p99 (ms)", "p999 (ms)");
+
+        values = malloc (sizeof (double) * n_sessions);
+        if (values == NULL) {
+                return;
+        }
+
+        for (op = 0; op < N_OPS; op++) {
+                int n_ok;
+                int i;
+
+                n_ok = 0;
+                for (i = 0; i < n_sessions; i++) {
+                        double v = latencies[i * N_OPS + op];
+                        if (v >= 0) {
+                                values[n_ok++] = v;
+                        }
+                }
+
+                if (n_ok == 0) {
+                        printf ("%-20s %8d %8d %10s %10s %10s\n",
+                                op_names[op], 0, n_sessions, "-", "-", "-");
+                        continue;
+                }
+
+                qsort (values, n_ok, sizeof (double), compare_double);
+                printf ("%-20s %8d %8d %10.3f %10.3f %10.3f\n",
+                        op_names[op],
+                        n_ok,
+                        n_sessions - n_ok,
+                        percentile (values, n_ok, 0.50) / 1000.0,
+                        percentile (values, n_ok, 0.99) / 1000.0,
+                        percentile (values, n_ok, 0.999) / 1000.0);
+        }
+
+        free (values);
+}
+
+static void
+usage (const char *name)
+{
+        fprintf (stderr,
+                 "Usage: %s [--sessions N] [--clients M] [--daemon PATH] [--dbus-daemon PATH]\n",
+                 name);
+}
+
+int
+main (int argc, char *argv[])
+{
+        static const struct option options[] = {
+                { "sessions", required_argument, NULL, 'n' },
+                { "clients", required_argument, NULL, 'c' },
+                { "daemon", required_argument, NULL, 'd' },
+                { "dbus-daemon", required_argument, NULL, 'b' },
+                { "help", no_argument, NULL, 'h' },
+                { NULL, 0, NULL, 0 }
+        };
+        int         n_sessions;
+        int         n_clients;
+        const char *daemon_path;
+        const char *dbus_daemon_path;
+        char        dir[] = "/tmp/ck-session-churn-XXXXXX";
+        char        config_path[sizeof (dir) + 16];
+        char        socket_path[sizeof (dir) + 16];
+        char        address[sizeof (socket_path) + 16];
+        pid_t       bus_pid;
+        pid_t       daemon_pid;
+        pid_t      *clients;
+        double      start;
+        double      elapsed;
+        int         ret;
+        int         i;
+
+        ret = 1;
+        n_sessions = 1000;
+        n_clients = 8;
+        daemon_path = CK_DAEMON_PATH;
+        dbus_daemon_path = "dbus-daemon";
+        bus_pid = 0;
+        daemon_pid = 0;
+        clients = NULL;
+
+        for (;;) {
+                int c;
+
+                c = getopt_long (argc, argv, "n:c:d:b:h", options, NULL);
+                if (c == -1) {
+                        break;
+                }
+
+                switch (c) {
+                case 'n':
+                        n_sessions = atoi (optarg);
+                        break;
+                case 'c':
+                        n_clients = atoi (optarg);
+                        break;
+                case 'd':
+                        daemon_path = optarg;
+                        break;
+                case 'b':
+                        dbus_daemon_path = optarg;
+                        break;
+                default:
+                        usage (argv[0]);
+                        return 1;
+                }
+        }
+
+        if (n_sessions <= 0 || n_clients <= 0) {
+                usage (argv[0]);
+                return 1;
+        }
+        if (n_clients > n_sessions) {
+                n_clients = n_sessions;
+        }
+
+        if (getuid () == 0) {
+                fprintf (stderr, "Refusing to run as root\n");
+                return 1;
+        }
+
+        if (mkdtemp (dir) == NULL) {
+                fprintf (stderr, "Unable to create a temporary directory: %s\n", strerror (errno));
+                return 1;
+        }
+        snprintf (config_path, sizeof (config_path), "%s/bus.conf", dir);
+        snprintf (socket_path, sizeof (socket_path), "%s/bus", dir);
+        snprintf (address, sizeof (address), "unix:path=%s", socket_path);
+
+        if (! write_bus_config (config_path, socket_path)) {
+                fprintf (stderr, "Unable to write %s\n", config_path);
+                goto out;
+        }
+
+        {
+                char *bus_argv[] = { (char *) dbus_daemon_path, "--nofork", NULL, NULL };
+                char  config_arg[sizeof (config_path) + 16];
+
+                snprintf (config_arg, sizeof (config_arg), "--config-file=%s", config_path);
+                bus_argv[2] = config_arg;
+                bus_pid = spawn (bus_argv);
+        }
+        if (bus_pid < 0 || ! wait_for_socket (socket_path)) {
+                fprintf (stderr, "The private bus did not come up\n");
+                goto out;
+        }
+
+        setenv ("DBUS_SYSTEM_BUS_ADDRESS", address, 1);
+
+        {
+                char *daemon_argv[] = { (char *) daemon_path, "--no-daemon", "--test-mode", NULL };
+
+                daemon_pid = spawn (daemon_argv);
+        }
+        if (daemon_pid < 0 || ! wait_for_daemon ()) {
+                fprintf (stderr, "%s did not come up on the private bus\n", daemon_path);
+                goto out;
+        }
+
+        latencies = mmap (NULL,
+                          sizeof (double) * N_OPS * n_sessions,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS,
+                          -1,
+                          0);
+        if (latencies == MAP_FAILED) {
+                fprintf (stderr, "Unable to allocate result buffer: %s\n", strerror (errno));
+                latencies = NULL;
+                goto out;
+        }
+        for (i = 0; i < N_OPS * n_sessions; i++) {
+                latencies[i] = -1;
+        }
+
+        clients = calloc (n_clients, sizeof (pid_t));
+        if (clients == NULL) {
+                goto out;
+        }
+
+        start = now_usec ();
+        for (i = 0; i < n_clients; i++) {
+                int first;
+                int last;
+
+                first = (long) n_sessions * i / n_clients;
+                last = (long) n_sessions * (i + 1) / n_clients;
+
+                clients[i] = fork ();
+                if (clients[i] == 0) {
+                        _exit (run_client (first, last));
+                }
+        }
+        for (i = 0; i < n_clients; i++) {
+                if (clients[i] > 0) {
+                        waitpid (clients[i], NULL, 0);
+                }
+        }
+        elapsed = now_usec () - start;
+
+        report (n_sessions, elapsed);
+
+        ret = 0;
+ out:
+        free (clients);
+        if (latencies != NULL) {
+                munmap (latencies, sizeof (double) * N_OPS * n_sessions);
+        }
+        stop (daemon_pid);
+        stop (bus_pid);
+        unlink (config_path);
+        unlink (socket_path);
+        rmdir (dir);
+
+        return ret;
+}
@@ -0,0 +1,328 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+#include "ck-caller-info.h"
+
+/* The credentials of a connection can't change while it is on the
+ * bus and unique names are never reused by the bus daemon, so once
+ * we have asked about a sender we can keep the answer until
+ * NameOwnerChanged tells us the connection has gone away. */
+
+typedef struct
+{
+        uid_t uid;
+        pid_t pid;
+} CallerInfo;
+
+typedef struct
+{
+        CkCallerInfoFunc callback;
+        gpointer         data;
+        GDestroyNotify   destroy_data;
+} CallerInfoWaiter;
+
+/* Lookups that are in flight.  Both bus queries are sent at once and
+ * any further request for the same sender is queued behind the
+ * outstanding pair instead of issuing new calls. */
+typedef struct
+{
+        char           *sender;
+        DBusGProxy     *bus_proxy;
+        GList          *waiters;
+        guint           n_outstanding;
+        gboolean        failed;
+        gboolean        forgotten;
+        guint           uid;
+        guint           pid;
+} PendingLookup;
+
+static GHashTable *caller_cache = NULL;
+static GHashTable *pending_lookups = NULL;
+
+static CallerInfo *
+lookup_cached (const char *sender)
+{
+        if (caller_cache == NULL) {
+                return NULL;
+        }
+
+        return g_hash_table_lookup (caller_cache, sender);
+}
+
+static void
+add_cached (const char *sender,
+            uid_t       uid,
+            pid_t       pid)
+{
+        CallerInfo *info;
+
+        if (caller_cache == NULL) {
+                caller_cache = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      g_free);
+        }
+
+        info = g_new0 (CallerInfo, 1);
+        info->uid = uid;
+        info->pid = pid;
+
+        g_hash_table_insert (caller_cache, g_strdup (sender), info);
+}
+
+/* adapted from PolicyKit */
+gboolean
+ck_caller_info_get (DBusGProxy  *bus_proxy,
+                    const char  *sender,
+                    uid_t       *calling_uid,
+                    pid_t       *calling_pid)
+{
+        CallerInfo *info;
+        gboolean    res;
+        GError     *error = NULL;
+        guint       uid;
+        guint       pid;
+
+        res = FALSE;
+
+        if (sender == NULL) {
+                goto out;
+        }
+
+        info = lookup_cached (sender);
+        if (info != NULL) {
+                *calling_uid = info->uid;
+                *calling_pid = info->pid;
+                res = TRUE;
+                goto out;
+        }
+
+        if (! dbus_g_proxy_call (bus_proxy, "GetConnectionUnixUser", &error,
+                                 G_TYPE_STRING, sender,
+                                 G_TYPE_INVALID,
+                                 G_TYPE_UINT, &uid,
+                                 G_TYPE_INVALID)) {
+                g_debug ("GetConnectionUnixUser() failed: %s", error->message);
+                g_error_free (error);
+                goto out;
+        }
+
+        if (! dbus_g_proxy_call (bus_proxy, "GetConnectionUnixProcessID", &error,
+                                 G_TYPE_STRING, sender,
+                                 G_TYPE_INVALID,
+                                 G_TYPE_UINT, &pid,
+                                 G_TYPE_INVALID)) {
+                g_debug ("GetConnectionUnixProcessID() failed: %s", error->message);
+                g_error_free (error);
+                goto out;
+        }
+
+        *calling_uid = uid;
+        *calling_pid = pid;
+
+        add_cached (sender, uid, pid);
+
+        res = TRUE;
+
+        g_debug ("uid = %d", *calling_uid);
+        g_debug ("pid = %d", *calling_pid);
+
+out:
+        return res;
+}
+
+static void
+pending_lookup_finish (PendingLookup *pending)
+{
+        GList *l;
+
+        g_hash_table_remove (pending_lookups, pending->sender);
+
+        if (! pending->failed) {
+                g_debug ("uid = %u", pending->uid);
+                g_debug ("pid = %u", pending->pid);
+
+                if (! pending->forgotten) {
+                        add_cached (pending->sender, pending->uid, pending->pid);
+                }
+        }
+
+        for (l = pending->waiters; l != NULL; l = l->next) {
+                CallerInfoWaiter *waiter = l->data;
+
+                waiter->callback (pending->sender,
+                                  ! pending->failed,
+                                  pending->uid,
+                                  pending->pid,
+                                  waiter->data);
+                if (waiter->destroy_data != NULL) {
+                        waiter->destroy_data (waiter->data);
+                }
+                g_free (waiter);
+        }
+        g_list_free (pending->waiters);
+
+        g_object_unref (pending->bus_proxy);
+        g_free (pending->sender);
+        g_free (pending);
+}
+
+static void
+get_uint_reply (DBusGProxy     *proxy,
+                DBusGProxyCall *call,
+                PendingLookup  *pending,
+                const char     *method,
+                guint          *value)
+{
+        GError *error;
+
+        error = NULL;
+        if (! dbus_g_proxy_end_call (proxy, call, &error,
+                                     G_TYPE_UINT, value,
+                                     G_TYPE_INVALID)) {
+                g_debug ("%s() failed: %s", method, error->message);
+                g_error_free (error);
+                pending->failed = TRUE;
+        }
+
+        pending->n_outstanding--;
+        if (pending->n_outstanding == 0) {
+                pending_lookup_finish (pending);
+        }
+}
+
+static void
+get_unix_user_notify (DBusGProxy     *proxy,
+                      DBusGProxyCall *call,
+                      PendingLookup  *pending)
+{
+        get_uint_reply (proxy, call, pending, "GetConnectionUnixUser", &pending->uid);
+}
+
+static void
+get_unix_process_id_notify (DBusGProxy     *proxy,
+                            DBusGProxyCall *call,
+                            PendingLookup  *pending)
+{
+        get_uint_reply (proxy, call, pending, "GetConnectionUnixProcessID", &pending->pid);
+}
+
+void
+ck_caller_info_get_async (DBusGProxy       *bus_proxy,
+                          const char       *sender,
+                          CkCallerInfoFunc  callback,
+                          gpointer          data,
+                          GDestroyNotify    destroy_data)
+{
+        CallerInfo       *info;
+        PendingLookup    *pending;
+        CallerInfoWaiter *waiter;
+
+        g_return_if_fail (callback != NULL);
+
+        if (sender == NULL) {
+                callback (sender, FALSE, -1, -1, data);
+                goto done;
+        }
+
+        info = lookup_cached (sender);
+        if (info != NULL) {
+                callback (sender, TRUE, info->uid, info->pid, data);
+                goto done;
+        }
+
+        if (pending_lookups == NULL) {
+                pending_lookups = g_hash_table_new (g_str_hash, g_str_equal);
+        }
+
+        waiter = g_new0 (CallerInfoWaiter, 1);
+        waiter->callback = callback;
+        waiter->data = data;
+        waiter->destroy_data = destroy_data;
+
+        pending = g_hash_table_lookup (pending_lookups, sender);
+        if (pending != NULL) {
+                pending->waiters = g_list_append (pending->waiters, waiter);
+                return;
+        }
+
+        pending = g_new0 (PendingLookup, 1);
+        pending->sender = g_strdup (sender);
+        pending->bus_proxy = g_object_ref (bus_proxy);
+        pending->waiters = g_list_append (NULL, waiter);
+        g_hash_table_insert (pending_lookups, pending->sender, pending);
+
+        /* Issue both queries before waiting on either one; whichever
+         * reply arrives last completes the lookup. */
+        pending->n_outstanding = 2;
+        dbus_g_proxy_begin_call (bus_proxy,
+                                 "GetConnectionUnixUser",
+                                 (DBusGProxyCallNotify) get_unix_user_notify,
+                                 pending,
+                                 NULL,
+                                 G_TYPE_STRING, sender,
+                                 G_TYPE_INVALID);
+        dbus_g_proxy_begin_call (bus_proxy,
+                                 "GetConnectionUnixProcessID",
+                                 (DBusGProxyCallNotify) get_unix_process_id_notify,
+                                 pending,
+                                 NULL,
+                                 G_TYPE_STRING, sender,
+                                 G_TYPE_INVALID);
+        return;
+
+ done:
+        if (destroy_data != NULL) {
+                destroy_data (data);
+        }
+}
+
+void
+ck_caller_info_forget (const char *sender)
+{
+        PendingLookup *pending;
+
+        if (sender == NULL) {
+                return;
+        }
+
+        if (pending_lookups != NULL) {
+                pending = g_hash_table_lookup (pending_lookups, sender);
+                if (pending != NULL) {
+                        pending->forgotten = TRUE;
+                }
+        }
+
+        if (caller_cache == NULL) {
+                return;
+        }
+
+        if (g_hash_table_remove (caller_cache, sender)) {
+                g_debug ("Forgot cached credentials for %s", sender);
+        }
+}
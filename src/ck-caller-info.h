@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_CALLER_INFO_H
+#define __CK_CALLER_INFO_H
+
+#include <sys/types.h>
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+G_BEGIN_DECLS
+
+typedef void  (* CkCallerInfoFunc)          (const char  *sender,
+                                             gboolean     success,
+                                             uid_t        calling_uid,
+                                             pid_t        calling_pid,
+                                             gpointer     data);
+
+gboolean            ck_caller_info_get                        (DBusGProxy  *bus_proxy,
+                                                               const char  *sender,
+                                                               uid_t       *calling_uid,
+                                                               pid_t       *calling_pid);
+void                ck_caller_info_get_async                  (DBusGProxy       *bus_proxy,
+                                                               const char       *sender,
+                                                               CkCallerInfoFunc  callback,
+                                                               gpointer          data,
+                                                               GDestroyNotify    destroy_data);
+void                ck_caller_info_forget                     (const char  *sender);
+
+G_END_DECLS
+
+#endif /* __CK_CALLER_INFO_H */
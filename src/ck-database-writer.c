@@ -0,0 +1,289 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ck-database-format.h"
+#include "ck-database-writer.h"
+
+#define ALIGN8(n) (((n) + 7) & ~7)
+
+typedef struct
+{
+        GString    *strings;
+        GHashTable *string_offsets;
+} StringTable;
+
+static guint32
+add_string (StringTable *table,
+            const char  *str)
+{
+        gpointer offset;
+
+        if (str == NULL || str[0] == '\0') {
+                return 0;
+        }
+
+        offset = g_hash_table_lookup (table->string_offsets, str);
+        if (offset != NULL) {
+                return GPOINTER_TO_UINT (offset);
+        }
+
+        offset = GUINT_TO_POINTER (table->strings->len);
+        g_string_append_len (table->strings, str, strlen (str) + 1);
+        g_hash_table_insert (table->string_offsets, g_strdup (str), offset);
+
+        return GPOINTER_TO_UINT (offset);
+}
+
+static void
+fill_session_record (const CkDatabaseWriterSession *session,
+                     CkDatabaseSessionRecord       *record,
+                     StringTable                   *table)
+{
+        record->id = add_string (table, session->id);
+        record->seat_id = add_string (table, session->seat_id);
+        record->type = add_string (table, session->type);
+        record->login_session_id = add_string (table, session->login_session_id);
+        record->display_device = add_string (table, session->display_device);
+        record->x11_display_device = add_string (table, session->x11_display_device);
+        record->x11_display = add_string (table, session->x11_display);
+        record->remote_host_name = add_string (table, session->remote_host_name);
+        record->uid = session->uid;
+
+        record->flags = 0;
+        if (session->is_active) {
+                record->flags |= CK_DATABASE_SESSION_ACTIVE;
+        }
+        if (session->is_local) {
+                record->flags |= CK_DATABASE_SESSION_LOCAL;
+        }
+
+        record->creation_time = session->creation_time;
+}
+
+static gboolean
+write_file (const char  *filename,
+            const char  *data,
+            gsize        len)
+{
+        char    *filename_tmp;
+        int      fd;
+        gsize    written;
+        gboolean ret;
+
+        ret = FALSE;
+        filename_tmp = g_strdup_printf ("%s~", filename);
+
+        fd = g_open (filename_tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd == -1) {
+                g_warning ("Cannot create file %s: %s", filename_tmp, g_strerror (errno));
+                goto out;
+        }
+
+        written = 0;
+        while (written < len) {
+                ssize_t res;
+
+                res = write (fd, data + written, len - written);
+                if (res < 0) {
+                        if (errno == EAGAIN || errno == EINTR) {
+                                continue;
+                        }
+                        g_warning ("Error writing %s: %s", filename_tmp, g_strerror (errno));
+                        close (fd);
+                        goto out;
+                }
+                written += res;
+        }
+
+        if (close (fd) != 0 && errno != EINTR) {
+                g_warning ("Cannot close fd for %s: %s", filename_tmp, g_strerror (errno));
+                goto out;
+        }
+
+        if (g_rename (filename_tmp, filename) != 0) {
+                g_warning ("Cannot rename %s to %s: %s", filename_tmp, filename, g_strerror (errno));
+                goto out;
+        }
+
+        ret = TRUE;
+ out:
+        g_free (filename_tmp);
+
+        return ret;
+}
+
+/* Writes a snapshot in the format described in ck-database-format.h */
+gboolean
+ck_database_writer_write (const char                    *filename,
+                          guint64                        generation,
+                          const CkDatabaseWriterSession *sessions,
+                          guint                          n_sessions,
+                          const CkDatabaseWriterSeat    *seats,
+                          guint                          n_seats)
+{
+        StringTable              table;
+        CkDatabaseHeader         header;
+        CkDatabaseSessionRecord *session_records;
+        CkDatabaseSeatRecord    *seat_records;
+        guint32                 *uid_buckets;
+        guint32                 *id_buckets;
+        guint32                 *local_active;
+        GHashTable              *index_for_ssid;
+        GString                 *buf;
+        guint                    n_buckets;
+        guint                    n_local_active;
+        guint                    i;
+        gboolean                 ret;
+
+        table.strings = g_string_new (NULL);
+        table.string_offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        /* offset 0 is the empty string */
+        g_string_append_len (table.strings, "", 1);
+
+        n_buckets = MAX (16, n_sessions + n_sessions / 2);
+
+        session_records = g_new0 (CkDatabaseSessionRecord, MAX (1, n_sessions));
+        seat_records = g_new0 (CkDatabaseSeatRecord, MAX (1, n_seats));
+        uid_buckets = g_new (guint32, n_buckets);
+        id_buckets = g_new (guint32, n_buckets);
+        local_active = g_new0 (guint32, MAX (1, n_sessions));
+        index_for_ssid = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        for (i = 0; i < n_buckets; i++) {
+                uid_buckets[i] = CK_DATABASE_NONE;
+                id_buckets[i] = CK_DATABASE_NONE;
+        }
+
+        for (i = 0; i < n_sessions; i++) {
+                fill_session_record (&sessions[i], &session_records[i], &table);
+        }
+
+        /* build the chains backwards so they come out in record order */
+        n_local_active = 0;
+        for (i = n_sessions; i > 0; i--) {
+                CkDatabaseSessionRecord *record;
+                const char              *ssid;
+                guint                    bucket;
+
+                record = &session_records[i - 1];
+                ssid = table.strings->str + record->id;
+
+                bucket = ck_database_hash_uid (record->uid) % n_buckets;
+                record->next_for_uid = uid_buckets[bucket];
+                uid_buckets[bucket] = i - 1;
+
+                bucket = ck_database_hash_string (ssid) % n_buckets;
+                record->next_for_id = id_buckets[bucket];
+                id_buckets[bucket] = i - 1;
+
+                g_hash_table_insert (index_for_ssid, g_strdup (ssid), GUINT_TO_POINTER (i));
+        }
+        for (i = 0; i < n_sessions; i++) {
+                if ((session_records[i].flags & CK_DATABASE_SESSION_ACTIVE)
+                    && (session_records[i].flags & CK_DATABASE_SESSION_LOCAL)) {
+                        local_active[n_local_active++] = i;
+                }
+        }
+
+        for (i = 0; i < n_seats; i++) {
+                const char *sid;
+                gpointer    index;
+                guint       j;
+
+                sid = seats[i].id;
+                seat_records[i].id = add_string (&table, sid);
+
+                seat_records[i].n_sessions = 0;
+                for (j = 0; j < n_sessions; j++) {
+                        if (sid != NULL
+                            && strcmp (table.strings->str + session_records[j].seat_id, sid) == 0) {
+                                seat_records[i].n_sessions++;
+                        }
+                }
+
+                seat_records[i].kind = seats[i].kind;
+
+                seat_records[i].active_session = CK_DATABASE_NONE;
+                if (seats[i].active_session != NULL) {
+                        index = g_hash_table_lookup (index_for_ssid, seats[i].active_session);
+                        if (index != NULL) {
+                                seat_records[i].active_session = GPOINTER_TO_UINT (index) - 1;
+                        }
+                }
+        }
+
+        memset (&header, 0, sizeof (header));
+        header.magic = CK_DATABASE_MAGIC;
+        header.version = CK_DATABASE_VERSION;
+        header.generation = generation;
+        header.n_sessions = n_sessions;
+        header.n_seats = n_seats;
+        header.n_buckets = n_buckets;
+        header.n_local_active = n_local_active;
+
+        header.sessions_offset = ALIGN8 (sizeof (CkDatabaseHeader));
+        header.seats_offset = header.sessions_offset + header.n_sessions * sizeof (CkDatabaseSessionRecord);
+        header.uid_buckets_offset = header.seats_offset + header.n_seats * sizeof (CkDatabaseSeatRecord);
+        header.id_buckets_offset = header.uid_buckets_offset + n_buckets * sizeof (guint32);
+        header.local_active_offset = header.id_buckets_offset + n_buckets * sizeof (guint32);
+        header.strings_offset = header.local_active_offset + n_local_active * sizeof (guint32);
+        header.strings_size = table.strings->len;
+        header.file_size = header.strings_offset + header.strings_size;
+
+        buf = g_string_sized_new (header.file_size);
+        g_string_append_len (buf, (const char *) &header, sizeof (header));
+        while (buf->len < header.sessions_offset) {
+                g_string_append_c (buf, '\0');
+        }
+        g_string_append_len (buf, (const char *) session_records, header.n_sessions * sizeof (CkDatabaseSessionRecord));
+        g_string_append_len (buf, (const char *) seat_records, header.n_seats * sizeof (CkDatabaseSeatRecord));
+        g_string_append_len (buf, (const char *) uid_buckets, n_buckets * sizeof (guint32));
+        g_string_append_len (buf, (const char *) id_buckets, n_buckets * sizeof (guint32));
+        g_string_append_len (buf, (const char *) local_active, n_local_active * sizeof (guint32));
+        g_string_append_len (buf, table.strings->str, table.strings->len);
+
+        g_assert (buf->len == header.file_size);
+
+        ret = write_file (filename, buf->str, buf->len);
+
+        g_string_free (buf, TRUE);
+        g_hash_table_destroy (index_for_ssid);
+        g_free (local_active);
+        g_free (id_buckets);
+        g_free (uid_buckets);
+        g_free (seat_records);
+        g_free (session_records);
+        g_hash_table_destroy (table.string_offsets);
+        g_string_free (table.strings, TRUE);
+
+        return ret;
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __CK_DATABASE_WRITER_H
+#define __CK_DATABASE_WRITER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* What the writer needs to know about a session or seat, so that it
+ * can be used without the objects themselves.  Strings may be NULL. */
+typedef struct
+{
+        const char *id;
+        const char *seat_id;
+        const char *type;
+        const char *login_session_id;
+        const char *display_device;
+        const char *x11_display_device;
+        const char *x11_display;
+        const char *remote_host_name;
+        guint       uid;
+        gboolean    is_active;
+        gboolean    is_local;
+        gint64      creation_time;
+} CkDatabaseWriterSession;
+
+typedef struct
+{
+        const char *id;
+        guint       kind;
+        const char *active_session;
+} CkDatabaseWriterSeat;
+
+gboolean            ck_database_writer_write                  (const char                    *filename,
+                                                               guint64                        generation,
+                                                               const CkDatabaseWriterSession *sessions,
+                                                               guint                          n_sessions,
+                                                               const CkDatabaseWriterSeat    *seats,
+                                                               guint                          n_seats);
+
+G_END_DECLS
+
+#endif /* __CK_DATABASE_WRITER_H */
@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -36,25 +37,108 @@
 
 #include "ck-event-logger.h"
 #include "ck-log-event.h"
+#include "ck-log-event-block.h"
+#include "ck-event-sink.h"
 
 #define CK_EVENT_LOGGER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), CK_TYPE_EVENT_LOGGER, CkEventLoggerPrivate))
 
 #define DEFAULT_LOG_FILENAME LOCALSTATEDIR "/log/ConsoleKit/history"
 
+/* Upper bound on the number of events written with a single write */
+#define MAX_BATCH_EVENTS 512
+
+/* Events are handed to the writer thread through a ring of slots
+ * allocated up front; the strings of an event are copied into its
+ * slot, so logging one doesn't allocate unless they are unusually
+ * long.  Past queue-depth events the overflow policy decides; an event
+ * that is kept when every slot is in use makes the ring grow, since
+ * the main loop must never wait for the writer. */
+#define DEFAULT_QUEUE_DEPTH 512
+#define MAX_QUEUE_DEPTH     65536
+#define SLOT_STRINGS_LEN    512
+
+typedef struct
+{
+        CkLogEvent  event;
+        CkLogEvent *copy;          /* only if the strings didn't fit */
+        guint       n_lost_before; /* events dropped just before this one */
+        CkLogEvent  lost;          /* the record written for them */
+        char        strings[SLOT_STRINGS_LEN];
+} EventSlot;
+
 struct CkEventLoggerPrivate
 {
-        int              fd;
-        FILE            *file;
         GThread         *writer_thread;
-        GAsyncQueue     *event_queue;
         char            *log_filename;
+        gboolean         write_file;
+        char            *socket_path;
+        int              memory_events;
+        volatile gint    sync_interval;
+        gboolean         binary_format;
+
+        GSList          *sinks;
+        CkEventSink     *socket_sink;
+        CkEventSink     *ring_sink;
+
+        /* only touched by the writer thread; the lines are only
+         * needed if the log is text or there is a sink other than the
+         * log */
+        GString         *lines;
+        GArray          *line_ends;
+        gboolean         needs_lines;
+        GString         *batch;
+        GPtrArray       *pending;
+        gboolean         needs_sync;
+        GTimeVal         last_sync;
+
+        /* the main loop only moves the head and the writer thread
+         * the tail, except that dropping the oldest event moves the
+         * tail from the main loop; that, growing the ring, claiming a
+         * batch off it and giving the batch back are done holding the
+         * lock, which is otherwise just for sleeping on.  The writer
+         * formats a claimed batch without the lock, so the claimed
+         * slots are never dropped, and a ring grown meanwhile is kept
+         * until they are given back. */
+        EventSlot       *ring;
+        guint            ring_size;
+        guint            n_claimed;
+        GSList          *old_rings;
+        int              queue_depth;
+        volatile gint    overflow;
+        volatile gint    ring_head;
+        volatile gint    ring_tail;
+        guint            n_lost;        /* main loop only */
+        GMutex          *wait_lock;
+        GCond           *events_cond;
+        volatile gint    writer_waiting;
+
+        volatile gint    n_events;
+        volatile gint    n_batches;
+        volatile gint    n_syncs;
+        volatile gint    max_batch;
+        volatile gint    n_dropped;
 };
 
 enum {
         PROP_0,
-        PROP_LOG_FILENAME
+        PROP_LOG_FILENAME,
+        PROP_WRITE_FILE,
+        PROP_SOCKET_PATH,
+        PROP_MEMORY_EVENTS,
+        PROP_SYNC_INTERVAL,
+        PROP_BINARY_FORMAT,
+        PROP_QUEUE_DEPTH,
+        PROP_OVERFLOW
 };
 
+static int      default_sync_interval = -1;
+static gboolean default_binary_format = FALSE;
+static int      default_queue_depth = DEFAULT_QUEUE_DEPTH;
+static int      default_overflow = CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST;
+static gboolean default_write_file = TRUE;
+static char    *default_socket_path = NULL;
+static int      default_memory_events = 0;
+
 static void     ck_event_logger_class_init  (CkEventLoggerClass *klass);
 static void     ck_event_logger_init        (CkEventLogger      *event_logger);
 static void     ck_event_logger_finalize    (GObject            *object);
@@ -72,202 +156,585 @@ ck_event_logger_error_quark (void)
         return ret;
 }
 
-gboolean
-ck_event_logger_queue_event (CkEventLogger      *event_logger,
-                             CkLogEvent         *event,
-                             GError            **error)
+static guint
+ring_length (CkEventLogger *event_logger)
 {
-        CkLogEvent *event_copy;
-        gboolean    ret;
+        return (guint) g_atomic_int_get (&event_logger->priv->ring_head)
+                - (guint) g_atomic_int_get (&event_logger->priv->ring_tail);
+}
 
-        g_return_val_if_fail (CK_IS_EVENT_LOGGER (event_logger), FALSE);
-        g_return_val_if_fail (event != NULL, FALSE);
+static gboolean
+ring_is_full (CkEventLogger *event_logger)
+{
+        return ring_length (event_logger) >= (guint) event_logger->priv->queue_depth;
+}
 
-        event_copy = ck_log_event_copy (event);
+static EventSlot *
+ring_slot (CkEventLogger *event_logger,
+           guint          index)
+{
+        return &event_logger->priv->ring[index & (event_logger->priv->ring_size - 1)];
+}
+
+/* Called from the main loop when every slot is in use.  The slots are
+ * moved to a ring twice the size under the lock.  Each slot keeps its
+ * index, so the head and tail stay as they are.  If the writer has
+ * claimed slots it is still reading them from the old ring, so that
+ * is only freed once they are given back. */
+static void
+grow_ring (CkEventLogger *event_logger)
+{
+        EventSlot *old_ring;
+        guint      old_size;
+        guint      tail;
+        guint      head;
+        guint      i;
+
+        old_ring = event_logger->priv->ring;
+        old_size = event_logger->priv->ring_size;
+
+        g_debug ("Event queue is full; growing it to %u events", old_size * 2);
+
+        g_mutex_lock (event_logger->priv->wait_lock);
+
+        event_logger->priv->ring = g_new0 (EventSlot, old_size * 2);
+        event_logger->priv->ring_size = old_size * 2;
+
+        tail = g_atomic_int_get (&event_logger->priv->ring_tail);
+        head = g_atomic_int_get (&event_logger->priv->ring_head);
+        for (i = tail; i != head; i++) {
+                EventSlot *from;
+                EventSlot *to;
+
+                from = &old_ring[i & (old_size - 1)];
+                to = ring_slot (event_logger, i);
+
+                to->n_lost_before = from->n_lost_before;
+                to->copy = from->copy;
+                if (to->copy == NULL) {
+                        /* it fitted in a slot before */
+                        ck_log_event_block_copy_event (&to->event,
+                                                       &from->event,
+                                                       to->strings,
+                                                       sizeof (to->strings));
+                }
+        }
 
-        g_async_queue_push (event_logger->priv->event_queue,
-                            event_copy);
+        if (event_logger->priv->n_claimed > 0) {
+                event_logger->priv->old_rings = g_slist_prepend (event_logger->priv->old_rings, old_ring);
+                old_ring = NULL;
+        }
+
+        g_mutex_unlock (event_logger->priv->wait_lock);
+
+        g_free (old_ring);
+}
+
+/* The dropped event is counted against the next one in the queue, or
+ * the next one queued if there are no others.  Returns FALSE if the
+ * oldest event is being written and so can't be dropped. */
+static gboolean
+drop_oldest_event (CkEventLogger *event_logger)
+{
+        EventSlot *slot;
+        guint      tail;
+        guint      n_lost;
+        gboolean   ret;
 
         ret = TRUE;
 
+        g_mutex_lock (event_logger->priv->wait_lock);
+
+        if (event_logger->priv->n_claimed > 0) {
+                ret = ! ring_is_full (event_logger);
+        } else if (ring_is_full (event_logger)) {
+                tail = g_atomic_int_get (&event_logger->priv->ring_tail);
+                slot = ring_slot (event_logger, tail);
+
+                n_lost = slot->n_lost_before + 1;
+                if (slot->copy != NULL) {
+                        ck_log_event_free (slot->copy);
+                        slot->copy = NULL;
+                }
+                g_atomic_int_set (&event_logger->priv->ring_tail, (gint) (tail + 1));
+
+                if (ring_length (event_logger) > 0) {
+                        ring_slot (event_logger, tail + 1)->n_lost_before += n_lost;
+                } else {
+                        event_logger->priv->n_lost += n_lost;
+                }
+
+                g_atomic_int_inc (&event_logger->priv->n_dropped);
+        }
+
+        g_mutex_unlock (event_logger->priv->wait_lock);
+
         return ret;
 }
 
-/* Adapted from auditd auditd-event.c */
+/* Only ever called from the main loop.  Returns FALSE if the event
+ * was dropped. */
 static gboolean
-open_log_file (CkEventLogger *event_logger)
-{
-        int   flags;
-        int   fd;
-        int   res;
-        char *dirname;
-
-        /*
-         * Likely errors on rotate: ENFILE, ENOMEM, ENOSPC
-         */
-        flags = O_WRONLY | O_APPEND;
-#ifdef O_NOFOLLOW
-        flags |= O_NOFOLLOW;
-#endif
+push_event (CkEventLogger *event_logger,
+            CkLogEvent    *event,
+            gboolean       may_drop)
+{
+        EventSlot *slot;
+        guint      head;
+        int        overflow;
 
-        dirname = g_path_get_dirname (event_logger->priv->log_filename);
-        /* always make sure we have a directory */
-        errno = 0;
-        res = g_mkdir_with_parents (dirname,
-                                    S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
-        if (res < 0) {
-                g_warning ("Unable to create directory %s (%s)",
-                           dirname,
-                           g_strerror (errno));
-                g_free (dirname);
-                return FALSE;
-        }
-        g_free (dirname);
-
-retry:
-        errno = 0;
-        fd = g_open (event_logger->priv->log_filename, flags, 0600);
-        if (fd < 0) {
-                if (errno == ENOENT) {
-                        fd = g_open (event_logger->priv->log_filename,
-                                     O_CREAT | O_EXCL | O_APPEND,
-                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-                        if (fd < 0) {
-                                g_warning ("Couldn't create log file %s (%s)",
-                                           event_logger->priv->log_filename,
-                                           g_strerror (errno));
-                                return FALSE;
-                        }
+        if (may_drop && ring_is_full (event_logger)) {
+                overflow = g_atomic_int_get (&event_logger->priv->overflow);
 
-                        close (fd);
-                        fd = g_open (event_logger->priv->log_filename, flags, 0600);
-                } else if (errno == ENFILE) {
-                        /* All system descriptors used, try again... */
-                        goto retry;
-                }
-                if (fd < 0) {
-                        g_warning ("Couldn't open log file %s (%s)",
-                                   event_logger->priv->log_filename,
-                                   g_strerror (errno));
+                switch (overflow) {
+                case CK_EVENT_LOGGER_OVERFLOW_DROP_OLDEST:
+                        if (drop_oldest_event (event_logger)) {
+                                break;
+                        }
+                        /* the oldest events are being written, so
+                         * this one goes instead */
+                        /* fall through */
+                case CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST:
+                        event_logger->priv->n_lost++;
+                        g_atomic_int_inc (&event_logger->priv->n_dropped);
                         return FALSE;
+                default:
+                        break;
                 }
         }
 
-        if (fcntl (fd, F_SETFD, FD_CLOEXEC) == -1) {
-                close (fd);
-                g_warning ("Error setting log file CLOEXEC flag (%s)",
-                           g_strerror (errno));
-                return FALSE;
+        if (ring_length (event_logger) >= event_logger->priv->ring_size) {
+                grow_ring (event_logger);
         }
 
-        if (fchown (fd, 0, 0) == -1) {
-                close (fd);
-                g_warning ("Error setting owner of log file (%s)",
-                           g_strerror (errno));
-                return FALSE;
+        head = g_atomic_int_get (&event_logger->priv->ring_head);
+        slot = ring_slot (event_logger, head);
+
+        if (ck_log_event_block_copy_event (&slot->event,
+                                           event,
+                                           slot->strings,
+                                           sizeof (slot->strings))) {
+                slot->copy = NULL;
+        } else {
+                slot->copy = ck_log_event_copy (event);
         }
+        slot->n_lost_before = event_logger->priv->n_lost;
+        event_logger->priv->n_lost = 0;
 
-        event_logger->priv->file = fdopen (fd, "a");
-        if (event_logger->priv->file == NULL) {
-                g_warning ("Error setting up log descriptor (%s)",
-                           g_strerror (errno));
-                close (fd);
-                return FALSE;
+        g_atomic_int_set (&event_logger->priv->ring_head, (gint) (head + 1));
+
+        /* the writer only needs waking for the first event of a batch */
+        if (g_atomic_int_get (&event_logger->priv->writer_waiting)) {
+                g_mutex_lock (event_logger->priv->wait_lock);
+                g_cond_signal (event_logger->priv->events_cond);
+                g_mutex_unlock (event_logger->priv->wait_lock);
         }
-        event_logger->priv->fd = fd;
 
-        /* Set it to line buffering */
-        setlinebuf (event_logger->priv->file);
+        return TRUE;
+}
+
+gboolean
+ck_event_logger_queue_event (CkEventLogger      *event_logger,
+                             CkLogEvent         *event,
+                             GError            **error)
+{
+        g_return_val_if_fail (CK_IS_EVENT_LOGGER (event_logger), FALSE);
+        g_return_val_if_fail (event != NULL, FALSE);
+
+        /* nothing would ever empty the queue */
+        if (event_logger->priv->writer_thread == NULL) {
+                g_debug ("No writer thread; not logging event");
+                return TRUE;
+        }
+
+        push_event (event_logger, event, TRUE);
 
         return TRUE;
 }
 
+guint
+ck_event_logger_get_queue_length (CkEventLogger *event_logger)
+{
+        g_return_val_if_fail (CK_IS_EVENT_LOGGER (event_logger), 0);
+
+        return ring_length (event_logger);
+}
+
+void
+ck_event_logger_get_stats (CkEventLogger      *event_logger,
+                           CkEventLoggerStats *stats)
+{
+        g_return_if_fail (CK_IS_EVENT_LOGGER (event_logger));
+        g_return_if_fail (stats != NULL);
+
+        stats->n_events = g_atomic_int_get (&event_logger->priv->n_events);
+        stats->n_batches = g_atomic_int_get (&event_logger->priv->n_batches);
+        stats->n_syncs = g_atomic_int_get (&event_logger->priv->n_syncs);
+        stats->max_batch = g_atomic_int_get (&event_logger->priv->max_batch);
+        stats->n_dropped = g_atomic_int_get (&event_logger->priv->n_dropped);
+        stats->n_unsent = 0;
+        if (event_logger->priv->socket_sink != NULL) {
+                stats->n_unsent = ck_event_sink_socket_get_n_unsent (event_logger->priv->socket_sink);
+        }
+}
+
+/**
+ * ck_event_logger_get_recent_events:
+ * @event_logger: a #CkEventLogger
+ * @after: the number of the last event already seen, or 0
+ * @last: return location for the number of the newest event
+ *
+ * Returns: the events kept in memory that are newer than @after, as
+ * lines of history, oldest first, or %NULL if no events are kept
+ */
+char **
+ck_event_logger_get_recent_events (CkEventLogger *event_logger,
+                                   guint          after,
+                                   guint         *last)
+{
+        g_return_val_if_fail (CK_IS_EVENT_LOGGER (event_logger), NULL);
+
+        if (event_logger->priv->ring_sink == NULL) {
+                return NULL;
+        }
+
+        return ck_event_sink_ring_get_events (event_logger->priv->ring_sink, after, last);
+}
+
+/* Used by the daemon options; applies to loggers created afterwards */
+void
+ck_event_logger_set_default_sync_interval (int interval)
+{
+        default_sync_interval = interval;
+}
+
+void
+ck_event_logger_set_default_binary_format (gboolean binary)
+{
+        default_binary_format = binary;
+}
+
+void
+ck_event_logger_set_default_queue_depth (int depth)
+{
+        default_queue_depth = CLAMP (depth, 1, MAX_QUEUE_DEPTH);
+}
+
+void
+ck_event_logger_set_default_overflow (CkEventLoggerOverflow overflow)
+{
+        default_overflow = overflow;
+}
+
+void
+ck_event_logger_set_default_write_file (gboolean write_file)
+{
+        default_write_file = write_file;
+}
+
+void
+ck_event_logger_set_default_socket_path (const char *path)
+{
+        g_free (default_socket_path);
+        default_socket_path = g_strdup (path);
+}
+
+void
+ck_event_logger_set_default_memory_events (int n_events)
+{
+        default_memory_events = MAX (n_events, 0);
+}
+
 static void
-reopen_file_stream (CkEventLogger *event_logger)
+sync_log_file (CkEventLogger *event_logger)
 {
-        /* fclose will also close the underlying fd */
-        if (event_logger->priv->file != NULL) {
-                fclose (event_logger->priv->file);
+        GSList *l;
+
+        for (l = event_logger->priv->sinks; l != NULL; l = l->next) {
+                ck_event_sink_sync (l->data);
         }
 
-        /* FIXME: retries */
-        open_log_file (event_logger);
+        event_logger->priv->needs_sync = FALSE;
+        g_get_current_time (&event_logger->priv->last_sync);
+        g_atomic_int_inc (&event_logger->priv->n_syncs);
 }
 
 static void
-check_file_stream (CkEventLogger *event_logger)
-{
-        int         old_fd;
-        struct stat old_stats;
-        int         new_fd;
-        struct stat new_stats;
-
-        old_fd = event_logger->priv->fd;
-        if (fstat (old_fd, &old_stats) != 0) {
-                g_warning ("Unable to stat file: %s",
-                           g_strerror (errno));
-                reopen_file_stream (event_logger);
+maybe_sync_log_file (CkEventLogger *event_logger)
+{
+        int      interval;
+        GTimeVal now;
+        glong    elapsed;
+
+        interval = g_atomic_int_get (&event_logger->priv->sync_interval);
+        if (interval < 0 || ! event_logger->priv->needs_sync) {
                 return;
         }
 
-        new_fd = g_open (event_logger->priv->log_filename, O_RDONLY | O_NONBLOCK, 0600);
-        if (new_fd == -1 || fstat (new_fd, &new_stats) < 0) {
-                close (new_fd);
-                g_debug ("Unable to open or stat %s - will try to reopen", event_logger->priv->log_filename);
-                reopen_file_stream (event_logger);
+        if (interval > 0) {
+                g_get_current_time (&now);
+                elapsed = (now.tv_sec - event_logger->priv->last_sync.tv_sec) * 1000
+                        + (now.tv_usec - event_logger->priv->last_sync.tv_usec) / 1000;
+                if (elapsed >= 0 && elapsed < interval) {
+                        return;
+                }
+        }
+
+        sync_log_file (event_logger);
+}
+
+/* The event has to stay valid until encode_pending_events() */
+static void
+add_event_to_batch (CkEventLogger *event_logger,
+                    CkLogEvent    *event)
+{
+        GString *lines;
+        gsize    start;
+
+        if (event_logger->priv->binary_format) {
+                g_ptr_array_add (event_logger->priv->pending, event);
+        }
+
+        if (! event_logger->priv->needs_lines) {
                 return;
         }
-        close (new_fd);
 
-        if (old_stats.st_ino != new_stats.st_ino || old_stats.st_dev != new_stats.st_dev) {
-                g_debug ("File %s has been replaced; writing to end of new file", event_logger->priv->log_filename);
-                reopen_file_stream (event_logger);
+        lines = event_logger->priv->lines;
+        start = lines->len;
+        ck_log_event_to_string (event, lines);
+        g_debug ("Writing log for event: %s", lines->str + start);
+        g_string_append_c (lines, '\n');
+        g_array_append_val (event_logger->priv->line_ends, lines->len);
+}
+
+static void
+encode_pending_events (CkEventLogger *event_logger)
+{
+        GPtrArray *pending;
+
+        pending = event_logger->priv->pending;
+        if (pending->len == 0) {
                 return;
         }
+
+        ck_log_event_block_append (event_logger->priv->batch,
+                                   (CkLogEvent **) pending->pdata,
+                                   pending->len);
+
+        g_ptr_array_set_size (pending, 0);
 }
 
+static void
+write_batch (CkEventLogger *event_logger,
+             int            n_events)
+{
+        CkEventSinkBatch batch;
+        GSList          *l;
+
+        batch.lines = event_logger->priv->lines->str;
+        batch.line_ends = (const gsize *) event_logger->priv->line_ends->data;
+        batch.n_events = event_logger->priv->line_ends->len;
+
+        if (event_logger->priv->binary_format) {
+                batch.log_data = event_logger->priv->batch->str;
+                batch.log_len = event_logger->priv->batch->len;
+        } else {
+                batch.log_data = event_logger->priv->lines->str;
+                batch.log_len = event_logger->priv->lines->len;
+        }
+
+        for (l = event_logger->priv->sinks; l != NULL; l = l->next) {
+                CkEventSink *sink;
+
+                sink = l->data;
+                if (ck_event_sink_write (sink, &batch) && ck_event_sink_can_sync (sink)) {
+                        event_logger->priv->needs_sync = TRUE;
+                }
+        }
+
+        g_string_truncate (event_logger->priv->lines, 0);
+        g_array_set_size (event_logger->priv->line_ends, 0);
+        g_string_truncate (event_logger->priv->batch, 0);
+
+        g_atomic_int_add (&event_logger->priv->n_events, n_events);
+        g_atomic_int_inc (&event_logger->priv->n_batches);
+        if (n_events > g_atomic_int_get (&event_logger->priv->max_batch)) {
+                g_atomic_int_set (&event_logger->priv->max_batch, n_events);
+        }
+}
+
+/* Returns FALSE if @deadline passed with nothing queued */
 static gboolean
-write_log_for_event (CkEventLogger *event_logger,
-                     CkLogEvent    *event)
+wait_for_events (CkEventLogger  *event_logger,
+                 const GTimeVal *deadline)
 {
-        GString *str;
+        gboolean ret;
 
-        str = g_string_new (NULL);
+        if (ring_length (event_logger) > 0) {
+                return TRUE;
+        }
 
-        ck_log_event_to_string (event, str);
+        ret = TRUE;
+
+        g_mutex_lock (event_logger->priv->wait_lock);
+        g_atomic_int_set (&event_logger->priv->writer_waiting, TRUE);
+        while (ring_length (event_logger) == 0) {
+                if (deadline == NULL) {
+                        g_cond_wait (event_logger->priv->events_cond,
+                                     event_logger->priv->wait_lock);
+                } else if (! g_cond_timed_wait (event_logger->priv->events_cond,
+                                                event_logger->priv->wait_lock,
+                                                (GTimeVal *) deadline)) {
+                        ret = ring_length (event_logger) > 0;
+                        break;
+                }
+        }
+        g_atomic_int_set (&event_logger->priv->writer_waiting, FALSE);
+        g_mutex_unlock (event_logger->priv->wait_lock);
 
-        g_debug ("Writing log for event: %s", str->str);
-        check_file_stream (event_logger);
+        return ret;
+}
 
-        if (event_logger->priv->file != NULL) {
-                int         rc;
+static gboolean
+wait_for_batch (CkEventLogger *event_logger)
+{
+        int      interval;
+        GTimeVal deadline;
 
-                rc = fprintf (event_logger->priv->file, "%s\n", str->str);
-                if (rc <= 0) {
-                        g_warning ("Record was not written to disk (%s)",
-                                   g_strerror (errno));
+        interval = g_atomic_int_get (&event_logger->priv->sync_interval);
+        if (interval <= 0 || ! event_logger->priv->needs_sync) {
+                return wait_for_events (event_logger, NULL);
+        }
+
+        /* wake up in time to sync the last batch even if nothing
+         * else gets logged */
+        deadline = event_logger->priv->last_sync;
+        g_time_val_add (&deadline, (glong) interval * 1000);
+
+        return wait_for_events (event_logger, &deadline);
+}
+
+/* Gives back the slots claimed for a batch once it is formatted */
+static void
+release_slots (CkEventLogger *event_logger,
+               guint          tail,
+               guint          n_slots)
+{
+        GSList *old_rings;
+        guint   i;
+
+        g_mutex_lock (event_logger->priv->wait_lock);
+
+        for (i = 0; i < n_slots; i++) {
+                EventSlot *slot;
+
+                slot = ring_slot (event_logger, tail + i);
+                if (slot->copy != NULL) {
+                        ck_log_event_free (slot->copy);
+                        slot->copy = NULL;
                 }
-        } else {
-                g_warning ("Log file not open for writing");
         }
 
-        g_string_free (str, TRUE);
+        g_atomic_int_set (&event_logger->priv->ring_tail, (gint) (tail + n_slots));
+        event_logger->priv->n_claimed = 0;
 
-        return TRUE;
+        old_rings = event_logger->priv->old_rings;
+        event_logger->priv->old_rings = NULL;
+
+        g_mutex_unlock (event_logger->priv->wait_lock);
+
+        g_slist_foreach (old_rings, (GFunc) g_free, NULL);
+        g_slist_free (old_rings);
+}
+
+static void
+add_lost_record (CkEventLogger *event_logger,
+                 EventSlot     *slot,
+                 CkLogEvent    *event)
+{
+        memset (&slot->lost, 0, sizeof (slot->lost));
+        slot->lost.type = CK_LOG_EVENT_EVENTS_LOST;
+        slot->lost.timestamp = event->timestamp;
+        slot->lost.event.events_lost.n_events = slot->n_lost_before;
+
+        g_warning ("%u events were not logged", slot->n_lost_before);
+
+        add_event_to_batch (event_logger, &slot->lost);
 }
 
+/* Everything that is queued when the thread wakes up is written with
+ * a single write, so a burst of logins costs one write (and at most one
+ * sync) rather than one per event.  Only claiming the slots is done
+ * under the lock; they are formatted without it and given back before
+ * the batch is written, so a stalled write doesn't hold on to them. */
 static void *
 writer_thread_start (CkEventLogger *event_logger)
 {
-        CkLogEvent *event;
+        gboolean done;
+
+        done = FALSE;
+        while (! done) {
+                EventSlot  *slots[MAX_BATCH_EVENTS];
+                guint       tail;
+                guint       n_slots;
+                guint       i;
+                int         n_events;
+
+                if (! wait_for_batch (event_logger)) {
+                        /* timed out waiting for the next event */
+                        maybe_sync_log_file (event_logger);
+                        continue;
+                }
 
-        while (1) {
-                event = g_async_queue_pop (event_logger->priv->event_queue);
-                if (event == NULL || event->type == CK_LOG_EVENT_NONE) {
-                        break;
+                g_mutex_lock (event_logger->priv->wait_lock);
+
+                tail = g_atomic_int_get (&event_logger->priv->ring_tail);
+                n_slots = MIN (ring_length (event_logger), MAX_BATCH_EVENTS);
+                event_logger->priv->n_claimed = n_slots;
+
+                /* the slots can't be dropped or freed once claimed,
+                 * but the ring can be replaced by a larger one */
+                for (i = 0; i < n_slots; i++) {
+                        slots[i] = ring_slot (event_logger, tail + i);
+                }
+
+                g_mutex_unlock (event_logger->priv->wait_lock);
+
+                n_events = 0;
+                for (i = 0; i < n_slots; i++) {
+                        EventSlot  *slot;
+                        CkLogEvent *event;
+
+                        slot = slots[i];
+                        event = slot->copy != NULL ? slot->copy : &slot->event;
+
+                        if (slot->n_lost_before > 0) {
+                                add_lost_record (event_logger, slot, event);
+                                n_events++;
+                        }
+
+                        if (event->type == CK_LOG_EVENT_NONE) {
+                                done = TRUE;
+                                i++;
+                                break;
+                        }
+
+                        add_event_to_batch (event_logger, event);
+                        n_events++;
+                }
+
+                encode_pending_events (event_logger);
+                release_slots (event_logger, tail, i);
+
+                if (n_events > 0) {
+                        write_batch (event_logger, n_events);
+                        maybe_sync_log_file (event_logger);
                 }
-                write_log_for_event (event_logger, event);
-                ck_log_event_free (event);
+        }
+
+        if (event_logger->priv->needs_sync
+            && g_atomic_int_get (&event_logger->priv->sync_interval) >= 0) {
+                sync_log_file (event_logger);
         }
 
         g_debug ("Writer thread received None event - exiting");
@@ -300,17 +767,61 @@ destroy_writer_thread (CkEventLogger *event_logger)
 {
         CkLogEvent event;
 
+        if (event_logger->priv->writer_thread == NULL) {
+                return;
+        }
+
+        memset (&event, 0, sizeof (event));
         event.type = CK_LOG_EVENT_NONE;
 
         g_debug ("Destroying writer thread");
-        g_async_queue_push (event_logger->priv->event_queue,
-                            &event);
+        push_event (event_logger, &event, FALSE);
 #if 1
         g_debug ("Joining writer thread");
         g_thread_join (event_logger->priv->writer_thread);
 #endif
 }
 
+static void
+add_sink (CkEventLogger *event_logger,
+          CkEventSink   *sink)
+{
+        event_logger->priv->sinks = g_slist_append (event_logger->priv->sinks, sink);
+}
+
+static void
+create_sinks (CkEventLogger *event_logger)
+{
+        CkEventSink *sink;
+
+        if (event_logger->priv->write_file) {
+                sink = ck_event_sink_file_new (event_logger->priv->log_filename);
+                if (sink != NULL) {
+                        add_sink (event_logger, sink);
+                }
+        }
+
+        if (event_logger->priv->socket_path != NULL) {
+                sink = ck_event_sink_socket_new (event_logger->priv->socket_path);
+                if (sink != NULL) {
+                        event_logger->priv->socket_sink = sink;
+                        event_logger->priv->needs_lines = TRUE;
+                        add_sink (event_logger, sink);
+                }
+        }
+
+        if (event_logger->priv->memory_events > 0) {
+                sink = ck_event_sink_ring_new (event_logger->priv->memory_events);
+                event_logger->priv->ring_sink = sink;
+                event_logger->priv->needs_lines = TRUE;
+                add_sink (event_logger, sink);
+        }
+
+        if (! event_logger->priv->binary_format) {
+                event_logger->priv->needs_lines = TRUE;
+        }
+}
+
 static GObject *
 ck_event_logger_constructor (GType                  type,
                              guint                  n_construct_properties,
@@ -325,7 +836,14 @@ ck_event_logger_constructor (GType                  type,
                                                                                                     n_construct_properties,
                                                                                                     construct_properties));
 
-        if (open_log_file (event_logger)) {
+        event_logger->priv->ring_size = 1;
+        while (event_logger->priv->ring_size < (guint) event_logger->priv->queue_depth) {
+                event_logger->priv->ring_size <<= 1;
+        }
+        event_logger->priv->ring = g_new0 (EventSlot, event_logger->priv->ring_size);
+
+        create_sinks (event_logger);
+        if (event_logger->priv->sinks != NULL) {
                 create_writer_thread (event_logger);
         }
 
@@ -354,6 +872,28 @@ ck_event_logger_set_property (GObject            *object,
         case PROP_LOG_FILENAME:
                 _ck_event_logger_set_log_filename (self, g_value_get_string (value));
                 break;
+        case PROP_WRITE_FILE:
+                self->priv->write_file = g_value_get_boolean (value);
+                break;
+        case PROP_SOCKET_PATH:
+                g_free (self->priv->socket_path);
+                self->priv->socket_path = g_value_dup_string (value);
+                break;
+        case PROP_MEMORY_EVENTS:
+                self->priv->memory_events = g_value_get_int (value);
+                break;
+        case PROP_SYNC_INTERVAL:
+                g_atomic_int_set (&self->priv->sync_interval, g_value_get_int (value));
+                break;
+        case PROP_BINARY_FORMAT:
+                self->priv->binary_format = g_value_get_boolean (value);
+                break;
+        case PROP_QUEUE_DEPTH:
+                self->priv->queue_depth = g_value_get_int (value);
+                break;
+        case PROP_OVERFLOW:
+                g_atomic_int_set (&self->priv->overflow, g_value_get_int (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -374,6 +914,27 @@ ck_event_logger_get_property (GObject    *object,
         case PROP_LOG_FILENAME:
                 g_value_set_string (value, self->priv->log_filename);
                 break;
+        case PROP_WRITE_FILE:
+                g_value_set_boolean (value, self->priv->write_file);
+                break;
+        case PROP_SOCKET_PATH:
+                g_value_set_string (value, self->priv->socket_path);
+                break;
+        case PROP_MEMORY_EVENTS:
+                g_value_set_int (value, self->priv->memory_events);
+                break;
+        case PROP_SYNC_INTERVAL:
+                g_value_set_int (value, g_atomic_int_get (&self->priv->sync_interval));
+                break;
+        case PROP_BINARY_FORMAT:
+                g_value_set_boolean (value, self->priv->binary_format);
+                break;
+        case PROP_QUEUE_DEPTH:
+                g_value_set_int (value, self->priv->queue_depth);
+                break;
+        case PROP_OVERFLOW:
+                g_value_set_int (value, g_atomic_int_get (&self->priv->overflow));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -397,6 +958,64 @@ ck_event_logger_class_init (CkEventLoggerClass *klass)
                                                               "log-filename",
                                                               DEFAULT_LOG_FILENAME,
                                                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_WRITE_FILE,
+                                         g_param_spec_boolean ("write-file",
+                                                               "write-file",
+                                                               "Append events to the log file",
+                                                               TRUE,
+                                                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_SOCKET_PATH,
+                                         g_param_spec_string ("socket-path",
+                                                              "socket-path",
+                                                              "Local datagram or seqpacket socket to send each event to",
+                                                              NULL,
+                                                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_MEMORY_EVENTS,
+                                         g_param_spec_int ("memory-events",
+                                                           "memory-events",
+                                                           "Number of recent events to keep in memory",
+                                                           0,
+                                                           G_MAXINT,
+                                                           0,
+                                                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_SYNC_INTERVAL,
+                                         g_param_spec_int ("sync-interval",
+                                                           "sync-interval",
+                                                           "Milliseconds between syncs of the log file, 0 to sync every write and -1 to never sync",
+                                                           -1,
+                                                           G_MAXINT,
+                                                           -1,
+                                                           G_PARAM_READWRITE));
+        /* the writer thread reads this, so it can only be set at construction */
+        g_object_class_install_property (object_class,
+                                         PROP_BINARY_FORMAT,
+                                         g_param_spec_boolean ("binary-format",
+                                                               "binary-format",
+                                                               "Write the log as binary blocks instead of text lines",
+                                                               FALSE,
+                                                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_QUEUE_DEPTH,
+                                         g_param_spec_int ("queue-depth",
+                                                           "queue-depth",
+                                                           "Largest number of events waiting to be written",
+                                                           1,
+                                                           MAX_QUEUE_DEPTH,
+                                                           DEFAULT_QUEUE_DEPTH,
+                                                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_OVERFLOW,
+                                         g_param_spec_int ("overflow",
+                                                           "overflow",
+                                                           "What to do with an event when the queue is full, a CkEventLoggerOverflow",
+                                                           CK_EVENT_LOGGER_OVERFLOW_GROW,
+                                                           CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST,
+                                                           CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST,
+                                                           G_PARAM_READWRITE));
 
         g_type_class_add_private (klass, sizeof (CkEventLoggerPrivate));
 }
@@ -406,7 +1025,19 @@ ck_event_logger_init (CkEventLogger *event_logger)
 {
         event_logger->priv = CK_EVENT_LOGGER_GET_PRIVATE (event_logger);
 
-        event_logger->priv->event_queue = g_async_queue_new ();
+        event_logger->priv->write_file = default_write_file;
+        event_logger->priv->socket_path = g_strdup (default_socket_path);
+        event_logger->priv->memory_events = default_memory_events;
+        event_logger->priv->sync_interval = default_sync_interval;
+        event_logger->priv->binary_format = default_binary_format;
+        event_logger->priv->queue_depth = default_queue_depth;
+        event_logger->priv->overflow = default_overflow;
+        event_logger->priv->lines = g_string_sized_new (4096);
+        event_logger->priv->line_ends = g_array_new (FALSE, FALSE, sizeof (gsize));
+        event_logger->priv->batch = g_string_sized_new (4096);
+        event_logger->priv->pending = g_ptr_array_new ();
+        event_logger->priv->wait_lock = g_mutex_new ();
+        event_logger->priv->events_cond = g_cond_new ();
 }
 
 static void
@@ -423,14 +1054,18 @@ ck_event_logger_finalize (GObject *object)
 
         destroy_writer_thread (event_logger);
 
-        if (event_logger->priv->event_queue != NULL) {
-                g_async_queue_unref (event_logger->priv->event_queue);
-        }
+        g_free (event_logger->priv->ring);
+        g_cond_free (event_logger->priv->events_cond);
+        g_mutex_free (event_logger->priv->wait_lock);
 
-        if (event_logger->priv->file != NULL) {
-                fclose (event_logger->priv->file);
-        }
+        g_slist_foreach (event_logger->priv->sinks, (GFunc) ck_event_sink_free, NULL);
+        g_slist_free (event_logger->priv->sinks);
 
+        g_ptr_array_free (event_logger->priv->pending, TRUE);
+        g_string_free (event_logger->priv->batch, TRUE);
+        g_array_free (event_logger->priv->line_ends, TRUE);
+        g_string_free (event_logger->priv->lines, TRUE);
+        g_free (event_logger->priv->socket_path);
         g_free (event_logger->priv->log_filename);
 
         G_OBJECT_CLASS (ck_event_logger_parent_class)->finalize (object);
@@ -51,6 +51,28 @@ typedef enum
          CK_EVENT_LOGGER_ERROR_GENERAL
 } CkEventLoggerError;
 
+/* What to do with an event when the queue is full.  Dropped events
+ * are counted and logged as an EVENTS_LOST record.  GROW keeps every
+ * event by growing the queue, without bound, while the writer is
+ * stalled; events are queued from the main loop, which can't wait
+ * for the writer, so there is no policy that blocks. */
+typedef enum
+{
+        CK_EVENT_LOGGER_OVERFLOW_GROW = 0,
+        CK_EVENT_LOGGER_OVERFLOW_DROP_OLDEST,
+        CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST
+} CkEventLoggerOverflow;
+
+typedef struct
+{
+        guint n_events;
+        guint n_batches;
+        guint n_syncs;
+        guint max_batch;
+        guint n_dropped;
+        guint n_unsent;
+} CkEventLoggerStats;
+
 #define CK_EVENT_LOGGER_ERROR ck_event_logger_error_quark ()
 
 GQuark               ck_event_logger_error_quark         (void);
@@ -60,6 +82,20 @@ CkEventLogger      * ck_event_logger_new                 (const char         *fi
 gboolean             ck_event_logger_queue_event         (CkEventLogger      *event_logger,
                                                           CkLogEvent         *event,
                                                           GError            **error);
+guint                ck_event_logger_get_queue_length    (CkEventLogger      *event_logger);
+void                 ck_event_logger_get_stats           (CkEventLogger      *event_logger,
+                                                          CkEventLoggerStats *stats);
+char              ** ck_event_logger_get_recent_events   (CkEventLogger      *event_logger,
+                                                          guint               after,
+                                                          guint              *last);
+
+void                 ck_event_logger_set_default_sync_interval (int interval);
+void                 ck_event_logger_set_default_binary_format (gboolean binary);
+void                 ck_event_logger_set_default_queue_depth   (int      depth);
+void                 ck_event_logger_set_default_overflow      (CkEventLoggerOverflow overflow);
+void                 ck_event_logger_set_default_write_file    (gboolean write_file);
+void                 ck_event_logger_set_default_socket_path   (const char *path);
+void                 ck_event_logger_set_default_memory_events (int      n_events);
 
 G_END_DECLS
 
@@ -0,0 +1,311 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2007 William Jon McCann <mccann@jhu.edu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ck-event-sink.h"
+
+/* How often to look for the log having been rotated, in seconds */
+#define CHECK_FILE_INTERVAL 1
+
+/* Appends to the history log */
+typedef struct
+{
+        CkEventSink  parent;
+        char        *filename;
+        int          fd;
+        gboolean     needs_check;
+        GTimeVal     last_check;
+} FileSink;
+
+/* Adapted from auditd auditd-event.c */
+static gboolean
+open_log_file (FileSink *file)
+{
+        int   flags;
+        int   fd;
+        int   res;
+        char *dirname;
+
+        /*
+         * Likely errors on rotate: ENFILE, ENOMEM, ENOSPC
+         */
+        flags = O_WRONLY | O_APPEND;
+#ifdef O_NOFOLLOW
+        flags |= O_NOFOLLOW;
+#endif
+
+        dirname = g_path_get_dirname (file->filename);
+        /* always make sure we have a directory */
+        errno = 0;
+        res = g_mkdir_with_parents (dirname,
+                                    S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+        if (res < 0) {
+                g_warning ("Unable to create directory %s (%s)",
+                           dirname,
+                           g_strerror (errno));
+                g_free (dirname);
+                return FALSE;
+        }
+        g_free (dirname);
+
+retry:
+        errno = 0;
+        fd = g_open (file->filename, flags, 0600);
+        if (fd < 0) {
+                if (errno == ENOENT) {
+                        fd = g_open (file->filename,
+                                     O_CREAT | O_EXCL | O_APPEND,
+                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+                        if (fd < 0) {
+                                g_warning ("Couldn't create log file %s (%s)",
+                                           file->filename,
+                                           g_strerror (errno));
+                                return FALSE;
+                        }
+
+                        close (fd);
+                        fd = g_open (file->filename, flags, 0600);
+                } else if (errno == ENFILE) {
+                        /* All system descriptors used, try again... */
+                        goto retry;
+                }
+                if (fd < 0) {
+                        g_warning ("Couldn't open log file %s (%s)",
+                                   file->filename,
+                                   g_strerror (errno));
+                        return FALSE;
+                }
+        }
+
+        if (fcntl (fd, F_SETFD, FD_CLOEXEC) == -1) {
+                close (fd);
+                g_warning ("Error setting log file CLOEXEC flag (%s)",
+                           g_strerror (errno));
+                return FALSE;
+        }
+
+        if (fchown (fd, 0, 0) == -1) {
+                close (fd);
+                g_warning ("Error setting owner of log file (%s)",
+                           g_strerror (errno));
+                return FALSE;
+        }
+
+        file->fd = fd;
+
+        return TRUE;
+}
+
+static void
+reopen_file_stream (FileSink *file)
+{
+        if (file->fd != -1) {
+                close (file->fd);
+                file->fd = -1;
+        }
+
+        /* FIXME: retries */
+        open_log_file (file);
+}
+
+static void
+check_file_stream (FileSink *file)
+{
+        int         old_fd;
+        struct stat old_stats;
+        struct stat new_stats;
+
+        old_fd = file->fd;
+        if (fstat (old_fd, &old_stats) != 0) {
+                g_warning ("Unable to stat file: %s",
+                           g_strerror (errno));
+                reopen_file_stream (file);
+                return;
+        }
+
+        if (g_stat (file->filename, &new_stats) < 0) {
+                g_debug ("Unable to stat %s - will try to reopen", file->filename);
+                reopen_file_stream (file);
+                return;
+        }
+
+        if (old_stats.st_ino != new_stats.st_ino || old_stats.st_dev != new_stats.st_dev) {
+                g_debug ("File %s has been replaced; writing to end of new file", file->filename);
+                reopen_file_stream (file);
+                return;
+        }
+}
+
+/* logrotate moves the file aside and creates a new one; rather than
+ * look for that before every write, check at most once every
+ * CHECK_FILE_INTERVAL seconds, or right away after a failed write.
+ * Anything written in between lands at the end of the rotated file. */
+static void
+maybe_check_file_stream (FileSink *file)
+{
+        GTimeVal now;
+
+        g_get_current_time (&now);
+
+        if (file->fd != -1
+            && ! file->needs_check
+            && now.tv_sec >= file->last_check.tv_sec
+            && now.tv_sec - file->last_check.tv_sec < CHECK_FILE_INTERVAL) {
+                return;
+        }
+
+        check_file_stream (file);
+
+        file->needs_check = FALSE;
+        file->last_check = now;
+}
+
+static gboolean
+write_all (int         fd,
+           const char *buf,
+           gsize       len)
+{
+        while (len > 0) {
+                ssize_t n;
+
+                n = write (fd, buf, len);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return FALSE;
+                }
+
+                buf += n;
+                len -= n;
+        }
+
+        return TRUE;
+}
+
+
+static gboolean
+file_sink_write (CkEventSink            *sink,
+                 const CkEventSinkBatch *batch)
+{
+        FileSink *file;
+
+        file = (FileSink *) sink;
+
+        maybe_check_file_stream (file);
+
+        if (file->fd == -1) {
+                g_warning ("Log file not open for writing");
+                return FALSE;
+        }
+
+        if (! write_all (file->fd, batch->log_data, batch->log_len)) {
+                g_warning ("Records were not written to disk (%s)",
+                           g_strerror (errno));
+                file->needs_check = TRUE;
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+file_sink_sync (CkEventSink *sink)
+{
+        FileSink *file;
+        int       res;
+
+        file = (FileSink *) sink;
+
+        if (file->fd == -1) {
+                return;
+        }
+
+#ifdef HAVE_FDATASYNC
+        res = fdatasync (file->fd);
+#else
+        res = fsync (file->fd);
+#endif
+        if (res != 0) {
+                g_warning ("Unable to sync log file: %s",
+                           g_strerror (errno));
+        }
+}
+
+static void
+file_sink_free (CkEventSink *sink)
+{
+        FileSink *file;
+
+        file = (FileSink *) sink;
+
+        if (file->fd != -1) {
+                close (file->fd);
+        }
+
+        g_free (file->filename);
+        g_free (file);
+}
+
+static const CkEventSinkClass file_sink_class = {
+        file_sink_write,
+        file_sink_sync,
+        file_sink_free
+};
+
+/**
+ * ck_event_sink_file_new:
+ * @filename: the history log
+ *
+ * Returns: a sink appending to @filename, or %NULL if it can't be
+ * opened
+ */
+CkEventSink *
+ck_event_sink_file_new (const char *filename)
+{
+        FileSink *file;
+
+        g_return_val_if_fail (filename != NULL, NULL);
+
+        file = g_new0 (FileSink, 1);
+        file->parent.klass = &file_sink_class;
+        file->filename = g_strdup (filename);
+        file->fd = -1;
+
+        if (! open_log_file (file)) {
+                file_sink_free ((CkEventSink *) file);
+                return NULL;
+        }
+
+        return (CkEventSink *) file;
+}
@@ -0,0 +1,162 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "ck-event-sink.h"
+
+/* Keeps the last events as lines of text, without the newline, for
+ * the main loop to hand out.  Events are numbered from 1 so that a
+ * reader can ask for just the ones it hasn't seen. */
+typedef struct
+{
+        CkEventSink  parent;
+        GMutex      *lock;
+        char       **lines;
+        guint        n_lines;
+        guint        last;      /* number of the newest event */
+} RingSink;
+
+static gboolean
+ring_sink_write (CkEventSink            *sink,
+                 const CkEventSinkBatch *batch)
+{
+        RingSink *ring;
+        gsize     start;
+        guint     i;
+
+        ring = (RingSink *) sink;
+
+        g_mutex_lock (ring->lock);
+
+        start = 0;
+        for (i = 0; i < batch->n_events; i++) {
+                char **line;
+                gsize  end;
+
+                end = batch->line_ends[i];
+
+                ring->last++;
+                line = &ring->lines[ring->last % ring->n_lines];
+                g_free (*line);
+                *line = g_strndup (batch->lines + start, end - start - 1);
+
+                start = end;
+        }
+
+        g_mutex_unlock (ring->lock);
+
+        return TRUE;
+}
+
+static void
+ring_sink_free (CkEventSink *sink)
+{
+        RingSink *ring;
+        guint     i;
+
+        ring = (RingSink *) sink;
+
+        for (i = 0; i < ring->n_lines; i++) {
+                g_free (ring->lines[i]);
+        }
+        g_free (ring->lines);
+        g_mutex_free (ring->lock);
+        g_free (ring);
+}
+
+static const CkEventSinkClass ring_sink_class = {
+        ring_sink_write,
+        NULL,
+        ring_sink_free
+};
+
+/**
+ * ck_event_sink_ring_new:
+ * @n_events: the number of events to keep
+ *
+ * Returns: a sink keeping the last @n_events events in memory
+ */
+CkEventSink *
+ck_event_sink_ring_new (guint n_events)
+{
+        RingSink *ring;
+
+        g_return_val_if_fail (n_events > 0, NULL);
+
+        ring = g_new0 (RingSink, 1);
+        ring->parent.klass = &ring_sink_class;
+        ring->lock = g_mutex_new ();
+        ring->lines = g_new0 (char *, n_events);
+        ring->n_lines = n_events;
+
+        return (CkEventSink *) ring;
+}
+
+/**
+ * ck_event_sink_ring_get_events:
+ * @sink: a sink made by ck_event_sink_ring_new()
+ * @after: the number of the last event already seen, or 0
+ * @last: return location for the number of the newest event
+ *
+ * Returns: the events kept that are newer than @after, oldest first,
+ * to be freed with g_strfreev()
+ */
+char **
+ck_event_sink_ring_get_events (CkEventSink *sink,
+                               guint        after,
+                               guint       *last)
+{
+        RingSink *ring;
+        char    **events;
+        guint     first;
+        guint     n;
+        guint     i;
+
+        g_return_val_if_fail (sink != NULL, NULL);
+        g_return_val_if_fail (sink->klass == &ring_sink_class, NULL);
+
+        ring = (RingSink *) sink;
+
+        g_mutex_lock (ring->lock);
+
+        /* the oldest event still kept */
+        first = ring->last >= ring->n_lines ? ring->last - ring->n_lines + 1 : 1;
+        if (after >= first && after <= ring->last) {
+                first = after + 1;
+        }
+
+        n = ring->last + 1 - first;
+        events = g_new (char *, n + 1);
+        for (i = 0; i < n; i++) {
+                events[i] = g_strdup (ring->lines[(first + i) % ring->n_lines]);
+        }
+        events[n] = NULL;
+
+        if (last != NULL) {
+                *last = ring->last;
+        }
+
+        g_mutex_unlock (ring->lock);
+
+        return events;
+}
@@ -0,0 +1,234 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "ck-event-sink.h"
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL)
+#else
+#define SEND_FLAGS MSG_DONTWAIT
+#endif
+
+/* How often to try connecting again while nobody is listening, in
+ * seconds */
+#define RECONNECT_INTERVAL 1
+
+/* Sends each event as a line of text, without the newline, in a
+ * message of its own to a local datagram or seqpacket socket.  Sends
+ * never block: while the listener is gone or not keeping up, events
+ * are counted and dropped rather than holding up the history log. */
+typedef struct
+{
+        CkEventSink   parent;
+        char         *path;
+        int           fd;
+        GTimeVal      last_connect;
+        volatile gint n_unsent;
+} SocketSink;
+
+static int
+connect_socket (const char *path,
+                int         type)
+{
+        struct sockaddr_un addr;
+        int                fd;
+
+        fd = socket (AF_UNIX, type, 0);
+        if (fd == -1) {
+                return -1;
+        }
+
+        if (fcntl (fd, F_SETFD, FD_CLOEXEC) == -1) {
+                close (fd);
+                return -1;
+        }
+
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+
+        if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+                int saved_errno;
+
+                saved_errno = errno;
+                close (fd);
+                errno = saved_errno;
+                return -1;
+        }
+
+        return fd;
+}
+
+/* The listener decides between datagrams and seqpackets; connecting
+ * with the wrong type fails with EPROTOTYPE */
+static gboolean
+maybe_connect (SocketSink *sock)
+{
+        GTimeVal now;
+
+        if (sock->fd != -1) {
+                return TRUE;
+        }
+
+        g_get_current_time (&now);
+        if (now.tv_sec >= sock->last_connect.tv_sec
+            && now.tv_sec - sock->last_connect.tv_sec < RECONNECT_INTERVAL) {
+                return FALSE;
+        }
+        sock->last_connect = now;
+
+        sock->fd = connect_socket (sock->path, SOCK_DGRAM);
+        if (sock->fd == -1 && errno == EPROTOTYPE) {
+                sock->fd = connect_socket (sock->path, SOCK_SEQPACKET);
+        }
+
+        if (sock->fd == -1) {
+                g_debug ("Unable to connect to %s: %s", sock->path, g_strerror (errno));
+                return FALSE;
+        }
+
+        g_debug ("Connected to %s", sock->path);
+
+        return TRUE;
+}
+
+static void
+disconnect (SocketSink *sock)
+{
+        close (sock->fd);
+        sock->fd = -1;
+}
+
+static gboolean
+socket_sink_write (CkEventSink            *sink,
+                   const CkEventSinkBatch *batch)
+{
+        SocketSink *sock;
+        gsize       start;
+        guint       i;
+
+        sock = (SocketSink *) sink;
+
+        if (! maybe_connect (sock)) {
+                g_atomic_int_add (&sock->n_unsent, batch->n_events);
+                return FALSE;
+        }
+
+        start = 0;
+        for (i = 0; i < batch->n_events; i++) {
+                gsize end;
+
+                end = batch->line_ends[i];
+
+                while (send (sock->fd, batch->lines + start, end - start - 1, SEND_FLAGS) == -1) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+
+                        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                                g_atomic_int_inc (&sock->n_unsent);
+                                break;
+                        }
+
+                        g_debug ("Unable to send to %s: %s", sock->path, g_strerror (errno));
+                        disconnect (sock);
+                        g_atomic_int_add (&sock->n_unsent, batch->n_events - i);
+                        return FALSE;
+                }
+
+                start = end;
+        }
+
+        return TRUE;
+}
+
+static void
+socket_sink_free (CkEventSink *sink)
+{
+        SocketSink *sock;
+
+        sock = (SocketSink *) sink;
+
+        if (sock->fd != -1) {
+                close (sock->fd);
+        }
+
+        g_free (sock->path);
+        g_free (sock);
+}
+
+static const CkEventSinkClass socket_sink_class = {
+        socket_sink_write,
+        NULL,
+        socket_sink_free
+};
+
+/**
+ * ck_event_sink_socket_new:
+ * @path: the path of a local socket
+ *
+ * The socket needn't exist yet; the sink keeps trying to connect to it.
+ *
+ * Returns: a sink sending each event to @path, or %NULL if @path is
+ * too long for a socket address
+ */
+CkEventSink *
+ck_event_sink_socket_new (const char *path)
+{
+        SocketSink        *sock;
+        struct sockaddr_un addr;
+
+        g_return_val_if_fail (path != NULL, NULL);
+
+        if (strlen (path) >= sizeof (addr.sun_path)) {
+                g_warning ("Socket path is too long: %s", path);
+                return NULL;
+        }
+
+        sock = g_new0 (SocketSink, 1);
+        sock->parent.klass = &socket_sink_class;
+        sock->path = g_strdup (path);
+        sock->fd = -1;
+
+        return (CkEventSink *) sock;
+}
+
+/* Events that were dropped because nobody was listening or the
+ * listener wasn't keeping up; may be called from any thread */
+guint
+ck_event_sink_socket_get_n_unsent (CkEventSink *sink)
+{
+        g_return_val_if_fail (sink != NULL, 0);
+        g_return_val_if_fail (sink->klass == &socket_sink_class, 0);
+
+        return g_atomic_int_get (&((SocketSink *) sink)->n_unsent);
+}
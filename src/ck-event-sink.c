@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "ck-event-sink.h"
+
+/**
+ * ck_event_sink_write:
+ * @sink: a #CkEventSink
+ * @batch: the events to write
+ *
+ * Returns: %TRUE if the events were written
+ */
+gboolean
+ck_event_sink_write (CkEventSink            *sink,
+                     const CkEventSinkBatch *batch)
+{
+        g_return_val_if_fail (sink != NULL, FALSE);
+        g_return_val_if_fail (batch != NULL, FALSE);
+
+        return sink->klass->write (sink, batch);
+}
+
+/* Whether writing to the sink leaves something to be synced */
+gboolean
+ck_event_sink_can_sync (CkEventSink *sink)
+{
+        g_return_val_if_fail (sink != NULL, FALSE);
+
+        return sink->klass->sync != NULL;
+}
+
+void
+ck_event_sink_sync (CkEventSink *sink)
+{
+        g_return_if_fail (sink != NULL);
+
+        if (sink->klass->sync != NULL) {
+                sink->klass->sync (sink);
+        }
+}
+
+void
+ck_event_sink_free (CkEventSink *sink)
+{
+        if (sink == NULL) {
+                return;
+        }
+
+        sink->klass->free (sink);
+}
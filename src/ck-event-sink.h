@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __CK_EVENT_SINK_H
+#define __CK_EVENT_SINK_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Where the event logger writes events to.  Sinks are only used from
+ * the writer thread, apart from the queries of the ring sink. */
+typedef struct CkEventSink CkEventSink;
+
+/* A batch of events, as text lines and in the format of the history
+ * log, which is the same as the lines unless it is binary */
+typedef struct
+{
+        const char  *lines;
+        const gsize *line_ends;     /* offset just past the newline of each line */
+        guint        n_events;
+
+        const char  *log_data;
+        gsize        log_len;
+} CkEventSinkBatch;
+
+typedef struct
+{
+        gboolean (* write) (CkEventSink            *sink,
+                            const CkEventSinkBatch *batch);
+        void     (* sync)  (CkEventSink            *sink);
+        void     (* free)  (CkEventSink            *sink);
+} CkEventSinkClass;
+
+struct CkEventSink
+{
+        const CkEventSinkClass *klass;
+};
+
+CkEventSink        * ck_event_sink_file_new            (const char             *filename);
+CkEventSink        * ck_event_sink_socket_new          (const char             *path);
+CkEventSink        * ck_event_sink_ring_new            (guint                   n_events);
+
+gboolean             ck_event_sink_write               (CkEventSink            *sink,
+                                                        const CkEventSinkBatch *batch);
+gboolean             ck_event_sink_can_sync            (CkEventSink            *sink);
+void                 ck_event_sink_sync                (CkEventSink            *sink);
+void                 ck_event_sink_free                (CkEventSink            *sink);
+
+guint                ck_event_sink_socket_get_n_unsent (CkEventSink            *sink);
+char              ** ck_event_sink_ring_get_events     (CkEventSink            *sink,
+                                                        guint                   after,
+                                                        guint                  *last);
+
+G_END_DECLS
+
+#endif /* __CK_EVENT_SINK_H */
@@ -58,6 +58,9 @@ enum {
 
 static guint signals [LAST_SIGNAL] = { 0, };
 
+/* children that have been started and not yet reaped */
+static guint n_pending_jobs = 0;
+
 static void     ck_job_class_init  (CkJobClass *klass);
 static void     ck_job_init        (CkJob      *job);
 static void     ck_job_finalize    (GObject     *object);
@@ -101,6 +104,9 @@ wait_on_job (CkJob *job)
 
         status = wait_on_child (job->priv->child_pid);
 
+        if (job->priv->child_pid > 0) {
+                n_pending_jobs--;
+        }
         g_spawn_close_pid (job->priv->child_pid);
         job->priv->child_pid = 0;
 
@@ -252,6 +258,8 @@ ck_job_execute (CkJob   *job,
                 return FALSE;
         }
 
+        n_pending_jobs++;
+
         /* output channel */
         channel = g_io_channel_unix_new (standard_output);
         g_io_channel_set_close_on_unref (channel, TRUE);
@@ -279,6 +287,15 @@ ck_job_execute (CkJob   *job,
         return res;
 }
 
+/* Only helpers run through CkJob are counted, which today means
+ * ck-collect-session-info; the callouts of ck_run_programs() are not
+ * jobs. */
+guint
+ck_job_get_n_pending (void)
+{
+        return n_pending_jobs;
+}
+
 gboolean
 ck_job_get_stdout (CkJob *job,
                    char **std_outp)
@@ -71,6 +71,8 @@ gboolean            ck_job_get_stderr          (CkJob      *job,
                                                 char      **std_error);
 gboolean            ck_job_cancel              (CkJob      *job);
 
+guint               ck_job_get_n_pending       (void);
+
 G_END_DECLS
 
 #endif /* __CK_JOB_H */
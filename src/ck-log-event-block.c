@@ -0,0 +1,562 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ck-log-event.h"
+#include "ck-log-event-block.h"
+
+/* Layout of a block, all integers little endian:
+ *
+ *   header   magic[4] payload_len:u32 first:i64 last:i64
+ *            n_strings:u16 n_records:u16
+ *   strings  n_strings times  len:u16 bytes[len]
+ *   records  n_records times  len:u16 type:u8 n_strings:u8 n_uints:u8
+ *                             pad:u8 timestamp:i64 string:u16[n_strings]
+ *                             uint:u32[n_uints]
+ *
+ * Timestamps are in microseconds.  The record length counts the bytes
+ * after the length field, so readers can step over records of types
+ * they don't know.  The first and last timestamps of a block let a
+ * reader skip it without decoding anything.
+ */
+
+#define NULL_STRING      0xffff
+#define MAX_STRING_LEN   0xfffe
+#define RECORD_FIXED_LEN 12
+
+typedef struct
+{
+        CkLogEventType type;
+        guint          n_strings;
+        glong          strings[8];
+        guint          n_uints;
+        glong          uints[2];
+} EventLayout;
+
+static const EventLayout layouts[] = {
+        { CK_LOG_EVENT_SEAT_ADDED,
+          1, { G_STRUCT_OFFSET (CkLogSeatAddedEvent, seat_id) },
+          1, { G_STRUCT_OFFSET (CkLogSeatAddedEvent, seat_kind) } },
+        { CK_LOG_EVENT_SEAT_REMOVED,
+          1, { G_STRUCT_OFFSET (CkLogSeatRemovedEvent, seat_id) },
+          1, { G_STRUCT_OFFSET (CkLogSeatRemovedEvent, seat_kind) } },
+        { CK_LOG_EVENT_SYSTEM_STOP,
+          0, { 0 },
+          0, { 0 } },
+        { CK_LOG_EVENT_SYSTEM_RESTART,
+          0, { 0 },
+          0, { 0 } },
+        { CK_LOG_EVENT_SYSTEM_START,
+          2, { G_STRUCT_OFFSET (CkLogSystemStartEvent, kernel_release),
+               G_STRUCT_OFFSET (CkLogSystemStartEvent, boot_arguments) },
+          0, { 0 } },
+        { CK_LOG_EVENT_SEAT_SESSION_ADDED,
+          8, { G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, seat_id),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_id),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_type),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_x11_display),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_x11_display_device),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_display_device),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_remote_host_name),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_creation_time) },
+          2, { G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_is_local),
+               G_STRUCT_OFFSET (CkLogSeatSessionAddedEvent, session_unix_user) } },
+        { CK_LOG_EVENT_SEAT_SESSION_REMOVED,
+          8, { G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, seat_id),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_id),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_type),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_x11_display),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_x11_display_device),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_display_device),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_remote_host_name),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_creation_time) },
+          2, { G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_is_local),
+               G_STRUCT_OFFSET (CkLogSeatSessionRemovedEvent, session_unix_user) } },
+        { CK_LOG_EVENT_SEAT_DEVICE_ADDED,
+          3, { G_STRUCT_OFFSET (CkLogSeatDeviceAddedEvent, seat_id),
+               G_STRUCT_OFFSET (CkLogSeatDeviceAddedEvent, device_type),
+               G_STRUCT_OFFSET (CkLogSeatDeviceAddedEvent, device_id) },
+          0, { 0 } },
+        { CK_LOG_EVENT_SEAT_DEVICE_REMOVED,
+          3, { G_STRUCT_OFFSET (CkLogSeatDeviceRemovedEvent, seat_id),
+               G_STRUCT_OFFSET (CkLogSeatDeviceRemovedEvent, device_type),
+               G_STRUCT_OFFSET (CkLogSeatDeviceRemovedEvent, device_id) },
+          0, { 0 } },
+        { CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED,
+          2, { G_STRUCT_OFFSET (CkLogSeatActiveSessionChangedEvent, seat_id),
+               G_STRUCT_OFFSET (CkLogSeatActiveSessionChangedEvent, session_id) },
+          0, { 0 } },
+        { CK_LOG_EVENT_EVENTS_LOST,
+          0, { 0 },
+          1, { G_STRUCT_OFFSET (CkLogEventsLostEvent, n_events) } },
+};
+
+static const EventLayout *
+find_layout (CkLogEventType type)
+{
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (layouts); i++) {
+                if (layouts[i].type == type) {
+                        return &layouts[i];
+                }
+        }
+
+        return NULL;
+}
+
+static void
+put_u8 (GString *str,
+        guint8   val)
+{
+        g_string_append_c (str, (char) val);
+}
+
+static void
+put_u16 (GString *str,
+         guint16  val)
+{
+        val = GUINT16_TO_LE (val);
+        g_string_append_len (str, (const char *) &val, sizeof (val));
+}
+
+static void
+put_u32 (GString *str,
+         guint32  val)
+{
+        val = GUINT32_TO_LE (val);
+        g_string_append_len (str, (const char *) &val, sizeof (val));
+}
+
+static void
+put_i64 (GString *str,
+         gint64   val)
+{
+        val = GINT64_TO_LE (val);
+        g_string_append_len (str, (const char *) &val, sizeof (val));
+}
+
+static guint16
+get_u16 (const char *data)
+{
+        guint16 val;
+
+        memcpy (&val, data, sizeof (val));
+        return GUINT16_FROM_LE (val);
+}
+
+static guint32
+get_u32 (const char *data)
+{
+        guint32 val;
+
+        memcpy (&val, data, sizeof (val));
+        return GUINT32_FROM_LE (val);
+}
+
+static gint64
+get_i64 (const char *data)
+{
+        gint64 val;
+
+        memcpy (&val, data, sizeof (val));
+        return GINT64_FROM_LE (val);
+}
+
+static gint64
+timeval_to_usec (const GTimeVal *tv)
+{
+        return (gint64) tv->tv_sec * G_USEC_PER_SEC + tv->tv_usec;
+}
+
+static void
+usec_to_timeval (gint64    usec,
+                 GTimeVal *tv)
+{
+        tv->tv_sec = usec / G_USEC_PER_SEC;
+        tv->tv_usec = usec % G_USEC_PER_SEC;
+}
+
+static guint16
+intern_string (GHashTable *table,
+               GString    *strings,
+               const char *str)
+{
+        gpointer index;
+        gsize    len;
+
+        if (str == NULL) {
+                return NULL_STRING;
+        }
+
+        if (g_hash_table_lookup_extended (table, str, NULL, &index)) {
+                return GPOINTER_TO_UINT (index);
+        }
+
+        len = strlen (str);
+        if (len > MAX_STRING_LEN) {
+                len = MAX_STRING_LEN;
+        }
+
+        index = GUINT_TO_POINTER (g_hash_table_size (table));
+        g_hash_table_insert (table, (gpointer) str, index);
+
+        put_u16 (strings, len);
+        g_string_append_len (strings, str, len);
+
+        return GPOINTER_TO_UINT (index);
+}
+
+/**
+ * ck_log_event_block_append:
+ * @str: string to append the block to
+ * @events: events to encode, oldest first
+ * @n_events: number of events, at most CK_LOG_EVENT_BLOCK_MAX_EVENTS
+ *
+ * Encodes @events as one binary block.  Strings that occur more than
+ * once in the block, like seat ids and session types, are stored once.
+ *
+ * Returns: %FALSE if there was nothing to encode
+ */
+gboolean
+ck_log_event_block_append (GString     *str,
+                           CkLogEvent **events,
+                           guint        n_events)
+{
+        GHashTable *table;
+        GString    *strings;
+        GString    *records;
+        GString    *record;
+        gint64      first;
+        gint64      last;
+        guint       n_records;
+        guint       i;
+        guint       j;
+        gboolean    ret;
+
+        g_return_val_if_fail (str != NULL, FALSE);
+        g_return_val_if_fail (n_events <= CK_LOG_EVENT_BLOCK_MAX_EVENTS, FALSE);
+
+        table = g_hash_table_new (g_str_hash, g_str_equal);
+        strings = g_string_new (NULL);
+        records = g_string_new (NULL);
+        record = g_string_new (NULL);
+
+        first = G_MAXINT64;
+        last = G_MININT64;
+        n_records = 0;
+
+        for (i = 0; i < n_events; i++) {
+                const EventLayout *layout;
+                CkLogEvent        *event;
+                gint64             timestamp;
+
+                event = events[i];
+                layout = find_layout (event->type);
+                if (layout == NULL) {
+                        continue;
+                }
+
+                timestamp = timeval_to_usec (&event->timestamp);
+                first = MIN (first, timestamp);
+                last = MAX (last, timestamp);
+
+                g_string_truncate (record, 0);
+                put_u8 (record, event->type);
+                put_u8 (record, layout->n_strings);
+                put_u8 (record, layout->n_uints);
+                put_u8 (record, 0);
+                put_i64 (record, timestamp);
+                for (j = 0; j < layout->n_strings; j++) {
+                        put_u16 (record,
+                                 intern_string (table,
+                                                strings,
+                                                G_STRUCT_MEMBER (char *, event, layout->strings[j])));
+                }
+                for (j = 0; j < layout->n_uints; j++) {
+                        put_u32 (record, G_STRUCT_MEMBER (guint, event, layout->uints[j]));
+                }
+
+                put_u16 (records, record->len);
+                g_string_append_len (records, record->str, record->len);
+                n_records++;
+        }
+
+        ret = n_records > 0;
+
+        /* only possible with very long strings; split the events in
+         * two blocks rather than write one a reader will refuse */
+        if (CK_LOG_EVENT_BLOCK_HEADER_LEN + strings->len + records->len > CK_LOG_EVENT_BLOCK_MAX_LEN
+            && n_events > 1) {
+                ret = ck_log_event_block_append (str, events, n_events / 2);
+                ret = ck_log_event_block_append (str, events + n_events / 2, n_events - n_events / 2) || ret;
+        } else if (n_records > 0) {
+                g_string_append_len (str, CK_LOG_EVENT_BLOCK_MAGIC, CK_LOG_EVENT_BLOCK_MAGIC_LEN);
+                put_u32 (str, strings->len + records->len);
+                put_i64 (str, first);
+                put_i64 (str, last);
+                put_u16 (str, g_hash_table_size (table));
+                put_u16 (str, n_records);
+                g_string_append_len (str, strings->str, strings->len);
+                g_string_append_len (str, records->str, records->len);
+        }
+
+        g_string_free (record, TRUE);
+        g_string_free (records, TRUE);
+        g_string_free (strings, TRUE);
+        g_hash_table_destroy (table);
+
+        return ret;
+}
+
+/**
+ * ck_log_event_block_parse_header:
+ * @data: start of the block
+ * @len: number of bytes available at @data
+ * @block_len: return location for the size of the whole block
+ * @first: return location for the oldest timestamp in the block, or %NULL
+ * @last: return location for the newest timestamp in the block, or %NULL
+ *
+ * Returns: %FALSE if @data does not start with a valid block header
+ * or if fewer than CK_LOG_EVENT_BLOCK_HEADER_LEN bytes are available
+ */
+gboolean
+ck_log_event_block_parse_header (const char *data,
+                                 gsize       len,
+                                 gsize      *block_len,
+                                 GTimeVal   *first,
+                                 GTimeVal   *last)
+{
+        guint32 payload_len;
+        gint64  first_usec;
+        gint64  last_usec;
+        guint   n_strings;
+        guint   n_records;
+
+        if (len < CK_LOG_EVENT_BLOCK_HEADER_LEN) {
+                return FALSE;
+        }
+
+        if (memcmp (data, CK_LOG_EVENT_BLOCK_MAGIC, CK_LOG_EVENT_BLOCK_MAGIC_LEN) != 0) {
+                return FALSE;
+        }
+
+        payload_len = get_u32 (data + 4);
+        first_usec = get_i64 (data + 8);
+        last_usec = get_i64 (data + 16);
+        n_strings = get_u16 (data + 24);
+        n_records = get_u16 (data + 26);
+
+        /* reject what no writer produces, so that a damaged header is
+         * noticed before its length is trusted */
+        if (n_records == 0
+            || n_records > CK_LOG_EVENT_BLOCK_MAX_EVENTS
+            || first_usec > last_usec
+            || payload_len < n_strings * 2 + n_records * (2 + RECORD_FIXED_LEN)
+            || payload_len > CK_LOG_EVENT_BLOCK_MAX_LEN - CK_LOG_EVENT_BLOCK_HEADER_LEN) {
+                return FALSE;
+        }
+
+        *block_len = CK_LOG_EVENT_BLOCK_HEADER_LEN + (gsize) payload_len;
+        if (first != NULL) {
+                usec_to_timeval (first_usec, first);
+        }
+        if (last != NULL) {
+                usec_to_timeval (last_usec, last);
+        }
+
+        return TRUE;
+}
+
+/**
+ * ck_log_event_block_decode:
+ * @data: start of the block
+ * @len: size of the block as returned by ck_log_event_block_parse_header()
+ * @events: array to append the decoded events to
+ *
+ * Records of unknown types are skipped.
+ *
+ * Returns: %FALSE if the block is corrupt; events decoded before the
+ * corruption was found are still appended
+ */
+gboolean
+ck_log_event_block_decode (const char *data,
+                           gsize       len,
+                           GPtrArray  *events)
+{
+        const char **strings;
+        guint16     *string_lens;
+        guint        n_strings;
+        guint        n_records;
+        const char  *p;
+        const char  *end;
+        gboolean     ret;
+        guint        i;
+
+        g_return_val_if_fail (events != NULL, FALSE);
+
+        if (len < CK_LOG_EVENT_BLOCK_HEADER_LEN) {
+                return FALSE;
+        }
+
+        ret = FALSE;
+        n_strings = get_u16 (data + 24);
+        n_records = get_u16 (data + 26);
+        strings = g_new0 (const char *, n_strings);
+        string_lens = g_new0 (guint16, n_strings);
+
+        p = data + CK_LOG_EVENT_BLOCK_HEADER_LEN;
+        end = data + len;
+
+        for (i = 0; i < n_strings; i++) {
+                if (end - p < 2) {
+                        goto out;
+                }
+                string_lens[i] = get_u16 (p);
+                p += 2;
+                if (end - p < string_lens[i]) {
+                        goto out;
+                }
+                strings[i] = p;
+                p += string_lens[i];
+        }
+
+        for (i = 0; i < n_records; i++) {
+                const EventLayout *layout;
+                CkLogEvent        *event;
+                const char        *r;
+                guint              record_len;
+                guint              rec_strings;
+                guint              rec_uints;
+                guint              j;
+
+                if (end - p < 2) {
+                        goto out;
+                }
+                record_len = get_u16 (p);
+                p += 2;
+                if (end - p < record_len || record_len < RECORD_FIXED_LEN) {
+                        goto out;
+                }
+                r = p;
+                p += record_len;
+
+                rec_strings = (guint8) r[1];
+                rec_uints = (guint8) r[2];
+                if (RECORD_FIXED_LEN + rec_strings * 2 + rec_uints * 4 > record_len) {
+                        goto out;
+                }
+
+                layout = find_layout ((guint8) r[0]);
+                if (layout == NULL) {
+                        continue;
+                }
+
+                event = g_new0 (CkLogEvent, 1);
+                event->type = layout->type;
+                usec_to_timeval (get_i64 (r + 4), &event->timestamp);
+
+                for (j = 0; j < MIN (rec_strings, layout->n_strings); j++) {
+                        guint index;
+
+                        index = get_u16 (r + RECORD_FIXED_LEN + j * 2);
+                        if (index == NULL_STRING) {
+                                continue;
+                        }
+                        if (index >= n_strings) {
+                                ck_log_event_free (event);
+                                goto out;
+                        }
+
+                        G_STRUCT_MEMBER (char *, event, layout->strings[j]) = g_strndup (strings[index], string_lens[index]);
+                }
+                for (j = 0; j < MIN (rec_uints, layout->n_uints); j++) {
+                        G_STRUCT_MEMBER (guint, event, layout->uints[j]) = get_u32 (r + RECORD_FIXED_LEN + rec_strings * 2 + j * 4);
+                }
+
+                g_ptr_array_add (events, event);
+        }
+
+        ret = TRUE;
+ out:
+        g_free (string_lens);
+        g_free (strings);
+
+        return ret;
+}
+
+/**
+ * ck_log_event_block_copy_event:
+ * @dest: event to copy into
+ * @src: event to copy
+ * @buf: storage for the strings of the copy
+ * @len: size of @buf
+ *
+ * Copies @src without allocating, using the fields of the binary
+ * format to find its strings.  The copy is valid for as long as @buf.
+ *
+ * Returns: %FALSE if the strings don't fit in @buf or the event type
+ * isn't known, in which case @dest is left undefined
+ */
+gboolean
+ck_log_event_block_copy_event (CkLogEvent       *dest,
+                               const CkLogEvent *src,
+                               char             *buf,
+                               gsize             len)
+{
+        const EventLayout *layout;
+        gsize              used;
+        guint              i;
+
+        memcpy (dest, src, sizeof (CkLogEvent));
+
+        layout = find_layout (src->type);
+        if (layout == NULL) {
+                return src->type == CK_LOG_EVENT_NONE;
+        }
+
+        used = 0;
+        for (i = 0; i < layout->n_strings; i++) {
+                const char *str;
+                char      **field;
+                gsize       str_len;
+
+                str = G_STRUCT_MEMBER (const char *, src, layout->strings[i]);
+                field = G_STRUCT_MEMBER_P (dest, layout->strings[i]);
+                if (str == NULL) {
+                        continue;
+                }
+
+                str_len = strlen (str) + 1;
+                if (str_len > len - used) {
+                        return FALSE;
+                }
+
+                memcpy (buf + used, str, str_len);
+                *field = buf + used;
+                used += str_len;
+        }
+
+        return TRUE;
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_LOG_EVENT_BLOCK_H
+#define __CK_LOG_EVENT_BLOCK_H
+
+#include <glib.h>
+
+#include "ck-log-event.h"
+
+G_BEGIN_DECLS
+
+/* A block starts with a NUL byte so that it can never be mistaken
+ * for a line of the text format, which lets both be mixed in one
+ * history file. */
+#define CK_LOG_EVENT_BLOCK_MAGIC      "\0CKB"
+#define CK_LOG_EVENT_BLOCK_MAGIC_LEN  4
+#define CK_LOG_EVENT_BLOCK_HEADER_LEN 28
+
+/* Largest number of events that fit in one block */
+#define CK_LOG_EVENT_BLOCK_MAX_EVENTS 4096
+
+/* Largest size of a block, header included; readers refuse larger
+ * ones so that a damaged length can't make them buffer gigabytes */
+#define CK_LOG_EVENT_BLOCK_MAX_LEN    (16 * 1024 * 1024)
+
+gboolean             ck_log_event_block_append       (GString       *str,
+                                                      CkLogEvent   **events,
+                                                      guint          n_events);
+
+gboolean             ck_log_event_block_parse_header (const char    *data,
+                                                      gsize          len,
+                                                      gsize         *block_len,
+                                                      GTimeVal      *first,
+                                                      GTimeVal      *last);
+gboolean             ck_log_event_block_decode       (const char    *data,
+                                                      gsize          len,
+                                                      GPtrArray     *events);
+
+gboolean             ck_log_event_block_copy_event   (CkLogEvent       *dest,
+                                                      const CkLogEvent *src,
+                                                      char             *buf,
+                                                      gsize             len);
+
+G_END_DECLS
+
+#endif /* __CK_LOG_EVENT_BLOCK_H */
@@ -0,0 +1,327 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ck-log-event.h"
+#include "ck-log-event-block.h"
+#include "ck-log-event-reader.h"
+
+#define READ_CHUNK_SIZE 65536
+
+/* Reads history in either format, or a mix of both: a NUL byte
+ * starts a binary block, anything else a line of text. */
+struct CkLogEventReader
+{
+        CkLogEventReadFunc func;
+        gpointer           handle;
+        gboolean           eof;
+
+        GString           *buf;
+        gsize              pos;
+        guint64            n_read;
+
+        GPtrArray         *decoded;
+        guint              decoded_pos;
+        guint64            block_start;
+
+        gboolean           use_since;
+        GTimeVal           since;
+        gboolean           hit_since;
+};
+
+CkLogEventReader *
+ck_log_event_reader_new (CkLogEventReadFunc func,
+                         gpointer           handle)
+{
+        CkLogEventReader *reader;
+
+        g_return_val_if_fail (func != NULL, NULL);
+
+        reader = g_new0 (CkLogEventReader, 1);
+        reader->func = func;
+        reader->handle = handle;
+        reader->buf = g_string_sized_new (READ_CHUNK_SIZE);
+        reader->decoded = g_ptr_array_new ();
+
+        return reader;
+}
+
+void
+ck_log_event_reader_free (CkLogEventReader *reader)
+{
+        if (reader == NULL) {
+                return;
+        }
+
+        while (reader->decoded_pos < reader->decoded->len) {
+                ck_log_event_free (g_ptr_array_index (reader->decoded, reader->decoded_pos++));
+        }
+        g_ptr_array_free (reader->decoded, TRUE);
+        g_string_free (reader->buf, TRUE);
+        g_free (reader);
+}
+
+/* Events older than @since are dropped and noted */
+void
+ck_log_event_reader_set_since (CkLogEventReader *reader,
+                               const GTimeVal   *since)
+{
+        g_return_if_fail (reader != NULL);
+
+        if (since != NULL) {
+                reader->use_since = TRUE;
+                reader->since = *since;
+        } else {
+                reader->use_since = FALSE;
+        }
+}
+
+gboolean
+ck_log_event_reader_hit_since (CkLogEventReader *reader)
+{
+        g_return_val_if_fail (reader != NULL, FALSE);
+
+        return reader->hit_since;
+}
+
+static gsize
+available (CkLogEventReader *reader)
+{
+        return reader->buf->len - reader->pos;
+}
+
+/**
+ * ck_log_event_reader_tell:
+ * @reader: a #CkLogEventReader
+ *
+ * Returns: the offset in the stream of the line or block holding the
+ * next event, suitable for starting another reader at
+ */
+guint64
+ck_log_event_reader_tell (CkLogEventReader *reader)
+{
+        g_return_val_if_fail (reader != NULL, 0);
+
+        if (reader->decoded_pos < reader->decoded->len) {
+                return reader->block_start;
+        }
+
+        return reader->n_read - available (reader);
+}
+
+/* Makes sure at least @wanted bytes are buffered past the current
+ * position, unless the stream ends first */
+static gboolean
+fill (CkLogEventReader *reader,
+      gsize             wanted)
+{
+        while (available (reader) < wanted && ! reader->eof) {
+                gsize  old_len;
+                gssize n;
+
+                if (reader->pos > 0) {
+                        g_string_erase (reader->buf, 0, reader->pos);
+                        reader->pos = 0;
+                }
+
+                old_len = reader->buf->len;
+                g_string_set_size (reader->buf, old_len + MAX (wanted - old_len, READ_CHUNK_SIZE));
+                n = reader->func (reader->handle, reader->buf->str + old_len, reader->buf->len - old_len);
+                if (n <= 0) {
+                        if (n < 0) {
+                                g_warning ("Error reading history");
+                        }
+                        reader->eof = TRUE;
+                        n = 0;
+                }
+                g_string_truncate (reader->buf, old_len + n);
+                reader->n_read += n;
+        }
+
+        return available (reader) >= wanted;
+}
+
+static gboolean
+is_too_old (CkLogEventReader *reader,
+            const GTimeVal   *timestamp)
+{
+        if (reader->use_since && timestamp->tv_sec < reader->since.tv_sec) {
+                reader->hit_since = TRUE;
+                return TRUE;
+        }
+
+        return FALSE;
+}
+
+/* Skips a corrupt block, which starts at the current position, up to
+ * the next thing that can be read: a block or the start of a line.
+ * The length in the header can't be trusted, so the bytes are scanned
+ * one by one. */
+static void
+resync (CkLogEventReader *reader)
+{
+        guint64 start;
+
+        start = reader->n_read - available (reader);
+
+        reader->pos++;
+        while (fill (reader, 1)) {
+                char c;
+
+                c = reader->buf->str[reader->pos];
+                if (c == '\n') {
+                        reader->pos++;
+                        break;
+                }
+
+                if (c == '\0'
+                    && fill (reader, CK_LOG_EVENT_BLOCK_MAGIC_LEN)
+                    && memcmp (reader->buf->str + reader->pos,
+                               CK_LOG_EVENT_BLOCK_MAGIC,
+                               CK_LOG_EVENT_BLOCK_MAGIC_LEN) == 0) {
+                        break;
+                }
+
+                reader->pos++;
+        }
+
+        g_warning ("Skipped %" G_GUINT64_FORMAT " bytes of corrupt binary history",
+                   reader->n_read - available (reader) - start);
+}
+
+static void
+read_block (CkLogEventReader *reader)
+{
+        gsize    block_len;
+        GTimeVal last;
+
+        reader->block_start = reader->n_read - available (reader);
+
+        if (! fill (reader, CK_LOG_EVENT_BLOCK_HEADER_LEN)
+            || ! ck_log_event_block_parse_header (reader->buf->str + reader->pos,
+                                                  available (reader),
+                                                  &block_len,
+                                                  NULL,
+                                                  &last)
+            || ! fill (reader, block_len)) {
+                resync (reader);
+                return;
+        }
+
+        /* nothing in the block is recent enough; don't decode it */
+        if (is_too_old (reader, &last)) {
+                reader->pos += block_len;
+                return;
+        }
+
+        g_ptr_array_set_size (reader->decoded, 0);
+        reader->decoded_pos = 0;
+        if (! ck_log_event_block_decode (reader->buf->str + reader->pos,
+                                         block_len,
+                                         reader->decoded)) {
+                /* keep what was decoded before the damage */
+                resync (reader);
+                return;
+        }
+        reader->pos += block_len;
+}
+
+static CkLogEvent *
+read_line (CkLogEventReader *reader)
+{
+        CkLogEvent *event;
+        GString    *str;
+        const char *start;
+        const char *nl;
+        gsize       scanned;
+        gsize       len;
+
+        scanned = 0;
+        while (TRUE) {
+                start = reader->buf->str + reader->pos;
+                nl = memchr (start + scanned, '\n', available (reader) - scanned);
+                if (nl != NULL) {
+                        break;
+                }
+
+                scanned = available (reader);
+                if (! fill (reader, scanned + 1)) {
+                        break;
+                }
+        }
+
+        start = reader->buf->str + reader->pos;
+        if (nl != NULL) {
+                len = nl - start;
+                reader->pos += len + 1;
+        } else {
+                len = available (reader);
+                reader->pos += len;
+        }
+
+        str = g_string_new_len (start, len);
+        event = ck_log_event_new_from_string (str);
+        g_string_free (str, TRUE);
+
+        return event;
+}
+
+/**
+ * ck_log_event_reader_next:
+ * @reader: a #CkLogEventReader
+ *
+ * Returns: the next event in the stream, to be freed with
+ * ck_log_event_free(), or %NULL at the end of the stream
+ */
+CkLogEvent *
+ck_log_event_reader_next (CkLogEventReader *reader)
+{
+        CkLogEvent *event;
+
+        g_return_val_if_fail (reader != NULL, NULL);
+
+        while (TRUE) {
+                if (reader->decoded_pos < reader->decoded->len) {
+                        event = g_ptr_array_index (reader->decoded, reader->decoded_pos++);
+                } else if (! fill (reader, 1)) {
+                        return NULL;
+                } else if (reader->buf->str[reader->pos] == '\0') {
+                        read_block (reader);
+                        continue;
+                } else {
+                        event = read_line (reader);
+                }
+
+                if (event == NULL) {
+                        continue;
+                }
+
+                if (is_too_old (reader, &event->timestamp)) {
+                        ck_log_event_free (event);
+                        continue;
+                }
+
+                return event;
+        }
+}
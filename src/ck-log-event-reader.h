@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_LOG_EVENT_READER_H
+#define __CK_LOG_EVENT_READER_H
+
+#include <glib.h>
+
+#include "ck-log-event.h"
+
+G_BEGIN_DECLS
+
+typedef struct CkLogEventReader CkLogEventReader;
+
+/* Reads up to len bytes; returns 0 at the end and -1 on error */
+typedef gssize  (* CkLogEventReadFunc)      (gpointer     handle,
+                                             char        *buf,
+                                             gsize        len);
+
+CkLogEventReader   * ck_log_event_reader_new       (CkLogEventReadFunc  func,
+                                                    gpointer            handle);
+void                 ck_log_event_reader_free      (CkLogEventReader   *reader);
+
+void                 ck_log_event_reader_set_since (CkLogEventReader   *reader,
+                                                    const GTimeVal     *since);
+gboolean             ck_log_event_reader_hit_since (CkLogEventReader   *reader);
+guint64              ck_log_event_reader_tell      (CkLogEventReader   *reader);
+
+CkLogEvent         * ck_log_event_reader_next      (CkLogEventReader   *reader);
+
+G_END_DECLS
+
+#endif /* __CK_LOG_EVENT_READER_H */
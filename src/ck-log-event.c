@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 
 #include <glib.h>
@@ -331,6 +332,9 @@ ck_log_event_copy (CkLogEvent *event)
                 event_seat_active_session_changed_copy ((CkLogSeatActiveSessionChangedEvent *) event,
                                                         (CkLogSeatActiveSessionChangedEvent *) event_copy);
                 break;
+        case CK_LOG_EVENT_EVENTS_LOST:
+                event_copy->event.events_lost = event->event.events_lost;
+                break;
         default:
                 g_assert_not_reached ();
                 break;
@@ -373,6 +377,8 @@ ck_log_event_free (CkLogEvent *event)
         case CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED:
                 event_seat_active_session_changed_free ((CkLogSeatActiveSessionChangedEvent *) event);
                 break;
+        case CK_LOG_EVENT_EVENTS_LOST:
+                break;
         default:
                 g_assert_not_reached ();
                 break;
@@ -522,6 +528,18 @@ add_log_for_seat_device_removed (GString    *str,
                                 e->device_type ? e->device_type : "");
 }
 
+static void
+add_log_for_events_lost (GString    *str,
+                         CkLogEvent *event)
+{
+        CkLogEventsLostEvent *e;
+
+        e = (CkLogEventsLostEvent *)event;
+        g_string_append_printf (str,
+                                "n-events=%u",
+                                e->n_events);
+}
+
 static const char *
 event_type_to_name (CkLogEventType event_type)
 {
@@ -557,6 +575,9 @@ event_type_to_name (CkLogEventType event_type)
         case CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED:
                 str = "SEAT_ACTIVE_SESSION_CHANGED";
                 break;
+        case CK_LOG_EVENT_EVENTS_LOST:
+                str = "EVENTS_LOST";
+                break;
         default:
                 str = "UNKNOWN";
                 break;
@@ -592,6 +613,8 @@ event_name_to_type (const char     *event_name,
                 *event_type = CK_LOG_EVENT_SEAT_DEVICE_REMOVED;
         } else if (strcmp (event_name, "SEAT_ACTIVE_SESSION_CHANGED") == 0) {
                 *event_type = CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED;
+        } else if (strcmp (event_name, "EVENTS_LOST") == 0) {
+                *event_type = CK_LOG_EVENT_EVENTS_LOST;
         } else {
                 ret = FALSE;
         }
@@ -648,6 +671,9 @@ ck_log_event_to_string (CkLogEvent  *event,
         case CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED:
                 add_log_for_seat_active_session_changed (str, event);
                 break;
+        case CK_LOG_EVENT_EVENTS_LOST:
+                add_log_for_events_lost (str, event);
+                break;
         default:
                 g_assert_not_reached ();
                 break;
@@ -696,532 +722,450 @@ parse_value_as_ulong (const char *value,
         return TRUE;
 }
 
+/* The body of a line is a list of key=value pairs separated by
+ * spaces, where string values are quoted with '.  A quoted value
+ * ends at the first quote that is followed by the end of the line or
+ * by another key, so kernel command lines that contain quotes still
+ * come out whole. */
+
+#define MAX_LOG_FIELDS 16
+
+typedef struct
+{
+        const char *key;
+        gsize       key_len;
+        const char *value;
+        gsize       value_len;
+} LogField;
+
+typedef struct
+{
+        const char *body;
+        LogField    fields[MAX_LOG_FIELDS];
+        guint       n_fields;
+} LogFields;
+
 static gboolean
-parse_log_for_seat_added (const GString *str,
-                          CkLogEvent    *event)
+is_key_char (char c)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
-        char       *tmp;
-        CkLogSeatAddedEvent *e;
+        return g_ascii_isalnum (c) || c == '-';
+}
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
+static gboolean
+is_key_start (const char *s,
+              const char *end)
+{
+        const char *p;
 
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        for (p = s; p < end && is_key_char (*p); p++) {
+                ;
         }
 
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' seat-kind=(?P<sessionid>[0-9]*)", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
-        }
+        return p > s && p < end && *p == '=';
+}
 
-        g_regex_match (re, s, 0, &match_info);
+static gboolean
+tokenize_log (const GString *str,
+              LogFields     *fields)
+{
+        const char *p;
+        const char *end;
 
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse seat added event: %s", s);
-                goto out;
+        fields->n_fields = 0;
+
+        p = skip_header (str->str, str->len);
+        if (p == NULL) {
+                return FALSE;
         }
+        fields->body = p;
 
-        e = (CkLogSeatAddedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
+        end = str->str + str->len;
+        while (end > p && g_ascii_isspace (end[-1])) {
+                end--;
+        }
+
+        while (p < end && fields->n_fields < MAX_LOG_FIELDS) {
+                LogField *f;
 
-        tmp = g_match_info_fetch_named (match_info, "seatkind");
-        if (tmp != NULL) {
-                gulong l;
-                if (parse_value_as_ulong (tmp, &l)) {
-                        e->seat_kind = l;
+                while (p < end && *p == ' ') {
+                        p++;
+                }
+                if (! is_key_start (p, end)) {
+                        break;
                 }
-        }
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
+                f = &fields->fields[fields->n_fields++];
+                f->key = p;
+                while (*p != '=') {
+                        p++;
+                }
+                f->key_len = p - f->key;
+                p++;
+
+                if (p < end && *p == '\'') {
+                        const char *q;
+
+                        p++;
+                        f->value = p;
+                        for (q = p; q < end; q++) {
+                                if (*q != '\'') {
+                                        continue;
+                                }
+                                if (q + 1 == end || (q[1] == ' ' && is_key_start (q + 2, end))) {
+                                        break;
+                                }
+                        }
+                        f->value_len = q - p;
+                        p = q < end ? q + 1 : end;
+                } else {
+                        f->value = p;
+                        while (p < end && *p != ' ') {
+                                p++;
+                        }
+                        f->value_len = p - f->value;
+                }
         }
-        if (re != NULL) {
-                g_regex_unref (re);
+
+        return TRUE;
+}
+
+static const LogField *
+find_field (const LogFields *fields,
+            const char      *key)
+{
+        gsize len;
+        guint i;
+
+        len = strlen (key);
+        for (i = 0; i < fields->n_fields; i++) {
+                const LogField *f = &fields->fields[i];
+
+                if (f->key_len == len && memcmp (f->key, key, len) == 0) {
+                        return f;
+                }
         }
 
-        return ret;
+        return NULL;
 }
 
+/* Checks for the keys, given as a NULL terminated list */
 static gboolean
-parse_log_for_seat_removed (const GString *str,
-                            CkLogEvent    *event)
+has_fields (const LogFields *fields,
+            ...)
 {
+        va_list     args;
+        const char *key;
         gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
-        char       *tmp;
-        CkLogSeatRemovedEvent *e;
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
+        ret = TRUE;
 
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        va_start (args, fields);
+        while ((key = va_arg (args, const char *)) != NULL) {
+                if (find_field (fields, key) == NULL) {
+                        ret = FALSE;
+                        break;
+                }
         }
+        va_end (args);
 
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' seat-kind=(?P<sessionid>[0-9]*)", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
-        }
+        return ret;
+}
 
-        g_regex_match (re, s, 0, &match_info);
+static char *
+dup_field (const LogFields *fields,
+           const char      *key)
+{
+        const LogField *f;
 
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse seat removed event: %s", s);
-                goto out;
+        f = find_field (fields, key);
+        if (f == NULL) {
+                return NULL;
         }
 
-        e = (CkLogSeatRemovedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
+        return g_strndup (f->value, f->value_len);
+}
 
-        tmp = g_match_info_fetch_named (match_info, "seatkind");
-        if (tmp != NULL) {
-                gulong l;
-                if (parse_value_as_ulong (tmp, &l)) {
-                        e->seat_kind = l;
-                }
-        }
+static gboolean
+get_field_as_ulong (const LogFields *fields,
+                    const char      *key,
+                    gulong          *intval)
+{
+        const LogField *f;
+        char            buf[32];
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
-        }
-        if (re != NULL) {
-                g_regex_unref (re);
+        f = find_field (fields, key);
+        if (f == NULL || f->value_len >= sizeof (buf)) {
+                return FALSE;
         }
 
-        return ret;
+        memcpy (buf, f->value, f->value_len);
+        buf[f->value_len] = '\0';
+
+        return parse_value_as_ulong (buf, intval);
 }
 
 static gboolean
-parse_log_for_system_stop (const GString *str,
-                           CkLogEvent    *event)
+get_field_as_boolean (const LogFields *fields,
+                      const char      *key)
 {
-        gboolean    ret;
-        const char *s;
-        CkLogSystemStopEvent *e;
+        const LogField *f;
 
-        ret = FALSE;
+        f = find_field (fields, key);
 
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        return f != NULL && f->value_len == 4 && memcmp (f->value, "TRUE", 4) == 0;
+}
+
+static gboolean
+parse_log_for_seat_added (const GString *str,
+                          CkLogEvent    *event)
+{
+        LogFields            fields;
+        gulong               l;
+        CkLogSeatAddedEvent *e;
+
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        e = (CkLogSystemStopEvent *)event;
+        if (! has_fields (&fields, "seat-id", "seat-kind", NULL)) {
+                g_warning ("Unable to parse seat added event: %s", fields.body);
+                return FALSE;
+        }
 
-        ret = TRUE;
- out:
+        e = (CkLogSeatAddedEvent *)event;
+        e->seat_id = dup_field (&fields, "seat-id");
+        if (get_field_as_ulong (&fields, "seat-kind", &l)) {
+                e->seat_kind = l;
+        }
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
-parse_log_for_system_restart (const GString *str,
-                              CkLogEvent    *event)
+parse_log_for_seat_removed (const GString *str,
+                            CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        CkLogSystemRestartEvent *e;
+        LogFields              fields;
+        gulong                 l;
+        CkLogSeatRemovedEvent *e;
 
-        ret = FALSE;
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
+        }
 
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        if (! has_fields (&fields, "seat-id", "seat-kind", NULL)) {
+                g_warning ("Unable to parse seat removed event: %s", fields.body);
+                return FALSE;
         }
 
-        e = (CkLogSystemRestartEvent *)event;
+        e = (CkLogSeatRemovedEvent *)event;
+        e->seat_id = dup_field (&fields, "seat-id");
+        if (get_field_as_ulong (&fields, "seat-kind", &l)) {
+                e->seat_kind = l;
+        }
 
-        ret = TRUE;
- out:
+        return TRUE;
+}
 
-        return ret;
+static gboolean
+parse_log_for_system_stop (const GString *str,
+                           CkLogEvent    *event)
+{
+        return skip_header (str->str, str->len) != NULL;
+}
+
+static gboolean
+parse_log_for_system_restart (const GString *str,
+                              CkLogEvent    *event)
+{
+        return skip_header (str->str, str->len) != NULL;
 }
 
 static gboolean
 parse_log_for_system_start (const GString *str,
                             CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
+        LogFields              fields;
         CkLogSystemStartEvent *e;
 
-        ret = FALSE;
-        re = NULL;
-        match_info = NULL;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
         /* kernel-release and boot-arguments are attributes added in 0.4 */
-        error = NULL;
-        re = g_regex_new ("(kernel-release='(?P<release>[^']+)')?[ ]?(boot-arguments='(?P<arguments>.*)')?", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
-        }
-
-        g_regex_match (re, s, 0, &match_info);
-
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse system start event: %s", s);
-                goto out;
-        }
-
         e = (CkLogSystemStartEvent *)event;
+        e->kernel_release = dup_field (&fields, "kernel-release");
+        e->boot_arguments = dup_field (&fields, "boot-arguments");
 
-        e->kernel_release = g_match_info_fetch_named (match_info, "release");
-        e->boot_arguments = g_match_info_fetch_named (match_info, "arguments");
+        return TRUE;
+}
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
+/* session added and removed events carry the same attributes */
+static gboolean
+parse_session_fields (const LogFields             *fields,
+                      CkLogSeatSessionAddedEvent  *e)
+{
+        gulong l;
+
+        if (! has_fields (fields,
+                          "seat-id",
+                          "session-id",
+                          "session-type",
+                          "session-x11-display",
+                          "session-x11-display-device",
+                          "session-display-device",
+                          "session-remote-host-name",
+                          "session-is-local",
+                          "session-unix-user",
+                          "session-creation-time",
+                          NULL)) {
+                return FALSE;
         }
-        if (re != NULL) {
-                g_regex_unref (re);
+
+        e->seat_id = dup_field (fields, "seat-id");
+        e->session_id = dup_field (fields, "session-id");
+        e->session_type = dup_field (fields, "session-type");
+        e->session_x11_display = dup_field (fields, "session-x11-display");
+        e->session_x11_display_device = dup_field (fields, "session-x11-display-device");
+        e->session_display_device = dup_field (fields, "session-display-device");
+        e->session_remote_host_name = dup_field (fields, "session-remote-host-name");
+        e->session_creation_time = dup_field (fields, "session-creation-time");
+        e->session_is_local = get_field_as_boolean (fields, "session-is-local");
+        if (get_field_as_ulong (fields, "session-unix-user", &l)) {
+                e->session_unix_user = l;
         }
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
 parse_log_for_seat_session_added (const GString *str,
                                   CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
-        char       *tmp;
-        CkLogSeatSessionAddedEvent *e;
+        LogFields fields;
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
-        }
-
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' session-id='(?P<sessionid>[a-zA-Z0-9/]+)' session-type='(?P<sessiontype>[a-zA-Z0-9 ]*)' session-x11-display='(?P<sessionx11display>[0-9a-zA-Z.:]*)' session-x11-display-device='(?P<sessionx11displaydevice>[^']*)' session-display-device='(?P<sessiondisplaydevice>[^']*)' session-remote-host-name='(?P<sessionremovehostname>[^']*)' session-is-local=(?P<sessionislocal>[a-zA-Z]*) session-unix-user=(?P<sessionunixuser>[0-9]*) session-creation-time='(?P<sessioncreationtime>[^']*)'", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
-        }
-
-        g_regex_match (re, s, 0, &match_info);
-
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse session added event: %s", s);
-                goto out;
-        }
-
-        e = (CkLogSeatSessionAddedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
-        e->session_id = g_match_info_fetch_named (match_info, "sessionid");
-        e->session_type = g_match_info_fetch_named (match_info, "sessiontype");
-        e->session_x11_display = g_match_info_fetch_named (match_info, "sessionx11display");
-        e->session_x11_display_device = g_match_info_fetch_named (match_info, "sessionx11displaydevice");
-        e->session_display_device = g_match_info_fetch_named (match_info, "sessiondisplaydevice");
-        e->session_remote_host_name = g_match_info_fetch_named (match_info, "sessionremotehostname");
-        e->session_creation_time = g_match_info_fetch_named (match_info, "sessioncreationtime");
-
-        tmp = g_match_info_fetch_named (match_info, "sessionislocal");
-        if (tmp != NULL && strcmp (tmp, "TRUE") == 0) {
-                e->session_is_local = TRUE;
-        } else {
-                e->session_is_local = FALSE;
-        }
-        g_free (tmp);
-
-        tmp = g_match_info_fetch_named (match_info, "sessionunixuser");
-        if (tmp != NULL) {
-                gulong l;
-                if (parse_value_as_ulong (tmp, &l)) {
-                        e->session_unix_user = l;
-                }
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
-        }
-        if (re != NULL) {
-                g_regex_unref (re);
+        if (! parse_session_fields (&fields, (CkLogSeatSessionAddedEvent *)event)) {
+                g_warning ("Unable to parse session added event: %s", fields.body);
+                return FALSE;
         }
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
 parse_log_for_seat_session_removed (const GString *str,
                                     CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
-        char       *tmp;
-        CkLogSeatSessionRemovedEvent *e;
-
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
-        }
-
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' session-id='(?P<sessionid>[a-zA-Z0-9/]+)' session-type='(?P<sessiontype>[a-zA-Z0-9 ]*)' session-x11-display='(?P<sessionx11display>[0-9a-zA-Z.:]*)' session-x11-display-device='(?P<sessionx11displaydevice>[^']*)' session-display-device='(?P<sessiondisplaydevice>[^']*)' session-remote-host-name='(?P<sessionremovehostname>[^']*)' session-is-local=(?P<sessionislocal>[a-zA-Z]*) session-unix-user=(?P<sessionunixuser>[0-9]*) session-creation-time='(?P<sessioncreationtime>[^']*)'", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
-        }
-
-        g_regex_match (re, s, 0, &match_info);
-
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse session removed event: %s", s);
-                goto out;
-        }
+        LogFields fields;
 
-        e = (CkLogSeatSessionRemovedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
-        e->session_id = g_match_info_fetch_named (match_info, "sessionid");
-        e->session_type = g_match_info_fetch_named (match_info, "sessiontype");
-        e->session_x11_display = g_match_info_fetch_named (match_info, "sessionx11display");
-        e->session_x11_display_device = g_match_info_fetch_named (match_info, "sessionx11displaydevice");
-        e->session_display_device = g_match_info_fetch_named (match_info, "sessiondisplaydevice");
-        e->session_remote_host_name = g_match_info_fetch_named (match_info, "sessionremotehostname");
-        e->session_creation_time = g_match_info_fetch_named (match_info, "sessioncreationtime");
-
-        tmp = g_match_info_fetch_named (match_info, "sessionislocal");
-        if (tmp != NULL && strcmp (tmp, "TRUE") == 0) {
-                e->session_is_local = TRUE;
-        } else {
-                e->session_is_local = FALSE;
-        }
-        g_free (tmp);
-
-        tmp = g_match_info_fetch_named (match_info, "sessionunixuser");
-        if (tmp != NULL) {
-                gulong l;
-                if (parse_value_as_ulong (tmp, &l)) {
-                        e->session_unix_user = l;
-                }
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
-        }
-        if (re != NULL) {
-                g_regex_unref (re);
+        /* the removed event has the same layout as the added one */
+        if (! parse_session_fields (&fields, (CkLogSeatSessionAddedEvent *)event)) {
+                g_warning ("Unable to parse session removed event: %s", fields.body);
+                return FALSE;
         }
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
 parse_log_for_seat_active_session_changed (const GString *str,
                                            CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
+        LogFields                           fields;
         CkLogSeatActiveSessionChangedEvent *e;
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
-        }
-
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' session-id='(?P<sessionid>[a-zA-Z0-9/]*)'", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        g_regex_match (re, s, 0, &match_info);
-
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse session changed event: %s", s);
-                goto out;
+        if (! has_fields (&fields, "seat-id", "session-id", NULL)) {
+                g_warning ("Unable to parse session changed event: %s", fields.body);
+                return FALSE;
         }
 
         e = (CkLogSeatActiveSessionChangedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
-        e->session_id = g_match_info_fetch_named (match_info, "sessionid");
+        e->seat_id = dup_field (&fields, "seat-id");
+        e->session_id = dup_field (&fields, "session-id");
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
-        }
-        if (re != NULL) {
-                g_regex_unref (re);
-        }
-
-        return ret;
+        return TRUE;
 }
 
 static gboolean
 parse_log_for_seat_device_added (const GString *str,
                                  CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
+        LogFields                  fields;
         CkLogSeatDeviceAddedEvent *e;
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
-        }
-
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' device-id='(?P<deviceid>[^']+)' device-type='(?P<devicetype>[^']+)'", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        g_regex_match (re, s, 0, &match_info);
-
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse device added event: %s", s);
-                goto out;
+        if (! has_fields (&fields, "seat-id", "device-id", "device-type", NULL)) {
+                g_warning ("Unable to parse device added event: %s", fields.body);
+                return FALSE;
         }
 
         e = (CkLogSeatDeviceAddedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
-        e->device_id = g_match_info_fetch_named (match_info, "deviceid");
-        e->device_type = g_match_info_fetch_named (match_info, "devicetype");
-
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
-        }
-        if (re != NULL) {
-                g_regex_unref (re);
-        }
+        e->seat_id = dup_field (&fields, "seat-id");
+        e->device_id = dup_field (&fields, "device-id");
+        e->device_type = dup_field (&fields, "device-type");
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
 parse_log_for_seat_device_removed (const GString *str,
                                    CkLogEvent    *event)
 {
-        gboolean    ret;
-        const char *s;
-        GRegex     *re;
-        GMatchInfo *match_info;
-        gboolean    res;
-        GError     *error;
+        LogFields                    fields;
         CkLogSeatDeviceRemovedEvent *e;
 
-        re = NULL;
-        match_info = NULL;
-        ret = FALSE;
-
-        s = skip_header (str->str, str->len);
-        if (s == NULL) {
-                goto out;
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
 
-        error = NULL;
-        re = g_regex_new ("seat-id='(?P<seatid>[a-zA-Z0-9/]+)' device-id='(?P<deviceid>[^']+)' device-type='(?P<devicetype>[^']+)'", 0, 0, &error);
-        if (re == NULL) {
-                g_warning ("%s", error->message);
-                goto out;
+        if (! has_fields (&fields, "seat-id", "device-id", "device-type", NULL)) {
+                g_warning ("Unable to parse device removed event: %s", fields.body);
+                return FALSE;
         }
 
-        g_regex_match (re, s, 0, &match_info);
+        e = (CkLogSeatDeviceRemovedEvent *)event;
+        e->seat_id = dup_field (&fields, "seat-id");
+        e->device_id = dup_field (&fields, "device-id");
+        e->device_type = dup_field (&fields, "device-type");
 
-        res = g_match_info_matches (match_info);
-        if (! res) {
-                g_warning ("Unable to parse device removed event: %s", s);
-                goto out;
-        }
+        return TRUE;
+}
 
-        e = (CkLogSeatDeviceRemovedEvent *)event;
-        e->seat_id = g_match_info_fetch_named (match_info, "seatid");
-        e->device_id = g_match_info_fetch_named (match_info, "deviceid");
-        e->device_type = g_match_info_fetch_named (match_info, "devicetype");
+static gboolean
+parse_log_for_events_lost (const GString *str,
+                           CkLogEvent    *event)
+{
+        LogFields             fields;
+        gulong                l;
+        CkLogEventsLostEvent *e;
 
-        ret = TRUE;
- out:
-        if (match_info != NULL) {
-                g_match_info_free (match_info);
+        if (! tokenize_log (str, &fields)) {
+                return FALSE;
         }
-        if (re != NULL) {
-                g_regex_unref (re);
+
+        e = (CkLogEventsLostEvent *)event;
+        if (! get_field_as_ulong (&fields, "n-events", &l)) {
+                g_warning ("Unable to parse events lost event: %s", fields.body);
+                return FALSE;
         }
+        e->n_events = l;
 
-        return ret;
+        return TRUE;
 }
 
 static gboolean
@@ -1255,6 +1199,32 @@ parse_log_for_any (const GString *str,
         return ret;
 }
 
+/* Reads only the timestamp and type at the start of a line, so
+ * callers can skip events they aren't interested in cheaply */
+gboolean
+ck_log_event_parse_header (const GString  *str,
+                           CkLogEventType *type,
+                           GTimeVal       *timestamp)
+{
+        CkLogEvent event;
+
+        g_return_val_if_fail (str != NULL, FALSE);
+
+        memset (&event, 0, sizeof (event));
+        if (! parse_log_for_any (str, &event)) {
+                return FALSE;
+        }
+
+        if (type != NULL) {
+                *type = event.type;
+        }
+        if (timestamp != NULL) {
+                *timestamp = event.timestamp;
+        }
+
+        return TRUE;
+}
+
 gboolean
 ck_log_event_fill_from_string (CkLogEvent    *event,
                                const GString *str)
@@ -1302,6 +1272,9 @@ ck_log_event_fill_from_string (CkLogEvent    *event,
         case CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED:
                 res = parse_log_for_seat_active_session_changed (str, event);
                 break;
+        case CK_LOG_EVENT_EVENTS_LOST:
+                res = parse_log_for_events_lost (str, event);
+                break;
         default:
                 g_assert_not_reached ();
                 break;
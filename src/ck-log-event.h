@@ -41,6 +41,7 @@ typedef enum
         CK_LOG_EVENT_SEAT_DEVICE_ADDED,
         CK_LOG_EVENT_SEAT_DEVICE_REMOVED,
         CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED,
+        CK_LOG_EVENT_EVENTS_LOST,
 } CkLogEventType;
 
 typedef struct
@@ -124,6 +125,12 @@ typedef struct
         char *device_id;
 } CkLogSeatDeviceRemovedEvent;
 
+/* Written in place of events the logger had to drop */
+typedef struct
+{
+        guint n_events;
+} CkLogEventsLostEvent;
+
 typedef struct
 {
         union {
@@ -138,6 +145,7 @@ typedef struct
                 CkLogSeatActiveSessionChangedEvent seat_active_session_changed;
                 CkLogSeatDeviceAddedEvent seat_device_added;
                 CkLogSeatDeviceRemovedEvent seat_device_removed;
+                CkLogEventsLostEvent events_lost;
         } event;
 
         GTimeVal       timestamp;
@@ -148,6 +156,9 @@ CkLogEvent         * ck_log_event_copy             (CkLogEvent    *event);
 void                 ck_log_event_free             (CkLogEvent    *event);
 
 CkLogEvent         * ck_log_event_new_from_string  (const GString *str);
+gboolean             ck_log_event_parse_header     (const GString  *str,
+                                                    CkLogEventType *type,
+                                                    GTimeVal       *timestamp);
 gboolean             ck_log_event_fill_from_string (CkLogEvent    *event,
                                                     const GString *str);
 
@@ -30,6 +30,7 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <pwd.h>
+#include <time.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -51,7 +52,13 @@
 #include "ck-session-leader.h"
 #include "ck-session.h"
 #include "ck-marshal.h"
+#include "ck-stats.h"
 #include "ck-event-logger.h"
+#include "ck-vt-monitor.h"
+#include "ck-job.h"
+#include "ck-caller-info.h"
+#include "ck-process-cache.h"
+#include "ck-database-writer.h"
 
 #include "ck-sysdeps.h"
 
@@ -62,6 +69,11 @@
 #define CK_DBUS_PATH         "/org/freedesktop/ConsoleKit"
 #define CK_MANAGER_DBUS_PATH CK_DBUS_PATH "/Manager"
 #define CK_MANAGER_DBUS_NAME "org.freedesktop.ConsoleKit.Manager"
+#define CK_DATABASE_BIN_FILE LOCALSTATEDIR "/run/ConsoleKit/database.bin"
+
+/* bound on the number of processes whose session cookie we remember */
+#define CK_USER_NAME_CACHE_SIZE 256
+#define CK_PROCESS_CACHE_SIZE 1024
 
 struct CkManagerPrivate
 {
@@ -73,6 +85,16 @@ struct CkManagerPrivate
         GHashTable      *sessions;
         GHashTable      *leaders;
 
+        /* secondary indexes over sessions; the lists hold no refs */
+        GHashTable      *sessions_by_uid;
+        GHashTable      *sessions_by_login_session_id;
+        GHashTable      *session_index_keys;
+        GHashTable      *leaders_by_service_name;
+        GHashTable      *real_user_sessions;
+        GHashTable      *user_names;
+
+        CkProcessCache  *process_cache;
+
         DBusGProxy      *bus_proxy;
         DBusGConnection *connection;
         CkEventLogger   *logger;
@@ -82,6 +104,11 @@ struct CkManagerPrivate
 
         gboolean         system_idle_hint;
         GTimeVal         system_idle_since_hint;
+        guint            n_busy_sessions;
+
+        gboolean         dump_dirty;
+        guint            dump_idle_id;
+        guint64          dump_generation;
 };
 
 enum {
@@ -176,18 +203,139 @@ out:
         return ret;
 }
 
+/* Keeps @str to be freed by write_database_bin() */
+static const char *
+take_string (GPtrArray *strings,
+             char      *str)
+{
+        if (str != NULL) {
+                g_ptr_array_add (strings, str);
+        }
+
+        return str;
+}
+
+static gboolean
+write_database_bin (CkManager *manager)
+{
+        CkDatabaseWriterSession *sessions;
+        CkDatabaseWriterSeat    *seats;
+        GPtrArray               *strings;
+        GHashTableIter           iter;
+        gpointer                 value;
+        guint                    n_sessions;
+        guint                    n_seats;
+        guint                    i;
+        gboolean                 ret;
+
+        strings = g_ptr_array_new ();
+        sessions = g_new0 (CkDatabaseWriterSession, g_hash_table_size (manager->priv->sessions) + 1);
+        seats = g_new0 (CkDatabaseWriterSeat, g_hash_table_size (manager->priv->seats) + 1);
+
+        n_sessions = 0;
+        g_hash_table_iter_init (&iter, manager->priv->sessions);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                CkSession               *session;
+                CkDatabaseWriterSession *info;
+                char                    *str;
+                GTimeVal                 tv;
+
+                session = CK_SESSION (value);
+                info = &sessions[n_sessions++];
+
+                str = NULL;
+                ck_session_get_id (session, &str, NULL);
+                info->id = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_seat_id (session, &str, NULL);
+                info->seat_id = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_session_type (session, &str, NULL);
+                info->type = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_login_session_id (session, &str, NULL);
+                info->login_session_id = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_display_device (session, &str, NULL);
+                info->display_device = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_x11_display_device (session, &str, NULL);
+                info->x11_display_device = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_x11_display (session, &str, NULL);
+                info->x11_display = take_string (strings, str);
+
+                str = NULL;
+                ck_session_get_remote_host_name (session, &str, NULL);
+                info->remote_host_name = take_string (strings, str);
+
+                ck_session_get_unix_user (session, &info->uid, NULL);
+                ck_session_is_active (session, &info->is_active, NULL);
+                ck_session_is_local (session, &info->is_local, NULL);
+
+                str = NULL;
+                ck_session_get_creation_time (session, &str, NULL);
+                if (str != NULL && g_time_val_from_iso8601 (str, &tv)) {
+                        info->creation_time = tv.tv_sec;
+                }
+                g_free (str);
+        }
+
+        n_seats = 0;
+        g_hash_table_iter_init (&iter, manager->priv->seats);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                CkSeat               *seat;
+                CkDatabaseWriterSeat *info;
+                CkSeatKind            kind;
+                char                 *str;
+
+                seat = CK_SEAT (value);
+                info = &seats[n_seats++];
+
+                str = NULL;
+                ck_seat_get_id (seat, &str, NULL);
+                info->id = take_string (strings, str);
+
+                kind = 0;
+                ck_seat_get_kind (seat, &kind, NULL);
+                info->kind = kind;
+
+                str = NULL;
+                ck_seat_get_active_session (seat, &str, NULL);
+                info->active_session = take_string (strings, str);
+        }
+
+        ret = ck_database_writer_write (CK_DATABASE_BIN_FILE,
+                                        manager->priv->dump_generation,
+                                        sessions,
+                                        n_sessions,
+                                        seats,
+                                        n_seats);
+
+        for (i = 0; i < strings->len; i++) {
+                g_free (g_ptr_array_index (strings, i));
+        }
+        g_ptr_array_free (strings, TRUE);
+        g_free (seats);
+        g_free (sessions);
+
+        return ret;
+}
+
 static void
-ck_manager_dump (CkManager *manager)
+write_dump (CkManager *manager)
 {
         int         fd;
         int         res;
         const char *filename = LOCALSTATEDIR "/run/ConsoleKit/database";
         const char *filename_tmp = LOCALSTATEDIR "/run/ConsoleKit/database~";
 
-        if (manager == NULL) {
-                return;
-        }
-
         /* always make sure we have a directory */
         errno = 0;
         res = g_mkdir_with_parents (LOCALSTATEDIR "/run/ConsoleKit",
@@ -225,6 +373,14 @@ ck_manager_dump (CkManager *manager)
                 goto error;
         }
 
+        /* binary snapshot of the same state for mmap readers */
+        manager->priv->dump_generation++;
+        if (! write_database_bin (manager)) {
+                if (g_unlink (CK_DATABASE_BIN_FILE) != 0 && errno != ENOENT) {
+                        g_warning ("Cannot unlink %s: %s", CK_DATABASE_BIN_FILE, g_strerror (errno));
+                }
+        }
+
         return;
 error:
         /* For security reasons; unlink the existing file since it
@@ -232,6 +388,63 @@ error:
         if (g_unlink (filename) != 0) {
                 g_warning ("Cannot unlink %s: %s", filename, g_strerror (errno));
         }
+        if (g_unlink (CK_DATABASE_BIN_FILE) != 0 && errno != ENOENT) {
+                g_warning ("Cannot unlink %s: %s", CK_DATABASE_BIN_FILE, g_strerror (errno));
+        }
+}
+
+static void
+ck_manager_dump_flush (CkManager *manager)
+{
+        if (manager == NULL) {
+                return;
+        }
+
+        if (manager->priv->dump_idle_id != 0) {
+                g_source_remove (manager->priv->dump_idle_id);
+                manager->priv->dump_idle_id = 0;
+        }
+
+        if (! manager->priv->dump_dirty) {
+                return;
+        }
+
+        manager->priv->dump_dirty = FALSE;
+        write_dump (manager);
+}
+
+static gboolean
+dump_idle_cb (CkManager *manager)
+{
+        manager->priv->dump_idle_id = 0;
+        ck_manager_dump_flush (manager);
+
+        return FALSE;
+}
+
+/* Marks the database as out of date.  It is rewritten once the main
+ * loop goes idle so that a burst of changes results in one write. */
+static void
+ck_manager_dump (CkManager *manager)
+{
+        if (manager == NULL) {
+                return;
+        }
+
+        manager->priv->dump_dirty = TRUE;
+        if (manager->priv->dump_idle_id == 0) {
+                manager->priv->dump_idle_id = g_idle_add ((GSourceFunc)dump_idle_cb, manager);
+        }
+}
+
+/* Like ck_manager_dump() but the file is up to date on return.  Use
+ * this before running callouts or emitting anything that tells other
+ * processes to read the database. */
+static void
+ck_manager_dump_sync (CkManager *manager)
+{
+        ck_manager_dump (manager);
+        ck_manager_dump_flush (manager);
 }
 
 GQuark
@@ -730,11 +943,25 @@ static char *
 get_cookie_for_pid (CkManager *manager,
                     guint      pid)
 {
-        char *cookie;
+        char    *cookie;
+        guint64  start_time;
 
-        /* FIXME: need a better way to get the cookie */
+        /* The environment has to be read in full to find the cookie,
+         * so remember the answer for as long as the pid belongs to the
+         * same process and the cookie still names a leader.  A process
+         * that execs itself with another cookie keeps the old one; see
+         * ck-process-cache.c. */
+        cookie = ck_process_cache_lookup (manager->priv->process_cache, pid, &start_time);
+        if (cookie != NULL && g_hash_table_lookup (manager->priv->leaders, cookie) == NULL) {
+                ck_process_cache_remove (manager->priv->process_cache, pid);
+                g_free (cookie);
+                cookie = NULL;
+        }
 
-        cookie = ck_unix_pid_get_env (pid, "XDG_SESSION_COOKIE");
+        if (cookie == NULL) {
+                cookie = ck_unix_pid_get_env (pid, "XDG_SESSION_COOKIE");
+                ck_process_cache_insert (manager->priv->process_cache, pid, start_time, cookie);
+        }
 
         return cookie;
 }
@@ -775,7 +1002,7 @@ auth_ready_callback (PolkitAuthority        *authority,
                 error2 = g_error_new (CK_MANAGER_ERROR,
                                       CK_MANAGER_ERROR_NOT_PRIVILEGED,
                                       "Not Authorized: %s", error->message);
-                dbus_g_method_return_error (data->context, error2);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error2);
                 g_error_free (error2);
                 g_error_free (error);
         }
@@ -786,14 +1013,14 @@ auth_ready_callback (PolkitAuthority        *authority,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_NOT_PRIVILEGED,
                                      "Authorization is required");
-                dbus_g_method_return_error (data->context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
         }
         else {
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_NOT_PRIVILEGED,
                                      "Not Authorized");
-                dbus_g_method_return_error (data->context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
         }
 
@@ -847,17 +1074,17 @@ ready_cb (PolkitAuthority *authority,
         error = NULL;
         ret = polkit_authority_check_authorization_finish (authority, res, &error);
         if (error != NULL) {
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
         }
         else if (polkit_authorization_result_get_is_authorized (ret)) {
-                dbus_g_method_return (context, TRUE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), TRUE);
         }
         else if (polkit_authorization_result_get_is_challenge (ret)) {
-                dbus_g_method_return (context, TRUE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), TRUE);
         }
         else {
-                dbus_g_method_return (context, FALSE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), FALSE);
         }
 
         g_object_unref (ret);
@@ -888,49 +1115,16 @@ get_polkit_permissions (CkManager   *manager,
 }
 #endif
 
-/* adapted from PolicyKit */
 static gboolean
 get_caller_info (CkManager   *manager,
                  const char  *sender,
                  uid_t       *calling_uid,
                  pid_t       *calling_pid)
 {
-        gboolean res;
-        GError  *error = NULL;
-
-        res = FALSE;
-
-        if (sender == NULL) {
-                goto out;
-        }
-
-        if (! dbus_g_proxy_call (manager->priv->bus_proxy, "GetConnectionUnixUser", &error,
-                                 G_TYPE_STRING, sender,
-                                 G_TYPE_INVALID,
-                                 G_TYPE_UINT, calling_uid,
-                                 G_TYPE_INVALID)) {
-                g_debug ("GetConnectionUnixUser() failed: %s", error->message);
-                g_error_free (error);
-                goto out;
-        }
-
-        if (! dbus_g_proxy_call (manager->priv->bus_proxy, "GetConnectionUnixProcessID", &error,
-                                 G_TYPE_STRING, sender,
-                                 G_TYPE_INVALID,
-                                 G_TYPE_UINT, calling_pid,
-                                 G_TYPE_INVALID)) {
-                g_debug ("GetConnectionUnixProcessID() failed: %s", error->message);
-                g_error_free (error);
-                goto out;
-        }
-
-        res = TRUE;
-
-        g_debug ("uid = %d", *calling_uid);
-        g_debug ("pid = %d", *calling_pid);
-
-out:
-        return res;
+        return ck_caller_info_get (manager->priv->bus_proxy,
+                                   sender,
+                                   calling_uid,
+                                   calling_pid);
 }
 
 static char *
@@ -950,74 +1144,60 @@ get_user_name (uid_t uid)
         return name;
 }
 
-static gboolean
-session_is_real_user (CkSession *session,
-                      char     **userp)
+/* Names are only looked up when a user's first session appears, and
+ * the table is simply emptied when it fills up; with directory backed
+ * accounts every miss can be a network round trip. */
+static const char *
+manager_peek_user_name (CkManager *manager,
+                        uid_t      uid)
 {
-        int         uid;
-        char       *username;
-        char       *session_type;
-        gboolean    ret;
-
-        ret = FALSE;
-        session_type = NULL;
-        username = NULL;
-
-        session_type = NULL;
-
-        g_object_get (session,
-                      "unix-user", &uid,
-                      "session-type", &session_type,
-                      NULL);
-
-        username = get_user_name (uid);
+        char *name;
 
-        /* filter out GDM user */
-        if (username != NULL && strcmp (username, "gdm") == 0) {
-                ret = FALSE;
-                goto out;
+        name = g_hash_table_lookup (manager->priv->user_names, GUINT_TO_POINTER (uid));
+        if (name != NULL) {
+                return name;
         }
 
-        if (userp != NULL) {
-                *userp = g_strdup (username);
+        name = get_user_name (uid);
+        if (name == NULL) {
+                /* don't remember failures, the lookup may have been
+                 * transient */
+                return NULL;
         }
 
-        ret = TRUE;
-
- out:
-        g_free (username);
-        g_free (session_type);
+        if (g_hash_table_size (manager->priv->user_names) >= CK_USER_NAME_CACHE_SIZE) {
+                g_hash_table_remove_all (manager->priv->user_names);
+        }
+        g_hash_table_insert (manager->priv->user_names, GUINT_TO_POINTER (uid), name);
 
-        return ret;
+        return name;
 }
 
-static void
-collect_users (const char *ssid,
-               CkSession  *session,
-               GHashTable *hash)
+static gboolean
+uid_is_real_user (CkManager *manager,
+                  uid_t      uid)
 {
-        char *username;
+        const char *username;
 
-        if (session_is_real_user (session, &username)) {
-                if (username != NULL) {
-                        g_hash_table_insert (hash, username, NULL);
-                }
+        username = manager_peek_user_name (manager, uid);
+        if (username == NULL) {
+                return FALSE;
+        }
+
+        /* filter out GDM user */
+        if (strcmp (username, "gdm") == 0) {
+                return FALSE;
         }
+
+        return TRUE;
 }
 
 static guint
 get_system_num_users (CkManager *manager)
 {
-        guint            num_users;
-        GHashTable      *hash;
+        guint num_users;
 
-        hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-
-        g_hash_table_foreach (manager->priv->sessions, (GHFunc)collect_users, hash);
-
-        num_users = g_hash_table_size (hash);
-
-        g_hash_table_destroy (hash);
+        num_users = g_hash_table_size (manager->priv->real_user_sessions);
 
         g_debug ("found %u unique users", num_users);
 
@@ -1067,6 +1247,14 @@ out:
 
         if (res && callback) {
                 callback (manager, context);
+        } else if (callback) {
+                GError *error;
+
+                error = g_error_new (CK_MANAGER_ERROR,
+                                     CK_MANAGER_ERROR_NOT_PRIVILEGED,
+                                     "Not Authorized");
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
+                g_error_free (error);
         }
 
         return res;
@@ -1095,12 +1283,12 @@ do_restart (CkManager             *manager,
                 new_error = g_error_new (CK_MANAGER_ERROR,
                                          CK_MANAGER_ERROR_GENERAL,
                                          "Unable to restart system: %s", error->message);
-                dbus_g_method_return_error (context, new_error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), new_error);
                 g_error_free (new_error);
 
                 g_error_free (error);
         } else {
-                dbus_g_method_return (context);
+                dbus_g_method_return (ck_stats_reply (context, TRUE));
         }
 }
 
@@ -1117,6 +1305,8 @@ ck_manager_restart (CkManager             *manager,
 {
         const char *action;
 
+        ck_stats_call_begin (context, "Manager.Restart");
+
         if (get_system_num_users (manager) > 1) {
                 action = "org.freedesktop.consolekit.system.restart-multiple-users";
         } else {
@@ -1131,6 +1321,7 @@ ck_manager_restart (CkManager             *manager,
         check_rbac_permissions (manager, context, RBAC_SHUTDOWN_KEY, do_restart);
 #else
         g_warning ("Compiled without PolicyKit or RBAC support!");
+        ck_stats_call_drop (context);
 #endif
 
         return TRUE;
@@ -1143,6 +1334,8 @@ ck_manager_can_restart (CkManager  *manager,
 {
         const char *action;
 
+        ck_stats_call_begin (context, "Manager.CanRestart");
+
         action = "org.freedesktop.consolekit.system.restart";
 
 #if defined HAVE_POLKIT
@@ -1150,9 +1343,9 @@ ck_manager_can_restart (CkManager  *manager,
 #elif defined ENABLE_RBAC_SHUTDOWN
         if (check_rbac_permissions (manager, context, RBAC_SHUTDOWN_KEY,
                                         NULL)) {
-                dbus_g_method_return (context, TRUE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), TRUE);
         } else {
-                dbus_g_method_return (context, FALSE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), FALSE);
         }
 #endif
 
@@ -1181,11 +1374,11 @@ do_stop (CkManager             *manager,
                 new_error = g_error_new (CK_MANAGER_ERROR,
                                          CK_MANAGER_ERROR_GENERAL,
                                          "Unable to stop system: %s", error->message);
-                dbus_g_method_return_error (context, new_error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), new_error);
                 g_error_free (new_error);
                 g_error_free (error);
         } else {
-                dbus_g_method_return (context);
+                dbus_g_method_return (ck_stats_reply (context, TRUE));
         }
 }
 
@@ -1195,6 +1388,8 @@ ck_manager_stop (CkManager             *manager,
 {
         const char *action;
 
+        ck_stats_call_begin (context, "Manager.Stop");
+
         if (get_system_num_users (manager) > 1) {
                 action = "org.freedesktop.consolekit.system.stop-multiple-users";
         } else {
@@ -1207,6 +1402,7 @@ ck_manager_stop (CkManager             *manager,
         check_rbac_permissions (manager, context, RBAC_SHUTDOWN_KEY, do_stop);
 #else
         g_warning ("Compiled without PolicyKit or RBAC support!");
+        ck_stats_call_drop (context);
 #endif
 
         return TRUE;
@@ -1218,6 +1414,8 @@ ck_manager_can_stop (CkManager  *manager,
 {
         const char *action;
 
+        ck_stats_call_begin (context, "Manager.CanStop");
+
         action = "org.freedesktop.consolekit.system.stop";
 
 #if defined HAVE_POLKIT
@@ -1225,9 +1423,9 @@ ck_manager_can_stop (CkManager  *manager,
 #elif defined ENABLE_RBAC_SHUTDOWN
         if (check_rbac_permissions (manager, context, RBAC_SHUTDOWN_KEY,
                                         NULL)) {
-                dbus_g_method_return (context, TRUE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), TRUE);
         } else {
-                dbus_g_method_return (context, FALSE);
+                dbus_g_method_return (ck_stats_reply (context, TRUE), FALSE);
         }
 #endif
 
@@ -1246,7 +1444,7 @@ on_seat_active_session_changed_full (CkSeat     *seat,
                 ck_session_get_id (session, &ssid, NULL);
         }
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_seat_run_programs (seat, old_session, session, "seat_active_session_changed");
 
         log_seat_active_session_changed_event (manager, seat, ssid);
@@ -1263,7 +1461,7 @@ on_seat_session_added_full (CkSeat     *seat,
 
         ck_session_get_id (session, &ssid, NULL);
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_session_run_programs (session, "session_added");
 
         log_seat_session_added_event (manager, seat, ssid);
@@ -1280,7 +1478,7 @@ on_seat_session_removed_full (CkSeat     *seat,
 
         ck_session_get_id (session, &ssid, NULL);
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_session_run_programs (session, "session_removed");
 
         log_seat_session_removed_event (manager, seat, ssid);
@@ -1358,7 +1556,7 @@ add_new_seat (CkManager *manager,
 
         g_debug ("Added seat: %s kind:%d", sid, kind);
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_seat_run_programs (seat, NULL, NULL, "seat_added");
 
         g_debug ("Emitting seat-added: %s", sid);
@@ -1401,7 +1599,7 @@ remove_seat (CkManager *manager,
                 g_hash_table_remove (manager->priv->seats, sid);
         }
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_seat_run_programs (seat, NULL, NULL, "seat_removed");
 
         g_debug ("Emitting seat-removed: %s", sid);
@@ -1499,9 +1697,7 @@ manager_set_system_idle_hint (CkManager *manager,
 }
 
 static gboolean
-is_session_busy (char      *id,
-                 CkSession *session,
-                 gpointer   data)
+is_session_busy (CkSession *session)
 {
         gboolean idle_hint;
 
@@ -1509,23 +1705,14 @@ is_session_busy (char      *id,
 
         ck_session_get_idle_hint (session, &idle_hint, NULL);
 
-        /* return TRUE to stop search */
         return !idle_hint;
 }
 
 static void
 manager_update_system_idle_hint (CkManager *manager)
 {
-        CkSession *session;
-        gboolean   system_idle;
-
-        /* just look for any session that doesn't have the idle-hint set */
-        session = g_hash_table_find (manager->priv->sessions, (GHRFunc)is_session_busy, NULL);
-
         /* if there aren't any busy sessions then the system is idle */
-        system_idle = (session == NULL);
-
-        manager_set_system_idle_hint (manager, system_idle);
+        manager_set_system_idle_hint (manager, manager->priv->n_busy_sessions == 0);
 }
 
 static void
@@ -1533,6 +1720,14 @@ session_idle_hint_changed (CkSession  *session,
                            gboolean    idle_hint,
                            CkManager  *manager)
 {
+        /* the session only emits this when the hint actually flips */
+        if (idle_hint) {
+                g_assert (manager->priv->n_busy_sessions > 0);
+                manager->priv->n_busy_sessions--;
+        } else {
+                manager->priv->n_busy_sessions++;
+        }
+
         manager_update_system_idle_hint (manager);
 }
 
@@ -1603,6 +1798,204 @@ ck_manager_get_system_idle_since_hint (CkManager *manager,
         return TRUE;
 }
 
+/* The keys a session was filed under, so it can be found in the
+ * indexes again after its properties have changed.  The index tables
+ * own their keys but not the lists, which are swapped in and out
+ * without going through a destroy notify. */
+typedef struct
+{
+        guint     uid;
+        char     *login_session_id;
+        gboolean  counted;      /* in real_user_sessions */
+} SessionIndexKeys;
+
+static void
+session_index_keys_free (SessionIndexKeys *keys)
+{
+        g_free (keys->login_session_id);
+        g_free (keys);
+}
+
+static void
+session_index_insert (GHashTable *table,
+                      gpointer    key,
+                      CkSession  *session)
+{
+        GList *list;
+
+        list = g_hash_table_lookup (table, key);
+        list = g_list_prepend (list, session);
+        g_hash_table_replace (table, key, list);
+}
+
+static void
+session_index_remove (GHashTable   *table,
+                      gconstpointer key,
+                      CkSession    *session)
+{
+        GList   *list;
+        gpointer orig_key;
+
+        if (! g_hash_table_lookup_extended (table, key, &orig_key, (gpointer *)&list)) {
+                return;
+        }
+
+        list = g_list_remove (list, session);
+        if (list == NULL) {
+                g_hash_table_remove (table, key);
+        } else {
+                g_hash_table_steal (table, key);
+                g_hash_table_insert (table, orig_key, list);
+        }
+}
+
+/* Counts the sessions of each user that is shown in the number of
+ * users logged in, so Stop and Restart don't walk every session.
+ * Returns whether the session was counted; only those may be passed
+ * to real_user_unref(). */
+static gboolean
+real_user_ref (CkManager *manager,
+               uid_t      uid)
+{
+        guint count;
+
+        count = GPOINTER_TO_UINT (g_hash_table_lookup (manager->priv->real_user_sessions,
+                                                       GUINT_TO_POINTER (uid)));
+        if (count == 0 && ! uid_is_real_user (manager, uid)) {
+                return FALSE;
+        }
+
+        g_hash_table_insert (manager->priv->real_user_sessions,
+                             GUINT_TO_POINTER (uid),
+                             GUINT_TO_POINTER (count + 1));
+
+        return TRUE;
+}
+
+static void
+real_user_unref (CkManager *manager,
+                 uid_t      uid)
+{
+        guint count;
+
+        count = GPOINTER_TO_UINT (g_hash_table_lookup (manager->priv->real_user_sessions,
+                                                       GUINT_TO_POINTER (uid)));
+        if (count == 0) {
+                return;
+        }
+
+        if (count == 1) {
+                g_hash_table_remove (manager->priv->real_user_sessions, GUINT_TO_POINTER (uid));
+        } else {
+                g_hash_table_insert (manager->priv->real_user_sessions,
+                                     GUINT_TO_POINTER (uid),
+                                     GUINT_TO_POINTER (count - 1));
+        }
+}
+
+static void
+index_add_session (CkManager *manager,
+                   CkSession *session)
+{
+        SessionIndexKeys *keys;
+
+        keys = g_new0 (SessionIndexKeys, 1);
+        ck_session_get_unix_user (session, &keys->uid, NULL);
+        keys->login_session_id = g_strdup (ck_session_peek_login_session_id (session));
+
+        session_index_insert (manager->priv->sessions_by_uid,
+                              GUINT_TO_POINTER (keys->uid),
+                              session);
+        if (keys->login_session_id != NULL) {
+                session_index_insert (manager->priv->sessions_by_login_session_id,
+                                      g_strdup (keys->login_session_id),
+                                      session);
+        }
+
+        g_hash_table_insert (manager->priv->session_index_keys, session, keys);
+
+        keys->counted = real_user_ref (manager, keys->uid);
+}
+
+static void
+index_remove_session (CkManager *manager,
+                      CkSession *session)
+{
+        SessionIndexKeys *keys;
+
+        keys = g_hash_table_lookup (manager->priv->session_index_keys, session);
+        if (keys == NULL) {
+                return;
+        }
+
+        session_index_remove (manager->priv->sessions_by_uid,
+                              GUINT_TO_POINTER (keys->uid),
+                              session);
+        if (keys->login_session_id != NULL) {
+                session_index_remove (manager->priv->sessions_by_login_session_id,
+                                      keys->login_session_id,
+                                      session);
+        }
+
+        if (keys->counted) {
+                real_user_unref (manager, keys->uid);
+        }
+
+        g_hash_table_remove (manager->priv->session_index_keys, session);
+}
+
+static void
+session_index_property_changed (CkSession  *session,
+                                GParamSpec *pspec,
+                                CkManager  *manager)
+{
+        g_debug ("Reindexing session %s after %s changed",
+                 ck_session_peek_id (session),
+                 g_param_spec_get_name (pspec));
+
+        index_remove_session (manager, session);
+        index_add_session (manager, session);
+}
+
+static void
+add_session (CkManager *manager,
+             const char *ssid,
+             CkSession  *session)
+{
+        g_hash_table_insert (manager->priv->sessions,
+                             g_strdup (ssid),
+                             g_object_ref (session));
+
+        index_add_session (manager, session);
+        g_signal_connect (session, "notify::unix-user",
+                          G_CALLBACK (session_index_property_changed),
+                          manager);
+        g_signal_connect (session, "notify::login-session-id",
+                          G_CALLBACK (session_index_property_changed),
+                          manager);
+
+        if (is_session_busy (session)) {
+                manager->priv->n_busy_sessions++;
+        }
+        g_signal_connect (session, "idle-hint-changed",
+                          G_CALLBACK (session_idle_hint_changed),
+                          manager);
+}
+
+static void
+unindex_session (CkManager *manager,
+                 CkSession *session)
+{
+        g_signal_handlers_disconnect_by_func (session, session_idle_hint_changed, manager);
+        if (is_session_busy (session)) {
+                g_assert (manager->priv->n_busy_sessions > 0);
+                manager->priv->n_busy_sessions--;
+        }
+
+        g_signal_handlers_disconnect_by_func (session, session_index_property_changed, manager);
+        index_remove_session (manager, session);
+}
+
 static void
 open_session_for_leader (CkManager             *manager,
                          CkSessionLeader       *leader,
@@ -1627,15 +2020,13 @@ open_session_for_leader (CkManager             *manager,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      "Unable to create new session");
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
 
                 return;
         }
 
-        g_hash_table_insert (manager->priv->sessions,
-                             g_strdup (ssid),
-                             g_object_ref (session));
+        add_session (manager, ssid, session);
 
         /* Add to seat */
         seat = find_seat_for_session (manager, session);
@@ -1650,13 +2041,10 @@ open_session_for_leader (CkManager             *manager,
         /* FIXME: add weak ref */
 
         manager_update_system_idle_hint (manager);
-        g_signal_connect (session, "idle-hint-changed",
-                          G_CALLBACK (session_idle_hint_changed),
-                          manager);
 
         g_object_unref (session);
 
-        dbus_g_method_return (context, cookie);
+        dbus_g_method_return (ck_stats_reply (context, TRUE), cookie);
 }
 
 enum {
@@ -1668,6 +2056,8 @@ enum {
                                                           G_TYPE_STRING,  \
                                                           G_TYPE_VALUE, \
                                                           G_TYPE_INVALID))
+#define CK_TYPE_PARAMETER_LIST (dbus_g_type_get_collection ("GPtrArray", \
+                                                            CK_TYPE_PARAMETER_STRUCT))
 
 static gboolean
 _get_parameter (GPtrArray  *parameters,
@@ -1744,9 +2134,7 @@ static gboolean
 _verify_login_session_id_is_local (CkManager  *manager,
                                    const char *login_session_id)
 {
-        GHashTableIter iter;
-        const char    *id;
-        CkSession     *session;
+        GList *l;
 
         g_return_val_if_fail (CK_IS_MANAGER (manager), FALSE);
 
@@ -1756,22 +2144,20 @@ _verify_login_session_id_is_local (CkManager  *manager,
 
         g_debug ("Looking for local sessions for login-session-id=%s", login_session_id);
 
-        session = NULL;
-        g_hash_table_iter_init (&iter, manager->priv->sessions);
-        while (g_hash_table_iter_next (&iter, (gpointer *)&id, (gpointer *)&session)) {
-                if (session != NULL) {
-                        gboolean is_local;
-                        char    *sessid;
-
-                        sessid = NULL;
-                        g_object_get (session,
-                                      "login-session-id", &sessid,
-                                      "is-local", &is_local,
-                                      NULL);
-                        if (g_strcmp0 (sessid, login_session_id) == 0 && is_local) {
-                                g_debug ("CkManager: found is-local=true on %s", id);
-                                return TRUE;
-                        }
+        if (login_session_id == NULL) {
+                return FALSE;
+        }
+
+        l = g_hash_table_lookup (manager->priv->sessions_by_login_session_id, login_session_id);
+        for (; l != NULL; l = l->next) {
+                CkSession *session = l->data;
+                gboolean   is_local;
+
+                is_local = FALSE;
+                ck_session_is_local (session, &is_local, NULL);
+                if (is_local) {
+                        g_debug ("CkManager: found is-local=true on %s", ck_session_peek_id (session));
+                        return TRUE;
                 }
         }
 
@@ -1845,7 +2231,7 @@ collect_parameters_cb (CkSessionLeader       *leader,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      "Unable to get information about the calling process");
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 return;
         }
@@ -1872,40 +2258,131 @@ generate_session_for_leader (CkManager             *manager,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      "Unable to get information about the calling process");
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
         }
 }
 
-static gboolean
-create_session_for_sender (CkManager             *manager,
-                           const char            *sender,
+typedef struct
+{
+        CkManager             *manager;
+        DBusGMethodInvocation *context;
+        char                  *cookie;
+        guint                  pid;
+        GPtrArray             *parameters;
+} CallerData;
+
+static CallerData *
+caller_data_new (CkManager             *manager,
+                 DBusGMethodInvocation *context)
+{
+        CallerData *data;
+
+        data = g_new0 (CallerData, 1);
+        data->manager = g_object_ref (manager);
+        data->context = context;
+
+        return data;
+}
+
+static void
+caller_data_free (CallerData *data)
+{
+        g_object_unref (data->manager);
+        g_free (data->cookie);
+        if (data->parameters != NULL) {
+                g_boxed_free (CK_TYPE_PARAMETER_LIST, data->parameters);
+        }
+        g_free (data);
+}
+
+/* Looks up the credentials of the caller without blocking the main
+ * loop and continues the method in @callback.  Takes ownership of
+ * @data. */
+static void
+get_caller_info_async (CkManager             *manager,
+                       DBusGMethodInvocation *context,
+                       CkCallerInfoFunc       callback,
+                       CallerData            *data)
+{
+        char *sender;
+
+        sender = dbus_g_method_get_sender (context);
+        ck_caller_info_get_async (manager->priv->bus_proxy,
+                                  sender,
+                                  callback,
+                                  data,
+                                  (GDestroyNotify) caller_data_free);
+        g_free (sender);
+}
+
+/* Leaders are also filed under the unique name of the connection
+ * that opened them, so a disconnect only has to look at its own
+ * leaders.  The lists hold no refs; priv->leaders owns the leaders. */
+static void
+add_leader (CkManager       *manager,
+            CkSessionLeader *leader)
+{
+        const char *service_name;
+        GList      *list;
+
+        g_hash_table_insert (manager->priv->leaders,
+                             g_strdup (ck_session_leader_peek_cookie (leader)),
+                             g_object_ref (leader));
+
+        service_name = ck_session_leader_peek_service_name (leader);
+        list = g_hash_table_lookup (manager->priv->leaders_by_service_name, service_name);
+        list = g_list_prepend (list, leader);
+        g_hash_table_replace (manager->priv->leaders_by_service_name,
+                              g_strdup (service_name),
+                              list);
+}
+
+static void
+remove_leader (CkManager  *manager,
+               const char *cookie)
+{
+        CkSessionLeader *leader;
+        const char      *service_name;
+        gpointer         orig_name;
+        GList           *list;
+
+        leader = g_hash_table_lookup (manager->priv->leaders, cookie);
+        if (leader == NULL) {
+                return;
+        }
+
+        service_name = ck_session_leader_peek_service_name (leader);
+        if (g_hash_table_lookup_extended (manager->priv->leaders_by_service_name,
+                                          service_name,
+                                          &orig_name,
+                                          (gpointer *)&list)) {
+                list = g_list_remove (list, leader);
+                g_hash_table_steal (manager->priv->leaders_by_service_name, service_name);
+                if (list != NULL) {
+                        g_hash_table_insert (manager->priv->leaders_by_service_name, orig_name, list);
+                } else {
+                        g_free (orig_name);
+                }
+        }
+
+        g_hash_table_remove (manager->priv->leaders, cookie);
+}
+
+static void
+create_session_for_sender (CkManager             *manager,
+                           const char            *sender,
+                           uid_t                  uid,
+                           pid_t                  pid,
                            const GPtrArray       *parameters,
                            DBusGMethodInvocation *context)
 {
-        pid_t           pid;
-        uid_t           uid;
-        gboolean        res;
         char            *cookie;
         char            *ssid;
         CkSessionLeader *leader;
 
         g_debug ("CkManager: create session for sender: %s", sender);
 
-        res = get_caller_info (manager,
-                               sender,
-                               &uid,
-                               &pid);
-        if (! res) {
-                GError *error;
-                error = g_error_new (CK_MANAGER_ERROR,
-                                     CK_MANAGER_ERROR_GENERAL,
-                                     "Unable to get information about the calling process");
-                dbus_g_method_return_error (context, error);
-                g_error_free (error);
-                return FALSE;
-        }
-
         cookie = generate_session_cookie (manager);
         ssid = generate_session_id (manager);
 
@@ -1920,9 +2397,7 @@ create_session_for_sender (CkManager             *manager,
         ck_session_leader_set_override_parameters (leader, parameters);
 
         /* need to store the leader info first so the pending request can be revoked */
-        g_hash_table_insert (manager->priv->leaders,
-                             g_strdup (cookie),
-                             g_object_ref (leader));
+        add_leader (manager, leader);
 
         generate_session_for_leader (manager,
                                      leader,
@@ -1931,26 +2406,40 @@ create_session_for_sender (CkManager             *manager,
         g_free (cookie);
         g_free (ssid);
         g_object_unref (leader);
+}
 
-        return TRUE;
+static void
+open_session_caller_info_cb (const char *sender,
+                             gboolean    success,
+                             uid_t       calling_uid,
+                             pid_t       calling_pid,
+                             CallerData *data)
+{
+        if (! success) {
+                GError *error;
+                error = g_error_new (CK_MANAGER_ERROR,
+                                     CK_MANAGER_ERROR_GENERAL,
+                                     "Unable to get information about the calling process");
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
+                g_error_free (error);
+                return;
+        }
+
+        create_session_for_sender (data->manager,
+                                   sender,
+                                   calling_uid,
+                                   calling_pid,
+                                   data->parameters,
+                                   data->context);
 }
 
-/*
-  Example:
-  dbus-send --system --dest=org.freedesktop.ConsoleKit \
-  --type=method_call --print-reply --reply-timeout=2000 \
-  /org/freedesktop/ConsoleKit/Manager \
-  org.freedesktop.ConsoleKit.Manager.GetSessionForCookie string:$XDG_SESSION_COOKIE
-*/
-gboolean
-ck_manager_get_session_for_cookie (CkManager             *manager,
-                                   const char            *cookie,
-                                   DBusGMethodInvocation *context)
+static void
+return_session_for_cookie (CkManager             *manager,
+                           const char            *cookie,
+                           pid_t                  calling_pid,
+                           DBusGMethodInvocation *context)
 {
         gboolean         res;
-        char            *sender;
-        uid_t            calling_uid;
-        pid_t            calling_pid;
         CkProcessStat   *stat;
         char            *ssid;
         CkSession       *session;
@@ -1959,27 +2448,6 @@ ck_manager_get_session_for_cookie (CkManager             *manager,
 
         ssid = NULL;
 
-        g_debug ("CkManager: get session for cookie");
-
-        sender = dbus_g_method_get_sender (context);
-
-        res = get_caller_info (manager,
-                               sender,
-                               &calling_uid,
-                               &calling_pid);
-        g_free (sender);
-
-        if (! res) {
-                GError *error;
-                error = g_error_new (CK_MANAGER_ERROR,
-                                     CK_MANAGER_ERROR_GENERAL,
-                                     _("Unable to get information about the calling process"));
-                dbus_g_method_return_error (context, error);
-                g_error_free (error);
-                g_debug ("CkManager: Unable to lookup caller info - failing");
-                return FALSE;
-        }
-
         local_error = NULL;
         res = ck_process_stat_new_for_unix_pid (calling_pid, &stat, &local_error);
         if (! res) {
@@ -1993,12 +2461,12 @@ ck_manager_get_session_for_cookie (CkManager             *manager,
                         g_error_free (local_error);
                 }
 
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
 
                 g_debug ("CkManager: Unable to lookup info for caller - failing");
 
-                return FALSE;
+                return;
         }
 
         /* FIXME: should we restrict this by uid? */
@@ -2011,10 +2479,10 @@ ck_manager_get_session_for_cookie (CkManager             *manager,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      _("Unable to find session for cookie"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 g_debug ("CkManager: Unable to lookup cookie for caller - failing");
-                return FALSE;
+                return;
         }
 
         session = g_hash_table_lookup (manager->priv->sessions, ck_session_leader_peek_session_id (leader));
@@ -2023,21 +2491,67 @@ ck_manager_get_session_for_cookie (CkManager             *manager,
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      _("Unable to find session for cookie"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 g_debug ("CkManager: Unable to lookup session for cookie - failing");
-                return FALSE;
+                return;
         }
 
         ck_session_get_id (session, &ssid, NULL);
 
         g_debug ("CkManager: Found session '%s'", ssid);
 
-        dbus_g_method_return (context, ssid);
+        dbus_g_method_return (ck_stats_reply (context, TRUE), ssid);
 
         g_free (ssid);
+}
 
-        return TRUE;
+static void
+return_session_for_unix_process (CkManager             *manager,
+                                 guint                  pid,
+                                 pid_t                  calling_pid,
+                                 DBusGMethodInvocation *context)
+{
+        char *cookie;
+
+        cookie = get_cookie_for_pid (manager, pid);
+        if (cookie == NULL) {
+                GError *error;
+
+                g_debug ("CkManager: unable to lookup session for unix process: %u", pid);
+
+                error = g_error_new (CK_MANAGER_ERROR,
+                                     CK_MANAGER_ERROR_GENERAL,
+                                     _("Unable to lookup session information for process '%d'"),
+                                     pid);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
+                g_error_free (error);
+                return;
+        }
+
+        return_session_for_cookie (manager, cookie, calling_pid, context);
+        g_free (cookie);
+}
+
+static void
+get_session_for_cookie_caller_info_cb (const char *sender,
+                                       gboolean    success,
+                                       uid_t       calling_uid,
+                                       pid_t       calling_pid,
+                                       CallerData *data)
+{
+        if (! success) {
+                GError *error;
+                error = g_error_new (CK_MANAGER_ERROR,
+                                     CK_MANAGER_ERROR_GENERAL,
+                                     _("Unable to get information about the calling process"));
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
+                g_error_free (error);
+                g_debug ("CkManager: Unable to lookup caller info - failing");
+                return;
+        }
+
+        return_session_for_cookie (data->manager, data->cookie, calling_pid, data->context);
 }
 
 /*
@@ -2045,58 +2559,97 @@ ck_manager_get_session_for_cookie (CkManager             *manager,
   dbus-send --system --dest=org.freedesktop.ConsoleKit \
   --type=method_call --print-reply --reply-timeout=2000 \
   /org/freedesktop/ConsoleKit/Manager \
-  org.freedesktop.ConsoleKit.Manager.GetSessionForUnixProcess uint32:`/sbin/pidof -s bash`
+  org.freedesktop.ConsoleKit.Manager.GetSessionForCookie string:$XDG_SESSION_COOKIE
 */
 gboolean
-ck_manager_get_session_for_unix_process (CkManager             *manager,
-                                         guint                  pid,
-                                         DBusGMethodInvocation *context)
+ck_manager_get_session_for_cookie (CkManager             *manager,
+                                   const char            *cookie,
+                                   DBusGMethodInvocation *context)
 {
-        gboolean       res;
-        char          *sender;
-        uid_t          calling_uid;
-        pid_t          calling_pid;
-        char          *cookie;
+        CallerData *data;
 
-        sender = dbus_g_method_get_sender (context);
+        ck_stats_call_begin (context, "Manager.GetSessionForCookie");
 
-        g_debug ("CkManager: get session for unix process: %u", pid);
+        g_debug ("CkManager: get session for cookie");
 
-        res = get_caller_info (manager,
-                               sender,
-                               &calling_uid,
-                               &calling_pid);
-        g_free (sender);
+        data = caller_data_new (manager, context);
+        data->cookie = g_strdup (cookie);
 
-        if (! res) {
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) get_session_for_cookie_caller_info_cb,
+                               data);
+
+        return TRUE;
+}
+
+static void
+get_session_for_unix_process_caller_info_cb (const char *sender,
+                                             gboolean    success,
+                                             uid_t       calling_uid,
+                                             pid_t       calling_pid,
+                                             CallerData *data)
+{
+        if (! success) {
                 GError *error;
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      _("Unable to get information about the calling process"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
-                return FALSE;
+                return;
         }
 
-        cookie = get_cookie_for_pid (manager, pid);
-        if (cookie == NULL) {
-                GError *error;
+        return_session_for_unix_process (data->manager, data->pid, calling_pid, data->context);
+}
 
-                g_debug ("CkManager: unable to lookup session for unix process: %u", pid);
+/*
+  Example:
+  dbus-send --system --dest=org.freedesktop.ConsoleKit \
+  --type=method_call --print-reply --reply-timeout=2000 \
+  /org/freedesktop/ConsoleKit/Manager \
+  org.freedesktop.ConsoleKit.Manager.GetSessionForUnixProcess uint32:`/sbin/pidof -s bash`
+*/
+gboolean
+ck_manager_get_session_for_unix_process (CkManager             *manager,
+                                         guint                  pid,
+                                         DBusGMethodInvocation *context)
+{
+        CallerData *data;
+
+        ck_stats_call_begin (context, "Manager.GetSessionForUnixProcess");
 
+        g_debug ("CkManager: get session for unix process: %u", pid);
+
+        data = caller_data_new (manager, context);
+        data->pid = pid;
+
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) get_session_for_unix_process_caller_info_cb,
+                               data);
+
+        return TRUE;
+}
+
+static void
+get_current_session_caller_info_cb (const char *sender,
+                                    gboolean    success,
+                                    uid_t       calling_uid,
+                                    pid_t       calling_pid,
+                                    CallerData *data)
+{
+        if (! success) {
+                GError *error;
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
-                                     _("Unable to lookup session information for process '%d'"),
-                                     pid);
-                dbus_g_method_return_error (context, error);
+                                     _("Unable to get information about the calling process"));
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
-                return FALSE;
+                return;
         }
 
-        res = ck_manager_get_session_for_cookie (manager, cookie, context);
-        g_free (cookie);
-
-        return res;
+        return_session_for_unix_process (data->manager, calling_pid, calling_pid, data->context);
 }
 
 /*
@@ -2110,48 +2663,30 @@ gboolean
 ck_manager_get_current_session (CkManager             *manager,
                                 DBusGMethodInvocation *context)
 {
-        gboolean    res;
-        char       *sender;
-        uid_t       calling_uid;
-        pid_t       calling_pid;
-
-        sender = dbus_g_method_get_sender (context);
+        ck_stats_call_begin (context, "Manager.GetCurrentSession");
 
         g_debug ("CkManager: get current session");
 
-        res = get_caller_info (manager,
-                               sender,
-                               &calling_uid,
-                               &calling_pid);
-        g_free (sender);
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) get_current_session_caller_info_cb,
+                               caller_data_new (manager, context));
 
-        if (! res) {
-                GError *error;
-                error = g_error_new (CK_MANAGER_ERROR,
-                                     CK_MANAGER_ERROR_GENERAL,
-                                     _("Unable to get information about the calling process"));
-                dbus_g_method_return_error (context, error);
-                g_error_free (error);
-                return FALSE;
-        }
-
-        res = ck_manager_get_session_for_unix_process (manager, calling_pid, context);
-
-        return res;
+        return TRUE;
 }
 
 gboolean
 ck_manager_open_session (CkManager             *manager,
                          DBusGMethodInvocation *context)
 {
-        char    *sender;
-        gboolean ret;
+        ck_stats_call_begin (context, "Manager.OpenSession");
 
-        sender = dbus_g_method_get_sender (context);
-        ret = create_session_for_sender (manager, sender, NULL, context);
-        g_free (sender);
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) open_session_caller_info_cb,
+                               caller_data_new (manager, context));
 
-        return ret;
+        return TRUE;
 }
 
 gboolean
@@ -2159,14 +2694,23 @@ ck_manager_open_session_with_parameters (CkManager             *manager,
                                          const GPtrArray       *parameters,
                                          DBusGMethodInvocation *context)
 {
-        char    *sender;
-        gboolean ret;
+        CallerData *data;
 
-        sender = dbus_g_method_get_sender (context);
-        ret = create_session_for_sender (manager, sender, parameters, context);
-        g_free (sender);
+        ck_stats_call_begin (context, "Manager.OpenSessionWithParameters");
 
-        return ret;
+        /* the arguments are freed as soon as we return so keep
+         * our own copy until the caller has been identified */
+        data = caller_data_new (manager, context);
+        if (parameters != NULL) {
+                data->parameters = g_boxed_copy (CK_TYPE_PARAMETER_LIST, parameters);
+        }
+
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) open_session_caller_info_cb,
+                               data);
+
+        return TRUE;
 }
 
 static gboolean
@@ -2240,6 +2784,7 @@ remove_session_for_cookie (CkManager  *manager,
 
         /* Remove the session from the list but don't call
          * unref until we are done with it */
+        unindex_session (manager, orig_session);
         g_hash_table_steal (manager->priv->sessions,
                             ck_session_leader_peek_session_id (leader));
 
@@ -2305,101 +2850,101 @@ paranoia_check_is_cookie_owner (CkManager  *manager,
         return TRUE;
 }
 
-gboolean
-ck_manager_close_session (CkManager             *manager,
-                          const char            *cookie,
-                          DBusGMethodInvocation *context)
+static void
+close_session_caller_info_cb (const char *sender,
+                              gboolean    success,
+                              uid_t       calling_uid,
+                              pid_t       calling_pid,
+                              CallerData *data)
 {
         gboolean res;
-        char    *sender;
-        uid_t    calling_uid;
-        pid_t    calling_pid;
         GError  *error;
 
-        g_debug ("Closing session for cookie: %s", cookie);
-
-        sender = dbus_g_method_get_sender (context);
-        res = get_caller_info (manager,
-                               sender,
-                               &calling_uid,
-                               &calling_pid);
-        g_free (sender);
-
-        if (! res) {
+        if (! success) {
                 error = g_error_new (CK_MANAGER_ERROR,
                                      CK_MANAGER_ERROR_GENERAL,
                                      "Unable to get information about the calling process");
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
 
-                return FALSE;
+                return;
         }
 
         error = NULL;
-        res = paranoia_check_is_cookie_owner (manager, cookie, calling_uid, calling_pid, &error);
+        res = paranoia_check_is_cookie_owner (data->manager, data->cookie, calling_uid, calling_pid, &error);
         if (! res) {
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
 
-                return FALSE;
+                return;
         }
 
         error = NULL;
-        res = remove_session_for_cookie (manager, cookie, &error);
+        res = remove_session_for_cookie (data->manager, data->cookie, &error);
         if (! res) {
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
-                return FALSE;
+                return;
         } else {
-                g_hash_table_remove (manager->priv->leaders, cookie);
+                remove_leader (data->manager, data->cookie);
         }
 
-        dbus_g_method_return (context, res);
-
-        return TRUE;
+        dbus_g_method_return (ck_stats_reply (data->context, TRUE), res);
 }
 
-typedef struct {
-        const char *service_name;
-        CkManager  *manager;
-} RemoveLeaderData;
-
-static gboolean
-remove_leader_for_connection (const char       *cookie,
-                              CkSessionLeader  *leader,
-                              RemoveLeaderData *data)
+gboolean
+ck_manager_close_session (CkManager             *manager,
+                          const char            *cookie,
+                          DBusGMethodInvocation *context)
 {
-        const char *name;
+        CallerData *data;
 
-        g_assert (leader != NULL);
-        g_assert (data->service_name != NULL);
+        ck_stats_call_begin (context, "Manager.CloseSession");
 
-        name = ck_session_leader_peek_service_name (leader);
-        if (strcmp (name, data->service_name) == 0) {
-                remove_session_for_cookie (data->manager, cookie, NULL);
-                ck_session_leader_cancel (leader);
-                return TRUE;
-        }
+        g_debug ("Closing session for cookie: %s", cookie);
 
-        return FALSE;
+        data = caller_data_new (manager, context);
+        data->cookie = g_strdup (cookie);
+
+        get_caller_info_async (manager,
+                               context,
+                               (CkCallerInfoFunc) close_session_caller_info_cb,
+                               data);
+
+        return TRUE;
 }
 
 static void
 remove_sessions_for_connection (CkManager  *manager,
                                 const char *service_name)
 {
-        guint            n_removed;
-        RemoveLeaderData data;
+        GList *leaders;
+        GList *l;
 
-        data.service_name = service_name;
-        data.manager = manager;
+        /* most connections that go away never opened a session */
+        leaders = g_hash_table_lookup (manager->priv->leaders_by_service_name, service_name);
+        if (leaders == NULL) {
+                return;
+        }
 
         g_debug ("Removing sessions for service name: %s", service_name);
 
-        n_removed = g_hash_table_foreach_remove (manager->priv->leaders,
-                                                 (GHRFunc)remove_leader_for_connection,
-                                                 &data);
+        /* take our own copy since remove_leader edits the index */
+        leaders = g_list_copy (leaders);
+        g_list_foreach (leaders, (GFunc)g_object_ref, NULL);
 
+        for (l = leaders; l != NULL; l = l->next) {
+                CkSessionLeader *leader = l->data;
+                const char      *cookie;
+
+                cookie = ck_session_leader_peek_cookie (leader);
+                remove_session_for_cookie (manager, cookie, NULL);
+                ck_session_leader_cancel (leader);
+                remove_leader (manager, cookie);
+        }
+
+        g_list_foreach (leaders, (GFunc)g_object_unref, NULL);
+        g_list_free (leaders);
 }
 
 static void
@@ -2411,6 +2956,7 @@ bus_name_owner_changed (DBusGProxy  *bus_proxy,
 {
         if (strlen (new_service_name) == 0) {
                 remove_sessions_for_connection (manager, old_service_name);
+                ck_caller_info_forget (old_service_name);
         }
 
         g_debug ("NameOwnerChanged: service_name='%s', old_service_name='%s' new_service_name='%s'",
@@ -2452,6 +2998,8 @@ register_manager (CkManager *manager)
                                      manager,
                                      NULL);
 
+        ck_stats_install_filter (manager->priv->connection);
+
         dbus_g_connection_register_g_object (manager->priv->connection, CK_MANAGER_DBUS_PATH, G_OBJECT (manager));
 
         return TRUE;
@@ -2501,46 +3049,29 @@ ck_manager_class_init (CkManagerClass *klass)
         g_type_class_add_private (klass, sizeof (CkManagerPrivate));
 }
 
-typedef struct {
-        guint                  uid;
-        GPtrArray             *sessions;
-} GetSessionsData;
-
-static void
-get_sessions_for_unix_user_iter (char            *id,
-                                 CkSession       *session,
-                                 GetSessionsData *data)
-{
-        guint    uid;
-        gboolean res;
-
-        res = ck_session_get_unix_user (session, &uid, NULL);
-
-        if (res && uid == data->uid) {
-                g_ptr_array_add (data->sessions, g_strdup (id));
-        }
-}
-
 gboolean
 ck_manager_get_sessions_for_unix_user (CkManager             *manager,
                                        guint                  uid,
                                        DBusGMethodInvocation *context)
 {
-        GetSessionsData *data;
+        GPtrArray *sessions;
+        GList     *l;
 
         g_return_val_if_fail (CK_IS_MANAGER (manager), FALSE);
 
-        data = g_new0 (GetSessionsData, 1);
-        data->uid = uid;
-        data->sessions = g_ptr_array_new ();
+        ck_stats_call_begin (context, "Manager.GetSessionsForUnixUser");
 
-        g_hash_table_foreach (manager->priv->sessions, (GHFunc)get_sessions_for_unix_user_iter, data);
+        sessions = g_ptr_array_new ();
 
-        dbus_g_method_return (context, data->sessions);
+        l = g_hash_table_lookup (manager->priv->sessions_by_uid, GUINT_TO_POINTER (uid));
+        for (; l != NULL; l = l->next) {
+                g_ptr_array_add (sessions, g_strdup (ck_session_peek_id (l->data)));
+        }
 
-        g_ptr_array_foreach (data->sessions, (GFunc)g_free, NULL);
-        g_ptr_array_free (data->sessions, TRUE);
-        g_free (data);
+        dbus_g_method_return (ck_stats_reply (context, TRUE), sessions);
+
+        g_ptr_array_foreach (sessions, (GFunc)g_free, NULL);
+        g_ptr_array_free (sessions, TRUE);
 
         return TRUE;
 }
@@ -2551,6 +3082,8 @@ ck_manager_get_sessions_for_user (CkManager             *manager,
                                   guint                  uid,
                                   DBusGMethodInvocation *context)
 {
+        ck_stats_call_begin (context, "Manager.GetSessionsForUser");
+
         return ck_manager_get_sessions_for_unix_user (manager, uid, context);
 }
 
@@ -2604,6 +3137,178 @@ ck_manager_get_sessions (CkManager  *manager,
         return TRUE;
 }
 
+/*
+  Example:
+  dbus-send --system --dest=org.freedesktop.ConsoleKit \
+  --type=method_call --print-reply --reply-timeout=2000 \
+  /org/freedesktop/ConsoleKit/Manager \
+  org.freedesktop.ConsoleKit.Manager.GetSnapshot
+*/
+gboolean
+ck_manager_get_snapshot (CkManager   *manager,
+                         GHashTable **seats,
+                         GHashTable **sessions,
+                         GError     **error)
+{
+        GHashTableIter iter;
+        const char    *id;
+        gpointer       object;
+
+        g_return_val_if_fail (CK_IS_MANAGER (manager), FALSE);
+
+        if (seats == NULL || sessions == NULL) {
+                return FALSE;
+        }
+
+        *seats = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify) g_hash_table_destroy);
+        g_hash_table_iter_init (&iter, manager->priv->seats);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&id, &object)) {
+                g_hash_table_insert (*seats,
+                                     g_strdup (id),
+                                     ck_seat_get_snapshot (CK_SEAT (object)));
+        }
+
+        *sessions = g_hash_table_new_full (g_str_hash,
+                                           g_str_equal,
+                                           g_free,
+                                           (GDestroyNotify) g_hash_table_destroy);
+        g_hash_table_iter_init (&iter, manager->priv->sessions);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&id, &object)) {
+                g_hash_table_insert (*sessions,
+                                     g_strdup (id),
+                                     ck_session_get_snapshot (CK_SESSION (object)));
+        }
+
+        return TRUE;
+}
+
+static void
+manager_collect_gauges (GHashTable *gauges,
+                        CkManager  *manager)
+{
+        guint64 hits;
+        guint64 misses;
+
+        g_hash_table_insert (gauges,
+                             g_strdup ("sessions"),
+                             GUINT_TO_POINTER (g_hash_table_size (manager->priv->sessions)));
+        g_hash_table_insert (gauges,
+                             g_strdup ("leaders"),
+                             GUINT_TO_POINTER (g_hash_table_size (manager->priv->leaders)));
+        g_hash_table_insert (gauges,
+                             g_strdup ("seats"),
+                             GUINT_TO_POINTER (g_hash_table_size (manager->priv->seats)));
+        g_hash_table_insert (gauges,
+                             g_strdup ("pending-jobs"),
+                             GUINT_TO_POINTER (ck_job_get_n_pending ()));
+        g_hash_table_insert (gauges,
+                             g_strdup ("vt-monitor-threads"),
+                             GUINT_TO_POINTER (ck_vt_monitor_get_n_threads ()));
+
+        ck_process_cache_get_stats (manager->priv->process_cache, &hits, &misses, NULL);
+        g_hash_table_insert (gauges,
+                             g_strdup ("process-cache-hits"),
+                             GUINT_TO_POINTER ((guint) hits));
+        g_hash_table_insert (gauges,
+                             g_strdup ("process-cache-misses"),
+                             GUINT_TO_POINTER ((guint) misses));
+
+        if (manager->priv->logger != NULL) {
+                CkEventLoggerStats stats;
+
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-queue"),
+                                     GUINT_TO_POINTER (ck_event_logger_get_queue_length (manager->priv->logger)));
+
+                ck_event_logger_get_stats (manager->priv->logger, &stats);
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-events"),
+                                     GUINT_TO_POINTER (stats.n_events));
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-batches"),
+                                     GUINT_TO_POINTER (stats.n_batches));
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-max-batch"),
+                                     GUINT_TO_POINTER (stats.max_batch));
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-syncs"),
+                                     GUINT_TO_POINTER (stats.n_syncs));
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-dropped"),
+                                     GUINT_TO_POINTER (stats.n_dropped));
+                g_hash_table_insert (gauges,
+                                     g_strdup ("event-logger-unsent"),
+                                     GUINT_TO_POINTER (stats.n_unsent));
+        }
+}
+
+/*
+  Example:
+  dbus-send --system --dest=org.freedesktop.ConsoleKit \
+  --type=method_call --print-reply --reply-timeout=2000 \
+  /org/freedesktop/ConsoleKit/Manager \
+  org.freedesktop.ConsoleKit.Manager.GetStatistics
+*/
+gboolean
+ck_manager_get_statistics (CkManager   *manager,
+                           GHashTable **methods,
+                           GArray     **bucket_bounds,
+                           GHashTable **gauges,
+                           GError     **error)
+{
+        g_return_val_if_fail (CK_IS_MANAGER (manager), FALSE);
+
+        if (methods == NULL || bucket_bounds == NULL || gauges == NULL) {
+                return FALSE;
+        }
+
+        *methods = ck_stats_get_methods ();
+        *bucket_bounds = ck_stats_get_bucket_bounds ();
+        *gauges = ck_stats_get_gauges ();
+
+        return TRUE;
+}
+
+/*
+  Example:
+  dbus-send --system --dest=org.freedesktop.ConsoleKit \
+  --type=method_call --print-reply --reply-timeout=2000 \
+  /org/freedesktop/ConsoleKit/Manager \
+  org.freedesktop.ConsoleKit.Manager.GetRecentEvents uint32:0
+*/
+gboolean
+ck_manager_get_recent_events (CkManager   *manager,
+                              guint        after,
+                              char      ***events,
+                              guint       *last,
+                              GError     **error)
+{
+        g_return_val_if_fail (CK_IS_MANAGER (manager), FALSE);
+
+        if (events == NULL || last == NULL) {
+                return FALSE;
+        }
+
+        *events = NULL;
+        *last = 0;
+        if (manager->priv->logger != NULL) {
+                *events = ck_event_logger_get_recent_events (manager->priv->logger, after, last);
+        }
+
+        if (*events == NULL) {
+                g_set_error (error,
+                             CK_MANAGER_ERROR,
+                             CK_MANAGER_ERROR_GENERAL,
+                             "Events are not being kept in memory");
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
 static void
 add_seat_for_file (CkManager  *manager,
                    const char *filename)
@@ -2632,7 +3337,7 @@ add_seat_for_file (CkManager  *manager,
 
         g_debug ("Added seat: %s", sid);
 
-        ck_manager_dump (manager);
+        ck_manager_dump_sync (manager);
         ck_seat_run_programs (seat, NULL, NULL, "seat_added");
 
         g_debug ("Emitting seat-added: %s", sid);
@@ -2690,6 +3395,10 @@ ck_manager_init (CkManager *manager)
 
         manager->priv->system_idle_hint = TRUE;
 
+        /* seed from the clock so readers see the generation of the
+         * binary database grow across daemon restarts */
+        manager->priv->dump_generation = (guint64) time (NULL) << 20;
+
         manager->priv->seats = g_hash_table_new_full (g_str_hash,
                                                       g_str_equal,
                                                       g_free,
@@ -2702,16 +3411,50 @@ ck_manager_init (CkManager *manager)
                                                         g_str_equal,
                                                         g_free,
                                                         (GDestroyNotify) g_object_unref);
+        manager->priv->sessions_by_uid = g_hash_table_new (g_direct_hash,
+                                                           g_direct_equal);
+        manager->priv->sessions_by_login_session_id = g_hash_table_new_full (g_str_hash,
+                                                                             g_str_equal,
+                                                                             g_free,
+                                                                             NULL);
+        manager->priv->leaders_by_service_name = g_hash_table_new_full (g_str_hash,
+                                                                        g_str_equal,
+                                                                        g_free,
+                                                                        NULL);
+        manager->priv->real_user_sessions = g_hash_table_new (g_direct_hash,
+                                                              g_direct_equal);
+        manager->priv->user_names = g_hash_table_new_full (g_direct_hash,
+                                                           g_direct_equal,
+                                                           NULL,
+                                                           g_free);
+        manager->priv->session_index_keys = g_hash_table_new_full (g_direct_hash,
+                                                                   g_direct_equal,
+                                                                   NULL,
+                                                                   (GDestroyNotify) session_index_keys_free);
+
+        manager->priv->process_cache = ck_process_cache_new (CK_PROCESS_CACHE_SIZE);
 
         manager->priv->logger = ck_event_logger_new (LOG_FILE);
 
+        ck_stats_set_gauge_func ((CkStatsGaugeFunc) manager_collect_gauges, manager);
+
         create_seats (manager);
 }
 
+static void
+free_index_list (gpointer key,
+                   GList   *list,
+                   gpointer data)
+{
+        g_list_free (list);
+}
+
 static void
 ck_manager_finalize (GObject *object)
 {
-        CkManager *manager;
+        CkManager     *manager;
+        GHashTableIter iter;
+        CkSession     *session;
 
         g_return_if_fail (object != NULL);
         g_return_if_fail (CK_IS_MANAGER (object));
@@ -2720,9 +3463,29 @@ ck_manager_finalize (GObject *object)
 
         g_return_if_fail (manager->priv != NULL);
 
+        ck_manager_dump_flush (manager);
+
+        ck_stats_set_gauge_func (NULL, NULL);
+
+        g_hash_table_iter_init (&iter, manager->priv->session_index_keys);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&session, NULL)) {
+                g_signal_handlers_disconnect_by_func (session, session_index_property_changed, manager);
+                g_signal_handlers_disconnect_by_func (session, session_idle_hint_changed, manager);
+        }
+        g_hash_table_destroy (manager->priv->session_index_keys);
+        g_hash_table_destroy (manager->priv->real_user_sessions);
+        g_hash_table_destroy (manager->priv->user_names);
+        g_hash_table_foreach (manager->priv->sessions_by_uid, (GHFunc)free_index_list, NULL);
+        g_hash_table_destroy (manager->priv->sessions_by_uid);
+        g_hash_table_foreach (manager->priv->sessions_by_login_session_id, (GHFunc)free_index_list, NULL);
+        g_hash_table_destroy (manager->priv->sessions_by_login_session_id);
+
         g_hash_table_destroy (manager->priv->seats);
         g_hash_table_destroy (manager->priv->sessions);
+        g_hash_table_foreach (manager->priv->leaders_by_service_name, (GHFunc)free_index_list, NULL);
+        g_hash_table_destroy (manager->priv->leaders_by_service_name);
         g_hash_table_destroy (manager->priv->leaders);
+        ck_process_cache_free (manager->priv->process_cache);
         if (manager->priv->bus_proxy != NULL) {
                 g_object_unref (manager->priv->bus_proxy);
         }
@@ -96,6 +96,20 @@ gboolean            ck_manager_get_sessions                   (CkManager
 gboolean            ck_manager_get_seats                      (CkManager             *manager,
                                                                GPtrArray            **seats,
                                                                GError               **error);
+gboolean            ck_manager_get_snapshot                   (CkManager             *manager,
+                                                               GHashTable           **seats,
+                                                               GHashTable           **sessions,
+                                                               GError               **error);
+gboolean            ck_manager_get_statistics                 (CkManager             *manager,
+                                                               GHashTable           **methods,
+                                                               GArray               **bucket_bounds,
+                                                               GHashTable           **gauges,
+                                                               GError               **error);
+gboolean            ck_manager_get_recent_events              (CkManager             *manager,
+                                                               guint                  after,
+                                                               char                ***events,
+                                                               guint                 *last,
+                                                               GError               **error);
 gboolean            ck_manager_close_session                  (CkManager             *manager,
                                                                const char            *cookie,
                                                                DBusGMethodInvocation *context);
@@ -0,0 +1,210 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include "ck-process-cache.h"
+#include "ck-sysdeps.h"
+
+/* Remembers a string per process, keyed by pid and validated against
+ * the start time of the process so that a recycled pid is never
+ * mistaken for the process we saw before.  Checking an entry costs one
+ * read of the process status instead of whatever produced the value.
+ *
+ * exec() changes neither the pid nor the start time, so a process
+ * that execs, say through env(1), keeps its entry even if the new
+ * image would produce a different value.  For a value exec can
+ * change, like the session cookie in the environment, the value from
+ * before the exec is returned until the process exits or the entry
+ * is removed. */
+
+typedef struct
+{
+        pid_t    pid;
+        guint64  start_time;
+        char    *value;
+        GList   *link;
+} CacheEntry;
+
+struct CkProcessCache
+{
+        GHashTable *entries;
+        GQueue     *lru;
+        guint       max_entries;
+        guint64     hits;
+        guint64     misses;
+};
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+        g_free (entry->value);
+        g_free (entry);
+}
+
+CkProcessCache *
+ck_process_cache_new (guint max_entries)
+{
+        CkProcessCache *cache;
+
+        g_return_val_if_fail (max_entries > 0, NULL);
+
+        cache = g_new0 (CkProcessCache, 1);
+        cache->entries = g_hash_table_new_full (g_direct_hash,
+                                                g_direct_equal,
+                                                NULL,
+                                                (GDestroyNotify) cache_entry_free);
+        cache->lru = g_queue_new ();
+        cache->max_entries = max_entries;
+
+        return cache;
+}
+
+void
+ck_process_cache_free (CkProcessCache *cache)
+{
+        if (cache == NULL) {
+                return;
+        }
+
+        g_queue_free (cache->lru);
+        g_hash_table_destroy (cache->entries);
+        g_free (cache);
+}
+
+void
+ck_process_cache_remove (CkProcessCache *cache,
+                         pid_t           pid)
+{
+        CacheEntry *entry;
+
+        g_return_if_fail (cache != NULL);
+
+        entry = g_hash_table_lookup (cache->entries, GINT_TO_POINTER (pid));
+        if (entry == NULL) {
+                return;
+        }
+
+        g_queue_delete_link (cache->lru, entry->link);
+        g_hash_table_remove (cache->entries, GINT_TO_POINTER (pid));
+}
+
+/* Returns a copy of the cached value when the process still has the
+ * start time it had when the value was stored.  start_time is set to
+ * the current start time of the process, or 0 if it could not be
+ * read, for use with ck_process_cache_insert(). */
+char *
+ck_process_cache_lookup (CkProcessCache *cache,
+                         pid_t           pid,
+                         guint64        *start_time)
+{
+        CkProcessStat *stat;
+        CacheEntry    *entry;
+        guint64        current;
+
+        g_return_val_if_fail (cache != NULL, NULL);
+
+        current = 0;
+        if (pid > 1 && ck_process_stat_new_for_unix_pid (pid, &stat, NULL)) {
+                current = ck_process_stat_get_start_time (stat);
+                ck_process_stat_free (stat);
+        }
+
+        if (start_time != NULL) {
+                *start_time = current;
+        }
+
+        entry = g_hash_table_lookup (cache->entries, GINT_TO_POINTER (pid));
+        if (entry != NULL) {
+                if (current != 0 && entry->start_time == current) {
+                        cache->hits++;
+
+                        g_queue_unlink (cache->lru, entry->link);
+                        g_queue_push_head_link (cache->lru, entry->link);
+
+                        return g_strdup (entry->value);
+                }
+
+                g_debug ("Dropping cached entry for recycled pid %d", pid);
+                ck_process_cache_remove (cache, pid);
+        }
+
+        cache->misses++;
+
+        return NULL;
+}
+
+void
+ck_process_cache_insert (CkProcessCache *cache,
+                         pid_t           pid,
+                         guint64         start_time,
+                         const char     *value)
+{
+        CacheEntry *entry;
+
+        g_return_if_fail (cache != NULL);
+
+        /* without a start time there is nothing to validate against */
+        if (start_time == 0 || value == NULL) {
+                return;
+        }
+
+        ck_process_cache_remove (cache, pid);
+
+        while (g_queue_get_length (cache->lru) >= cache->max_entries) {
+                CacheEntry *oldest;
+
+                oldest = g_queue_peek_tail (cache->lru);
+                ck_process_cache_remove (cache, oldest->pid);
+        }
+
+        entry = g_new0 (CacheEntry, 1);
+        entry->pid = pid;
+        entry->start_time = start_time;
+        entry->value = g_strdup (value);
+
+        g_queue_push_head (cache->lru, entry);
+        entry->link = g_queue_peek_head_link (cache->lru);
+
+        g_hash_table_insert (cache->entries, GINT_TO_POINTER (pid), entry);
+}
+
+void
+ck_process_cache_get_stats (CkProcessCache *cache,
+                            guint64        *hits,
+                            guint64        *misses,
+                            guint          *n_entries)
+{
+        g_return_if_fail (cache != NULL);
+
+        if (hits != NULL) {
+                *hits = cache->hits;
+        }
+        if (misses != NULL) {
+                *misses = cache->misses;
+        }
+        if (n_entries != NULL) {
+                *n_entries = g_hash_table_size (cache->entries);
+        }
+}
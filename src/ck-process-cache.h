@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_PROCESS_CACHE_H
+#define __CK_PROCESS_CACHE_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct CkProcessCache CkProcessCache;
+
+CkProcessCache *    ck_process_cache_new                      (guint           max_entries);
+void                ck_process_cache_free                     (CkProcessCache *cache);
+
+char *              ck_process_cache_lookup                   (CkProcessCache *cache,
+                                                               pid_t           pid,
+                                                               guint64        *start_time);
+void                ck_process_cache_insert                   (CkProcessCache *cache,
+                                                               pid_t           pid,
+                                                               guint64         start_time,
+                                                               const char     *value);
+void                ck_process_cache_remove                   (CkProcessCache *cache,
+                                                               pid_t           pid);
+void                ck_process_cache_get_stats                (CkProcessCache *cache,
+                                                               guint64        *hits,
+                                                               guint64        *misses,
+                                                               guint          *n_entries);
+
+G_END_DECLS
+
+#endif /* __CK_PROCESS_CACHE_H */
@@ -112,6 +112,15 @@ _child_timeout (ChildData *cd)
         return FALSE;
 }
 
+static gboolean run_programs_enabled = TRUE;
+
+/* Lets the test mode of the daemon turn off all callouts */
+void
+ck_run_programs_set_enabled (gboolean enabled)
+{
+        run_programs_enabled = enabled;
+}
+
 /**
  * ck_run_programs:
  * @dirpath: Path to a directory containing programs to run
@@ -138,6 +147,10 @@ ck_run_programs (const char *dirpath,
         g_return_if_fail (dirpath != NULL);
         g_return_if_fail (action != NULL);
 
+        if (! run_programs_enabled) {
+                return;
+        }
+
         g_debug ("Running programs in %s for action %s", dirpath, action);
 
         /* Construct an environment consisting of the existing and the given environment */
@@ -29,6 +29,7 @@
 G_BEGIN_DECLS
 
 void ck_run_programs (const char *dirpath, const char *action, char **extra_env);
+void ck_run_programs_set_enabled (gboolean enabled);
 
 G_END_DECLS
 
@@ -38,6 +38,7 @@
 #include "ck-seat.h"
 #include "ck-seat-glue.h"
 #include "ck-marshal.h"
+#include "ck-stats.h"
 
 #include "ck-session.h"
 #include "ck-vt-monitor.h"
@@ -173,14 +174,14 @@ activated_cb (CkVtMonitor    *vt_monitor,
               ActivateData   *adata)
 {
         if (adata->num == num) {
-                dbus_g_method_return (adata->context, TRUE);
+                dbus_g_method_return (ck_stats_reply (adata->context, TRUE), TRUE);
         } else {
                 GError *error;
 
                 error = g_error_new (CK_SEAT_ERROR,
                                      CK_SEAT_ERROR_GENERAL,
                                      _("Another session was activated while waiting"));
-                dbus_g_method_return_error (adata->context, error);
+                dbus_g_method_return_error (ck_stats_reply (adata->context, FALSE), error);
                 g_error_free (error);
         }
 
@@ -209,7 +210,7 @@ _seat_activate_session (CkSeat                *seat,
                 error = g_error_new (CK_SEAT_ERROR,
                                      CK_SEAT_ERROR_GENERAL,
                                      _("Activation is not supported for this kind of seat"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 goto out;
         }
@@ -219,7 +220,7 @@ _seat_activate_session (CkSeat                *seat,
                 error = g_error_new (CK_SEAT_ERROR,
                                      CK_SEAT_ERROR_GENERAL,
                                      _("Unknown session id"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 goto out;
         }
@@ -235,7 +236,7 @@ _seat_activate_session (CkSeat                *seat,
                 error = g_error_new (CK_SEAT_ERROR,
                                      CK_SEAT_ERROR_GENERAL,
                                      _("Unable to activate session"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 goto out;
         }
@@ -258,7 +259,7 @@ _seat_activate_session (CkSeat                *seat,
         ret = ck_vt_monitor_set_active (seat->priv->vt_monitor, num, &vt_error);
         if (! ret) {
                 g_debug ("Unable to activate session: %s", vt_error->message);
-                dbus_g_method_return_error (context, vt_error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), vt_error);
                 g_signal_handler_disconnect (seat->priv->vt_monitor, adata->handler_id);
                 g_error_free (vt_error);
                 goto out;
@@ -289,6 +290,8 @@ ck_seat_activate_session (CkSeat                *seat,
 
         g_return_val_if_fail (CK_IS_SEAT (seat), FALSE);
 
+        ck_stats_call_begin (context, "Seat.ActivateSession");
+
         session = NULL;
 
         g_debug ("Trying to activate session: %s", ssid);
@@ -512,7 +515,9 @@ change_active_session (CkSeat    *seat,
          * handling. dbus-glib will then send out a D-Bus on the
          * 'active-session-changed' signal. Since the D-Bus signal
          * must be sent when the database dump is finished it is
-         * important that the '-full' signalled is emitted first. */
+         * important that the '-full' signalled is emitted first.
+         * The manager flushes any coalesced dump before the
+         * callouts so the file is complete by then. */
 
         g_signal_emit (seat, signals [ACTIVE_SESSION_CHANGED_FULL], 0, old_session, session);
         g_signal_emit (seat, signals [ACTIVE_SESSION_CHANGED], 0, ssid);
@@ -1307,6 +1312,59 @@ dump_seat_session_iter (char      *id,
         }
 }
 
+static void
+snapshot_value_free (GValue *value)
+{
+        g_value_unset (value);
+        g_free (value);
+}
+
+static void
+snapshot_session_iter (char       *id,
+                       CkSession  *session,
+                       GPtrArray  *array)
+{
+        g_ptr_array_add (array, g_strdup (id));
+}
+
+/* The kind, sessions and active session of the seat as an a{sv}
+ * dictionary; active-session is left out when there is none. */
+GHashTable *
+ck_seat_get_snapshot (CkSeat *seat)
+{
+        GHashTable *props;
+        GValue     *value;
+        GPtrArray  *sessions;
+
+        g_return_val_if_fail (CK_IS_SEAT (seat), NULL);
+
+        props = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) snapshot_value_free);
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, G_TYPE_UINT);
+        g_value_set_uint (value, seat->priv->kind);
+        g_hash_table_insert (props, g_strdup ("kind"), value);
+
+        sessions = g_ptr_array_new ();
+        g_hash_table_foreach (seat->priv->sessions, (GHFunc) snapshot_session_iter, sessions);
+        value = g_new0 (GValue, 1);
+        g_value_init (value, dbus_g_type_get_collection ("GPtrArray", DBUS_TYPE_G_OBJECT_PATH));
+        g_value_take_boxed (value, sessions);
+        g_hash_table_insert (props, g_strdup ("sessions"), value);
+
+        if (seat->priv->active_session != NULL) {
+                value = g_new0 (GValue, 1);
+                g_value_init (value, DBUS_TYPE_G_OBJECT_PATH);
+                g_value_set_boxed (value, ck_session_peek_id (seat->priv->active_session));
+                g_hash_table_insert (props, g_strdup ("active-session"), value);
+        }
+
+        return props;
+}
+
 void
 ck_seat_dump (CkSeat   *seat,
               GKeyFile *key_file)
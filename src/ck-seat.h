@@ -100,6 +100,7 @@ void                ck_seat_run_programs        (CkSeat                *seat,
 
 void                ck_seat_dump                (CkSeat                *seat,
                                                  GKeyFile              *key_file);
+GHashTable        * ck_seat_get_snapshot        (CkSeat                *seat);
 
 gboolean            ck_seat_get_kind            (CkSeat                *seat,
                                                  CkSeatKind            *kind,
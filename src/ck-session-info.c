@@ -0,0 +1,941 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2007 William Jon McCann <mccann@jhu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * Authors: William Jon McCann <mccann@jhu.edu>
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <errno.h>
+#ifdef HAVE_SYS_FSUID_H
+#include <sys/fsuid.h>
+#endif
+
+#include <glib.h>
+
+#include "ck-sysdeps.h"
+#include "ck-session-info.h"
+
+CkSessionInfo *
+ck_session_info_new (uid_t uid,
+                     pid_t pid)
+{
+        CkSessionInfo *si;
+
+        si = g_new0 (CkSessionInfo, 1);
+        si->uid = uid;
+        si->pid = pid;
+
+        return si;
+}
+
+void
+ck_session_info_free (CkSessionInfo *si)
+{
+        if (si == NULL) {
+                return;
+        }
+
+        g_free (si->login_session_id);
+        g_free (si->display_device);
+        g_free (si->x11_display_device);
+        g_free (si->x11_display);
+        g_free (si->remote_host_name);
+        g_free (si);
+}
+
+static void
+setuid_child_setup_func (CkSessionInfo *si)
+{
+        int res;
+
+        /* only async-signal-safe calls here; the daemon may have
+         * other threads running when we fork */
+
+        /* set the group */
+        res = setgid (si->gid);
+        if (res == -1) {
+                _exit (1);
+        }
+
+        /* become the user */
+        res = setuid (si->uid);
+        if (res == -1) {
+                _exit (1);
+        }
+}
+
+static gboolean
+lookup_user_gid (CkSessionInfo *si)
+{
+        struct passwd  pwd;
+        struct passwd *pwent;
+        char          *buf;
+        long           bufsize;
+        int            res;
+
+        bufsize = sysconf (_SC_GETPW_R_SIZE_MAX);
+        if (bufsize <= 0) {
+                bufsize = 16384;
+        }
+        buf = g_malloc (bufsize);
+
+        pwent = NULL;
+        res = getpwuid_r (si->uid, &pwd, buf, bufsize, &pwent);
+        if (pwent == NULL) {
+                g_warning ("Unable to lookup UID: %s", g_strerror (res != 0 ? res : ENOENT));
+                g_free (buf);
+                return FALSE;
+        }
+
+        si->gid = pwent->pw_gid;
+        g_free (buf);
+
+        return TRUE;
+}
+
+static GPtrArray *
+get_filtered_environment (pid_t pid)
+{
+        GPtrArray  *env;
+        GHashTable *hash;
+        int         i;
+        static const char *allowed_env_vars [] = {
+                "DISPLAY",
+                "XAUTHORITY",
+                "XAUTHLOCALHOSTNAME",
+                "SSH_CLIENT",
+                "SSH_CONNECTION",
+                "SSH_TTY",
+                "HOME",
+        };
+
+        env = g_ptr_array_new ();
+
+        g_ptr_array_add (env, g_strdup ("PATH=/bin:/usr/bin"));
+
+        hash = ck_unix_pid_get_env_hash (pid);
+
+        for (i = 0; i < G_N_ELEMENTS (allowed_env_vars); i++) {
+                const char *var;
+                const char *val;
+                var = allowed_env_vars [i];
+                val = g_hash_table_lookup (hash, var);
+                if (val != NULL) {
+                        char *str;
+                        str = g_strdup_printf ("%s=%s", var, val);
+                        g_ptr_array_add (env, str);
+                }
+        }
+
+        g_ptr_array_add (env, NULL);
+
+        g_hash_table_destroy (hash);
+
+        return env;
+}
+
+/* Native resolution of the X server PID.
+ *
+ * Rather than running ck-get-x11-server-pid as the user we connect to
+ * the local socket of the display ourselves and read the peer
+ * credentials.  To keep the meaning of x11-can-connect, the
+ * connection setup is done with the user's own MIT-MAGIC-COOKIE-1 and
+ * only counts if the server accepts it.  Anything we can't handle here
+ * (remote displays, no usable cookie) still goes through the helper.
+ */
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+#define X11_SOCKET_DIR         "/tmp/.X11-unix"
+#define X11_AUTH_NAME          "MIT-MAGIC-COOKIE-1"
+#define X11_FAMILY_LOCAL       256
+#define X11_FAMILY_WILD        65535
+#define X11_MAX_XAUTHORITY     (64 * 1024)
+#define X11_IO_TIMEOUT_SECONDS 5
+#define X11_CACHE_MAX_ENTRIES  256
+
+typedef struct
+{
+        pid_t    server_pid;
+        guint64  server_start_time;
+        char    *cookie;
+        gsize    cookie_len;
+} X11CacheEntry;
+
+/* keyed by "<uid>:<display number>" */
+static GHashTable *x11_cache = NULL;
+G_LOCK_DEFINE_STATIC (x11_cache);
+
+static void
+x11_cache_entry_free (X11CacheEntry *entry)
+{
+        g_free (entry->cookie);
+        g_free (entry);
+}
+
+static guint64
+get_start_time_for_pid (pid_t pid)
+{
+        CkProcessStat *stat;
+        guint64        start_time;
+
+        if (! ck_process_stat_new_for_unix_pid (pid, &stat, NULL)) {
+                return 0;
+        }
+
+        start_time = ck_process_stat_get_start_time (stat);
+        ck_process_stat_free (stat);
+
+        return start_time;
+}
+
+static gboolean
+x11_cache_lookup (const char *key,
+                  const char *cookie,
+                  gsize       cookie_len,
+                  pid_t      *server_pid)
+{
+        X11CacheEntry *entry;
+        pid_t          pid;
+        guint64        start_time;
+
+        pid = 0;
+        start_time = 0;
+
+        G_LOCK (x11_cache);
+        if (x11_cache != NULL) {
+                entry = g_hash_table_lookup (x11_cache, key);
+                if (entry != NULL
+                    && entry->cookie_len == cookie_len
+                    && memcmp (entry->cookie, cookie, cookie_len) == 0) {
+                        pid = entry->server_pid;
+                        start_time = entry->server_start_time;
+                }
+        }
+        G_UNLOCK (x11_cache);
+
+        /* the server may have been restarted with the same cookie file */
+        if (pid < 2 || start_time == 0 || get_start_time_for_pid (pid) != start_time) {
+                return FALSE;
+        }
+
+        *server_pid = pid;
+        return TRUE;
+}
+
+static void
+x11_cache_add (const char *key,
+               const char *cookie,
+               gsize       cookie_len,
+               pid_t       server_pid)
+{
+        X11CacheEntry *entry;
+        guint64        start_time;
+
+        start_time = get_start_time_for_pid (server_pid);
+        if (start_time == 0) {
+                return;
+        }
+
+        entry = g_new0 (X11CacheEntry, 1);
+        entry->server_pid = server_pid;
+        entry->server_start_time = start_time;
+        entry->cookie = g_memdup (cookie, cookie_len);
+        entry->cookie_len = cookie_len;
+
+        G_LOCK (x11_cache);
+        if (x11_cache == NULL) {
+                x11_cache = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   (GDestroyNotify)x11_cache_entry_free);
+        }
+        if (g_hash_table_size (x11_cache) >= X11_CACHE_MAX_ENTRIES) {
+                g_hash_table_remove_all (x11_cache);
+        }
+        g_hash_table_insert (x11_cache, g_strdup (key), entry);
+        G_UNLOCK (x11_cache);
+}
+
+/* Only displays of the form ":N[.S]" or "unix:N[.S]" use the local socket */
+static gboolean
+parse_local_display (const char *display,
+                     int        *number)
+{
+        const char *colon;
+        char       *end;
+        long        num;
+
+        colon = strrchr (display, ':');
+        if (colon == NULL) {
+                return FALSE;
+        }
+
+        if (colon != display
+            && ! (colon - display == 4 && strncmp (display, "unix", 4) == 0)) {
+                return FALSE;
+        }
+
+        errno = 0;
+        num = strtol (colon + 1, &end, 10);
+        if (errno != 0 || end == colon + 1 || num < 0 || num > G_MAXINT) {
+                return FALSE;
+        }
+        if (*end != '\0' && *end != '.') {
+                return FALSE;
+        }
+
+        *number = num;
+        return TRUE;
+}
+
+static int
+connect_to_display (int number)
+{
+        struct sockaddr_un addr;
+        struct timeval     tv;
+        socklen_t          len;
+        int                fd;
+        int                res;
+
+        fd = socket (AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+                return -1;
+        }
+
+        fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+        tv.tv_sec = X11_IO_TIMEOUT_SECONDS;
+        tv.tv_usec = 0;
+        setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+        setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+
+        res = -1;
+
+#ifdef __linux__
+        /* try the abstract namespace first like libxcb does */
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        g_snprintf (addr.sun_path + 1, sizeof (addr.sun_path) - 1, X11_SOCKET_DIR "/X%d", number);
+        len = G_STRUCT_OFFSET (struct sockaddr_un, sun_path) + 1 + strlen (addr.sun_path + 1);
+        do {
+                res = connect (fd, (struct sockaddr *)&addr, len);
+        } while (res == -1 && errno == EINTR);
+#endif
+
+        if (res == -1) {
+                memset (&addr, 0, sizeof (addr));
+                addr.sun_family = AF_UNIX;
+                g_snprintf (addr.sun_path, sizeof (addr.sun_path), X11_SOCKET_DIR "/X%d", number);
+                len = sizeof (addr);
+                do {
+                        res = connect (fd, (struct sockaddr *)&addr, len);
+                } while (res == -1 && errno == EINTR);
+        }
+
+        if (res == -1) {
+                g_debug ("Unable to connect to display :%d: %s", number, g_strerror (errno));
+                close (fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+static gboolean
+read_xauth_counted (const guchar **p,
+                    const guchar  *end,
+                    const guchar **str,
+                    gsize         *len)
+{
+        if (end - *p < 2) {
+                return FALSE;
+        }
+
+        *len = ((*p)[0] << 8) | (*p)[1];
+        *p += 2;
+
+        if ((gsize)(end - *p) < *len) {
+                return FALSE;
+        }
+
+        *str = *p;
+        *p += *len;
+
+        return TRUE;
+}
+
+static gboolean
+counted_equal (const guchar *str,
+               gsize         len,
+               const char   *value)
+{
+        return value != NULL && strlen (value) == len && memcmp (str, value, len) == 0;
+}
+
+/* Finds the cookie libXau would pick for a local connection */
+static gboolean
+find_cookie (const guchar *contents,
+             gsize         length,
+             int           number,
+             const char   *local_hostname,
+             char        **cookie,
+             gsize        *cookie_len)
+{
+        const guchar *p;
+        const guchar *end;
+        char          hostname[256];
+        char         *number_str;
+        gboolean      found;
+
+        hostname[0] = '\0';
+        if (gethostname (hostname, sizeof (hostname)) == 0) {
+                hostname[sizeof (hostname) - 1] = '\0';
+        }
+
+        number_str = g_strdup_printf ("%d", number);
+        found = FALSE;
+
+        p = contents;
+        end = contents + length;
+        while (p < end && ! found) {
+                guint         family;
+                const guchar *address;
+                gsize         address_len;
+                const guchar *num;
+                gsize         num_len;
+                const guchar *name;
+                gsize         name_len;
+                const guchar *data;
+                gsize         data_len;
+
+                if (end - p < 2) {
+                        break;
+                }
+                family = (p[0] << 8) | p[1];
+                p += 2;
+
+                if (! read_xauth_counted (&p, end, &address, &address_len)
+                    || ! read_xauth_counted (&p, end, &num, &num_len)
+                    || ! read_xauth_counted (&p, end, &name, &name_len)
+                    || ! read_xauth_counted (&p, end, &data, &data_len)) {
+                        break;
+                }
+
+                if (family != X11_FAMILY_WILD) {
+                        if (family != X11_FAMILY_LOCAL) {
+                                continue;
+                        }
+                        if (! counted_equal (address, address_len, hostname)
+                            && ! counted_equal (address, address_len, local_hostname)) {
+                                continue;
+                        }
+                }
+
+                if (num_len != 0 && ! counted_equal (num, num_len, number_str)) {
+                        continue;
+                }
+
+                if (! counted_equal (name, name_len, X11_AUTH_NAME)) {
+                        continue;
+                }
+
+                *cookie = g_memdup (data, data_len);
+                *cookie_len = data_len;
+                found = TRUE;
+        }
+
+        g_free (number_str);
+
+        return found;
+}
+
+/* Opens the file with the filesystem permissions of the user, where
+ * that's possible, so that root only opens what the user could */
+static int
+open_as_user (CkSessionInfo *si,
+              const char    *path)
+{
+        int fd;
+#ifdef HAVE_SETFSUID
+        int old_fsuid;
+        int old_fsgid;
+
+        if (! lookup_user_gid (si)) {
+                return -1;
+        }
+
+        old_fsgid = setfsgid (si->gid);
+        old_fsuid = setfsuid (si->uid);
+#endif
+
+        fd = open (path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY);
+
+#ifdef HAVE_SETFSUID
+        setfsuid (old_fsuid);
+        setfsgid (old_fsgid);
+#endif
+
+        return fd;
+}
+
+/* The file is named by the user's environment so only accept a
+ * regular file that the user owns.  It is checked before it is
+ * opened, so that a FIFO or device is never opened, and again after,
+ * in case it was replaced in between. */
+static gboolean
+read_user_cookie (CkSessionInfo *si,
+                  int            number,
+                  char         **cookie,
+                  gsize         *cookie_len)
+{
+        GHashTable  *hash;
+        const char  *xauthority;
+        const char  *home;
+        char        *path;
+        int          fd;
+        struct stat  lst;
+        struct stat  st;
+        guchar      *contents;
+        gsize        length;
+        gboolean     ret;
+
+        ret = FALSE;
+        fd = -1;
+        path = NULL;
+        contents = NULL;
+
+        hash = ck_unix_pid_get_env_hash (si->pid);
+        if (hash == NULL) {
+                return FALSE;
+        }
+
+        xauthority = g_hash_table_lookup (hash, "XAUTHORITY");
+        home = g_hash_table_lookup (hash, "HOME");
+        if (xauthority != NULL && xauthority[0] != '\0') {
+                path = g_strdup (xauthority);
+        } else if (home != NULL && home[0] != '\0') {
+                path = g_build_filename (home, ".Xauthority", NULL);
+        } else {
+                goto out;
+        }
+
+        if (lstat (path, &lst) == -1
+            || ! S_ISREG (lst.st_mode)
+            || lst.st_uid != si->uid) {
+                g_debug ("Ignoring authority file %s", path);
+                goto out;
+        }
+
+        fd = open_as_user (si, path);
+        if (fd == -1) {
+                goto out;
+        }
+
+        if (fstat (fd, &st) == -1
+            || ! S_ISREG (st.st_mode)
+            || st.st_dev != lst.st_dev
+            || st.st_ino != lst.st_ino
+            || st.st_uid != si->uid
+            || st.st_size > X11_MAX_XAUTHORITY) {
+                g_debug ("Ignoring authority file %s", path);
+                goto out;
+        }
+
+        contents = g_malloc (st.st_size + 1);
+        length = 0;
+        while (length < (gsize)st.st_size) {
+                ssize_t n;
+
+                n = read (fd, contents + length, st.st_size - length);
+                if (n == -1 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        break;
+                }
+                length += n;
+        }
+
+        ret = find_cookie (contents,
+                           length,
+                           number,
+                           g_hash_table_lookup (hash, "XAUTHLOCALHOSTNAME"),
+                           cookie,
+                           cookie_len);
+ out:
+        if (fd != -1) {
+                close (fd);
+        }
+        g_free (contents);
+        g_free (path);
+        g_hash_table_destroy (hash);
+
+        return ret;
+}
+
+static gboolean
+write_all (int           fd,
+           const guchar *buf,
+           gsize         len)
+{
+        while (len > 0) {
+                ssize_t n;
+
+                n = write (fd, buf, len);
+                if (n == -1 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return FALSE;
+                }
+                buf += n;
+                len -= n;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+read_all (int     fd,
+          guchar *buf,
+          gsize   len)
+{
+        while (len > 0) {
+                ssize_t n;
+
+                n = read (fd, buf, len);
+                if (n == -1 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return FALSE;
+                }
+                buf += n;
+                len -= n;
+        }
+
+        return TRUE;
+}
+
+#define PAD4(n) (((n) + 3) & ~3)
+
+/* Sends the connection setup request and returns TRUE if the server
+ * accepted it */
+static gboolean
+x11_authenticate (int         fd,
+                  const char *cookie,
+                  gsize       cookie_len)
+{
+        guchar  *request;
+        gsize    name_len;
+        gsize    len;
+        guchar   reply[8];
+        gboolean ret;
+
+        name_len = strlen (X11_AUTH_NAME);
+        len = 12 + PAD4 (name_len) + PAD4 (cookie_len);
+        request = g_malloc0 (len);
+
+        request[0] = 'l';       /* little endian */
+        request[2] = 11;        /* protocol major version */
+        request[4] = 0;         /* protocol minor version */
+        request[6] = name_len & 0xff;
+        request[7] = (name_len >> 8) & 0xff;
+        request[8] = cookie_len & 0xff;
+        request[9] = (cookie_len >> 8) & 0xff;
+        memcpy (request + 12, X11_AUTH_NAME, name_len);
+        memcpy (request + 12 + PAD4 (name_len), cookie, cookie_len);
+
+        ret = FALSE;
+        if (write_all (fd, request, len) && read_all (fd, reply, sizeof (reply))) {
+                /* 0 = Failed, 1 = Success, 2 = Authenticate */
+                ret = (reply[0] == 1);
+        }
+
+        g_free (request);
+
+        return ret;
+}
+
+/* Returns FALSE if the display can't be checked here, which includes
+ * the server refusing the cookie: it may let the user in by other
+ * means, such as xhost, that only the helper's XOpenDisplay tries */
+static gboolean
+resolve_x11_server_pid (CkSessionInfo *si,
+                        gboolean      *can_connect,
+                        guint         *pid)
+{
+        int       number;
+        int       fd;
+        char     *cookie;
+        gsize     cookie_len;
+        char     *key;
+        pid_t     server_pid;
+        gboolean  ret;
+
+        if (! parse_local_display (si->x11_display, &number)) {
+                return FALSE;
+        }
+
+        cookie = NULL;
+        cookie_len = 0;
+        if (! read_user_cookie (si, number, &cookie, &cookie_len)) {
+                return FALSE;
+        }
+
+        ret = TRUE;
+        key = g_strdup_printf ("%u:%d", (guint)si->uid, number);
+
+        if (x11_cache_lookup (key, cookie, cookie_len, &server_pid)) {
+                g_debug ("Using cached X server pid %d for display :%d", server_pid, number);
+                *can_connect = TRUE;
+                *pid = server_pid;
+                goto out;
+        }
+
+        fd = connect_to_display (number);
+        if (fd == -1) {
+                ret = FALSE;
+                goto out;
+        }
+
+        if (x11_authenticate (fd, cookie, cookie_len)) {
+                *can_connect = TRUE;
+                server_pid = 0;
+                if (ck_get_socket_peer_credentials (fd, &server_pid, NULL, NULL) && server_pid > 0) {
+                        *pid = server_pid;
+                        x11_cache_add (key, cookie, cookie_len, server_pid);
+                }
+        } else {
+                g_debug ("Display :%d refused the session cookie", number);
+                ret = FALSE;
+        }
+
+        close (fd);
+ out:
+        g_free (key);
+        g_free (cookie);
+
+        return ret;
+}
+
+static void
+run_x11_server_pid_helper (CkSessionInfo *si,
+                           gboolean      *can_connect,
+                           guint         *pid)
+{
+        gboolean   res;
+        char      *err;
+        char      *out;
+        int        status;
+        int        i;
+        GError    *error;
+        guint      num;
+        char      *argv[4];
+        GPtrArray *env;
+
+        if (can_connect != NULL) {
+                *can_connect = FALSE;
+        }
+        if (pid != NULL) {
+                *pid = 0;
+        }
+
+        /* resolve the group now since the child may not use getpwuid */
+        if (! lookup_user_gid (si)) {
+                return;
+        }
+
+        /* get the applicable environment */
+        env = get_filtered_environment (si->pid);
+
+        num = 0;
+
+        argv[0] = LIBEXECDIR "/ck-get-x11-server-pid";
+        argv[1] = NULL;
+
+        error = NULL;
+        out = NULL;
+        err = NULL;
+        status = -1;
+        res = g_spawn_sync (NULL,
+                            argv,
+                            (char **)env->pdata,
+                            0,
+                            (GSpawnChildSetupFunc)setuid_child_setup_func,
+                            si,
+                            &out,
+                            &err,
+                            &status,
+                            &error);
+        for (i = 0; i < env->len; i++) {
+                g_free (g_ptr_array_index (env, i));
+        }
+        g_ptr_array_free (env, TRUE);
+
+        if (error != NULL) {
+                g_warning ("Unable to PID for x11 server: %s", error->message);
+                g_error_free (error);
+        }
+
+        if (status == 0) {
+                if (res && out != NULL) {
+                        guint v;
+                        char  c;
+
+                        if (1 == sscanf (out, "%u %c", &v, &c)) {
+                                num = v;
+                        }
+                }
+
+                if (can_connect != NULL) {
+                        *can_connect = TRUE;
+                }
+        }
+
+
+        if (err != NULL && err[0] != '\0') {
+                g_warning ("%s", err);
+        }
+
+        if (pid != NULL) {
+                *pid = num;
+        }
+
+        g_free (out);
+        g_free (err);
+}
+
+/* Looking at the XFree86_VT property on the root window
+ * doesn't work very well because it is difficult to
+ * distinguish local from remote systems and the value
+ * can't necessarily be trusted.  So instead we connect
+ * to the server and use peer credentials to find the
+ * local PID and then find its tty.
+ */
+static void
+fill_x11_info (CkSessionInfo *si)
+{
+        guint          xorg_pid;
+        gboolean       can_connect;
+        gboolean       res;
+        CkProcessStat *xorg_stat;
+        GError        *error;
+
+        /* assume this is true then check it */
+        si->x11_display = ck_unix_pid_get_env (si->pid, "DISPLAY");
+
+        if (si->x11_display == NULL) {
+                /* no point continuing */
+                si->x11_can_connect = FALSE;
+                return;
+        }
+
+        xorg_pid = 0;
+        can_connect = FALSE;
+        if (! resolve_x11_server_pid (si, &can_connect, &xorg_pid)) {
+                run_x11_server_pid_helper (si, &can_connect, &xorg_pid);
+        }
+
+        si->x11_can_connect = can_connect;
+        if (! can_connect) {
+                g_free (si->x11_display);
+                si->x11_display = NULL;
+                return;
+        }
+
+        if (xorg_pid < 2) {
+                /* keep the tty value */
+                /* if we can connect but don't have a pid
+                 * then we're not local */
+
+                si->is_local = FALSE;
+                si->is_local_is_set = TRUE;
+
+                /* FIXME: get the remote hostname */
+
+                return;
+        }
+
+        error = NULL;
+        res = ck_process_stat_new_for_unix_pid (xorg_pid, &xorg_stat, &error);
+        if (! res) {
+                if (error != NULL) {
+                        g_warning ("stat on pid %d failed: %s", xorg_pid, error->message);
+                        g_error_free (error);
+                }
+                /* keep the tty value */
+                return;
+        }
+
+        si->x11_display_device = ck_process_stat_get_tty (xorg_stat);
+        ck_process_stat_free (xorg_stat);
+
+        /* don't set is-local here - let the daemon do that */
+
+        g_free (si->remote_host_name);
+        si->remote_host_name = NULL;
+}
+
+gboolean
+ck_session_info_collect (CkSessionInfo *si)
+{
+        CkProcessStat *stat;
+        GError        *error;
+        gboolean       res;
+
+        error = NULL;
+        res = ck_process_stat_new_for_unix_pid (si->pid, &stat, &error);
+        if (! res) {
+                if (error != NULL) {
+                        g_warning ("stat on pid %d failed: %s", si->pid, error->message);
+                        g_error_free (error);
+                }
+
+                return FALSE;
+        }
+
+        si->display_device = ck_process_stat_get_tty (stat);
+        ck_process_stat_free (stat);
+
+        fill_x11_info (si);
+
+        res = ck_unix_pid_get_login_session_id (si->pid, &si->login_session_id);
+        if (! res) {
+                si->login_session_id = NULL;
+        }
+
+        return TRUE;
+}
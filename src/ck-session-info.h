@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2007 William Jon McCann <mccann@jhu.edu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __CK_SESSION_INFO_H
+#define __CK_SESSION_INFO_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+        uid_t    uid;
+        pid_t    pid;
+        gid_t    gid;
+        char    *login_session_id;
+        char    *display_device;
+        char    *x11_display_device;
+        char    *x11_display;
+        gboolean x11_can_connect;
+        char    *remote_host_name;
+        gboolean is_local;
+        gboolean is_local_is_set;
+} CkSessionInfo;
+
+CkSessionInfo *     ck_session_info_new                       (uid_t           uid,
+                                                               pid_t           pid);
+void                ck_session_info_free                      (CkSessionInfo  *si);
+
+/* Safe to call from a thread other than the main one */
+gboolean            ck_session_info_collect                   (CkSessionInfo  *si);
+
+G_END_DECLS
+
+#endif /* __CK_SESSION_INFO_H */
@@ -36,7 +36,9 @@
 #include <dbus/dbus-glib-lowlevel.h>
 
 #include "ck-session-leader.h"
+#include "ck-session-info.h"
 #include "ck-job.h"
+#include "ck-stats.h"
 
 #define CK_SESSION_LEADER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), CK_TYPE_SESSION_LEADER, CkSessionLeaderPrivate))
 
@@ -47,6 +49,9 @@
 #define CK_TYPE_PARAMETER_LIST (dbus_g_type_get_collection ("GPtrArray", \
                                                             CK_TYPE_PARAMETER_STRUCT))
 
+/* upper bound on concurrent in-process session info collections */
+#define CK_SESSION_INFO_MAX_THREADS 4
+
 struct CkSessionLeaderPrivate
 {
         char       *id;
@@ -58,6 +63,9 @@ struct CkSessionLeaderPrivate
         GList      *pending_jobs;
         gboolean    cancelled;
         GHashTable *override_parameters;
+
+        /* the call waiting for the parameters, if any */
+        DBusGMethodInvocation *pending_context;
 };
 
 enum {
@@ -108,6 +116,12 @@ ck_session_leader_cancel (CkSessionLeader *leader)
                 leader->priv->pending_jobs = NULL;
         }
 
+        /* the caller is never replied to */
+        if (leader->priv->pending_context != NULL) {
+                ck_stats_call_drop (leader->priv->pending_context);
+                leader->priv->pending_context = NULL;
+        }
+
         leader->priv->cancelled = TRUE;
 }
 
@@ -241,6 +255,27 @@ static struct {
         { "unix-user",          add_param_int },
 };
 
+static void
+add_generated_param (CkSessionLeader *leader,
+                     GPtrArray       *parameters,
+                     const char      *key,
+                     const char      *value)
+{
+        int j;
+
+        /* we're going to override this anyway so just shortcut out */
+        if (have_override_parameter (leader, key)) {
+                return;
+        }
+
+        for (j = 0; j < G_N_ELEMENTS (parse_ops); j++) {
+                if (strcmp (key, parse_ops[j].key) == 0) {
+                        parse_ops[j].func (parameters, key, value);
+                        break;
+                }
+        }
+}
+
 static GPtrArray *
 parse_output (CkSessionLeader *leader,
               const char      *output)
@@ -248,7 +283,6 @@ parse_output (CkSessionLeader *leader,
         GPtrArray *parameters;
         char     **lines;
         int        i;
-        int        j;
 
         lines = g_strsplit (output, "\n", -1);
         if (lines == NULL) {
@@ -267,18 +301,7 @@ parse_output (CkSessionLeader *leader,
                         continue;
                 }
 
-                /* we're going to override this anyway so just shortcut out */
-                if (have_override_parameter (leader, vals[0])) {
-                        g_strfreev (vals);
-                        continue;
-                }
-
-                for (j = 0; j < G_N_ELEMENTS (parse_ops); j++) {
-                        if (strcmp (vals[0], parse_ops[j].key) == 0) {
-                                parse_ops[j].func (parameters, vals[0], vals[1]);
-                                break;
-                        }
-                }
+                add_generated_param (leader, parameters, vals[0], vals[1]);
                 g_strfreev (vals);
         }
         g_strfreev (lines);
@@ -291,6 +314,47 @@ parse_output (CkSessionLeader *leader,
         return parameters;
 }
 
+/* builds the same parameters that parse_output() would produce for
+ * the output of ck-collect-session-info */
+static GPtrArray *
+parameters_for_session_info (CkSessionLeader *leader,
+                             CkSessionInfo   *si)
+{
+        GPtrArray *parameters;
+        char      *str;
+
+        parameters = g_ptr_array_sized_new (10);
+
+        str = g_strdup_printf ("%u", si->uid);
+        add_generated_param (leader, parameters, "unix-user", str);
+        g_free (str);
+
+        if (si->x11_display != NULL) {
+                add_generated_param (leader, parameters, "x11-display", si->x11_display);
+        }
+        if (si->x11_display_device != NULL) {
+                add_generated_param (leader, parameters, "x11-display-device", si->x11_display_device);
+        }
+        if (si->display_device != NULL) {
+                add_generated_param (leader, parameters, "display-device", si->display_device);
+        }
+        if (si->remote_host_name != NULL) {
+                add_generated_param (leader, parameters, "remote-host-name", si->remote_host_name);
+        }
+        if (si->is_local_is_set) {
+                add_generated_param (leader, parameters, "is-local", si->is_local ? "true" : "false");
+        }
+        if (si->login_session_id != NULL) {
+                add_generated_param (leader, parameters, "login-session-id", si->login_session_id);
+        }
+
+        g_hash_table_foreach (leader->priv->override_parameters,
+                              (GHFunc)add_to_parameters,
+                              parameters);
+
+        return parameters;
+}
+
 static void
 parameters_free (GPtrArray *parameters)
 {
@@ -375,6 +439,9 @@ job_completed (CkJob     *job,
                JobData   *data)
 {
         g_debug ("Job status: %d", status);
+
+        data->leader->priv->pending_context = NULL;
+
         if (status == 0) {
                 char      *output;
                 GPtrArray *parameters;
@@ -411,11 +478,11 @@ job_data_free (JobData *data)
         g_free (data);
 }
 
-gboolean
-ck_session_leader_collect_parameters (CkSessionLeader        *session_leader,
-                                      DBusGMethodInvocation  *context,
-                                      CkSessionLeaderDoneFunc done_cb,
-                                      gpointer                user_data)
+static gboolean
+collect_with_helper (CkSessionLeader        *session_leader,
+                     DBusGMethodInvocation  *context,
+                     CkSessionLeaderDoneFunc done_cb,
+                     gpointer                user_data)
 {
         GError      *local_error;
         char        *command;
@@ -468,6 +535,142 @@ ck_session_leader_collect_parameters (CkSessionLeader        *session_leader,
         return ret;
 }
 
+typedef struct {
+        CkSessionLeader        *leader;
+        CkSessionLeaderDoneFunc done_cb;
+        gpointer                user_data;
+        DBusGMethodInvocation  *context;
+        CkSessionInfo          *si;
+        gboolean                res;
+} CollectData;
+
+static GThreadPool *collect_pool = NULL;
+
+static void
+collect_data_free (CollectData *data)
+{
+        g_object_unref (data->leader);
+        ck_session_info_free (data->si);
+        g_free (data);
+}
+
+/* runs in the main thread once the worker is finished */
+static gboolean
+collect_done_idle (CollectData *data)
+{
+        CkSessionLeader *leader;
+
+        leader = data->leader;
+
+        /* like a cancelled job the caller is not notified */
+        if (! leader->priv->cancelled) {
+                leader->priv->pending_context = NULL;
+
+                if (data->res) {
+                        GPtrArray *parameters;
+
+                        parameters = parameters_for_session_info (leader, data->si);
+                        data->done_cb (leader,
+                                       parameters,
+                                       data->context,
+                                       data->user_data);
+                        parameters_free (parameters);
+                } else {
+                        data->done_cb (leader,
+                                       NULL,
+                                       data->context,
+                                       data->user_data);
+                }
+        }
+
+        collect_data_free (data);
+
+        return FALSE;
+}
+
+static void
+collect_thread_func (CollectData *data,
+                     gpointer     pool_data)
+{
+        data->res = ck_session_info_collect (data->si);
+        g_idle_add ((GSourceFunc)collect_done_idle, data);
+}
+
+static gboolean
+collect_in_process (CkSessionLeader        *session_leader,
+                    DBusGMethodInvocation  *context,
+                    CkSessionLeaderDoneFunc done_cb,
+                    gpointer                user_data)
+{
+        GError      *error;
+        CollectData *data;
+
+        if (collect_pool == NULL) {
+                error = NULL;
+                collect_pool = g_thread_pool_new ((GFunc)collect_thread_func,
+                                                  NULL,
+                                                  CK_SESSION_INFO_MAX_THREADS,
+                                                  FALSE,
+                                                  &error);
+                if (collect_pool == NULL) {
+                        g_warning ("Unable to create session info thread pool: %s",
+                                   error != NULL ? error->message : "unknown error");
+                        if (error != NULL) {
+                                g_error_free (error);
+                        }
+                        return FALSE;
+                }
+        }
+
+        data = g_new0 (CollectData, 1);
+        data->leader = g_object_ref (session_leader);
+        data->done_cb = done_cb;
+        data->user_data = user_data;
+        data->context = context;
+        data->si = ck_session_info_new (session_leader->priv->uid,
+                                        session_leader->priv->pid);
+
+        error = NULL;
+        g_thread_pool_push (collect_pool, data, &error);
+        if (error != NULL) {
+                g_warning ("Unable to queue session info collection: %s", error->message);
+                g_error_free (error);
+                collect_data_free (data);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+gboolean
+ck_session_leader_collect_parameters (CkSessionLeader        *session_leader,
+                                      DBusGMethodInvocation  *context,
+                                      CkSessionLeaderDoneFunc done_cb,
+                                      gpointer                user_data)
+{
+        gboolean ret;
+
+        g_return_val_if_fail (CK_IS_SESSION_LEADER (session_leader), FALSE);
+
+        /* Gather the information in the daemon itself and only fall
+         * back to the external helper when that isn't possible or
+         * has been disabled. */
+        ret = FALSE;
+        if (g_thread_supported ()
+            && g_getenv ("CK_USE_SESSION_INFO_HELPER") == NULL) {
+                ret = collect_in_process (session_leader, context, done_cb, user_data);
+        }
+
+        if (! ret) {
+                ret = collect_with_helper (session_leader, context, done_cb, user_data);
+        }
+
+        if (ret) {
+                session_leader->priv->pending_context = context;
+        }
+
+        return ret;
+}
 
 const char *
 ck_session_leader_peek_session_id    (CkSessionLeader        *session_leader)
@@ -39,7 +39,9 @@
 #include "ck-session.h"
 #include "ck-session-glue.h"
 #include "ck-marshal.h"
+#include "ck-stats.h"
 #include "ck-run-programs.h"
+#include "ck-caller-info.h"
 
 #define CK_SESSION_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), CK_TYPE_SESSION, CkSessionPrivate))
 
@@ -159,10 +161,12 @@ ck_session_lock (CkSession             *session,
 {
         g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
 
+        ck_stats_call_begin (context, "Session.Lock");
+
         g_debug ("Emitting lock for session %s", session->priv->id);
         g_signal_emit (session, signals [LOCK], 0);
 
-        dbus_g_method_return (context);
+        dbus_g_method_return (ck_stats_reply (context, TRUE));
 
         return TRUE;
 }
@@ -173,59 +177,16 @@ ck_session_unlock (CkSession             *session,
 {
         g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
 
+        ck_stats_call_begin (context, "Session.Unlock");
+
         g_debug ("Emitting unlock for session %s", session->priv->id);
         g_signal_emit (session, signals [UNLOCK], 0);
 
-        dbus_g_method_return (context);
+        dbus_g_method_return (ck_stats_reply (context, TRUE));
 
         return TRUE;
 }
 
-/* adapted from PolicyKit */
-static gboolean
-get_caller_info (CkSession   *session,
-                 const char  *sender,
-                 uid_t       *calling_uid,
-                 pid_t       *calling_pid)
-{
-        gboolean res;
-        GError  *error = NULL;
-
-        res = FALSE;
-
-        if (sender == NULL) {
-                goto out;
-        }
-
-        if (! dbus_g_proxy_call (session->priv->bus_proxy, "GetConnectionUnixUser", &error,
-                                 G_TYPE_STRING, sender,
-                                 G_TYPE_INVALID,
-                                 G_TYPE_UINT, calling_uid,
-                                 G_TYPE_INVALID)) {
-                g_warning ("GetConnectionUnixUser() failed: %s", error->message);
-                g_error_free (error);
-                goto out;
-        }
-
-        if (! dbus_g_proxy_call (session->priv->bus_proxy, "GetConnectionUnixProcessID", &error,
-                                 G_TYPE_STRING, sender,
-                                 G_TYPE_INVALID,
-                                 G_TYPE_UINT, calling_pid,
-                                 G_TYPE_INVALID)) {
-                g_warning ("GetConnectionUnixProcessID() failed: %s", error->message);
-                g_error_free (error);
-                goto out;
-        }
-
-        res = TRUE;
-
-        g_debug ("uid = %d", *calling_uid);
-        g_debug ("pid = %d", *calling_pid);
-
-out:
-        return res;
-}
-
 static gboolean
 session_set_idle_hint_internal (CkSession      *session,
                                 gboolean        idle_hint)
@@ -244,43 +205,41 @@ session_set_idle_hint_internal (CkSession      *session,
         return TRUE;
 }
 
-/*
-  Example:
-  dbus-send --system --dest=org.freedesktop.ConsoleKit \
-  --type=method_call --print-reply --reply-timeout=2000 \
-  /org/freedesktop/ConsoleKit/Session1 \
-  org.freedesktop.ConsoleKit.Session.SetIdleHint boolean:TRUE
-*/
-gboolean
-ck_session_set_idle_hint (CkSession             *session,
-                          gboolean               idle_hint,
-                          DBusGMethodInvocation *context)
+typedef struct
 {
-        char       *sender;
-        uid_t       calling_uid;
-        pid_t       calling_pid;
-        gboolean    res;
+        CkSession             *session;
+        gboolean               idle_hint;
+        DBusGMethodInvocation *context;
+} SetIdleHintData;
 
-        g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
+static void
+set_idle_hint_data_free (SetIdleHintData *data)
+{
+        g_object_unref (data->session);
+        g_free (data);
+}
 
-        sender = dbus_g_method_get_sender (context);
+static void
+set_idle_hint_caller_info_cb (const char      *sender,
+                              gboolean         success,
+                              uid_t            calling_uid,
+                              pid_t            calling_pid,
+                              SetIdleHintData *data)
+{
+        CkSession *session;
 
-        res = get_caller_info (session,
-                               sender,
-                               &calling_uid,
-                               &calling_pid);
-        g_free (sender);
+        session = data->session;
 
-        if (! res) {
+        if (! success) {
                 GError *error;
                 error = g_error_new (CK_SESSION_ERROR,
                                      CK_SESSION_ERROR_GENERAL,
                                      _("Unable to lookup information about calling process '%d'"),
                                      calling_pid);
                 g_warning ("stat on pid %d failed", calling_pid);
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
-                return FALSE;
+                return;
         }
 
         /* only restrict this by UID for now */
@@ -289,13 +248,46 @@ ck_session_set_idle_hint (CkSession             *session,
                 error = g_error_new (CK_SESSION_ERROR,
                                      CK_SESSION_ERROR_GENERAL,
                                      _("Only session owner may set idle hint state"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (data->context, FALSE), error);
                 g_error_free (error);
-                return FALSE;
+                return;
         }
 
-        session_set_idle_hint_internal (session, idle_hint);
-        dbus_g_method_return (context);
+        session_set_idle_hint_internal (session, data->idle_hint);
+        dbus_g_method_return (ck_stats_reply (data->context, TRUE));
+}
+
+/*
+  Example:
+  dbus-send --system --dest=org.freedesktop.ConsoleKit \
+  --type=method_call --print-reply --reply-timeout=2000 \
+  /org/freedesktop/ConsoleKit/Session1 \
+  org.freedesktop.ConsoleKit.Session.SetIdleHint boolean:TRUE
+*/
+gboolean
+ck_session_set_idle_hint (CkSession             *session,
+                          gboolean               idle_hint,
+                          DBusGMethodInvocation *context)
+{
+        char            *sender;
+        SetIdleHintData *data;
+
+        g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
+
+        ck_stats_call_begin (context, "Session.SetIdleHint");
+
+        data = g_new0 (SetIdleHintData, 1);
+        data->session = g_object_ref (session);
+        data->idle_hint = idle_hint;
+        data->context = context;
+
+        sender = dbus_g_method_get_sender (context);
+        ck_caller_info_get_async (session->priv->bus_proxy,
+                                  sender,
+                                  (CkCallerInfoFunc) set_idle_hint_caller_info_cb,
+                                  data,
+                                  (GDestroyNotify) set_idle_hint_data_free);
+        g_free (sender);
 
         return TRUE;
 }
@@ -368,6 +360,8 @@ ck_session_activate (CkSession             *session,
 
         g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
 
+        ck_stats_call_begin (context, "Session.Activate");
+
         res = FALSE;
         g_signal_emit (session, signals [ACTIVATE], 0, context, &res);
         if (! res) {
@@ -381,7 +375,7 @@ ck_session_activate (CkSession             *session,
                 error = g_error_new (CK_SESSION_ERROR,
                                      CK_SESSION_ERROR_GENERAL,
                                      _("Unable to activate session"));
-                dbus_g_method_return_error (context, error);
+                dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
                 g_error_free (error);
                 return FALSE;
         }
@@ -413,11 +407,28 @@ ck_session_set_is_local (CkSession      *session,
 
         if (session->priv->is_local != is_local) {
                 session->priv->is_local = is_local;
+                g_object_notify (G_OBJECT (session), "is-local");
         }
 
         return TRUE;
 }
 
+const char *
+ck_session_peek_id (CkSession *session)
+{
+        g_return_val_if_fail (CK_IS_SESSION (session), NULL);
+
+        return session->priv->id;
+}
+
+const char *
+ck_session_peek_login_session_id (CkSession *session)
+{
+        g_return_val_if_fail (CK_IS_SESSION (session), NULL);
+
+        return session->priv->login_session_id;
+}
+
 gboolean
 ck_session_get_id (CkSession      *session,
                    char          **id,
@@ -641,7 +652,10 @@ ck_session_set_unix_user (CkSession      *session,
 {
         g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
 
-        session->priv->uid = uid;
+        if (session->priv->uid != uid) {
+                session->priv->uid = uid;
+                g_object_notify (G_OBJECT (session), "unix-user");
+        }
 
         return TRUE;
 }
@@ -692,8 +706,11 @@ ck_session_set_login_session_id (CkSession      *session,
 {
         g_return_val_if_fail (CK_IS_SESSION (session), FALSE);
 
-        g_free (session->priv->login_session_id);
-        session->priv->login_session_id = g_strdup (login_session_id);
+        if (g_strcmp0 (session->priv->login_session_id, login_session_id) != 0) {
+                g_free (session->priv->login_session_id);
+                session->priv->login_session_id = g_strdup (login_session_id);
+                g_object_notify (G_OBJECT (session), "login-session-id");
+        }
 
         return TRUE;
 }
@@ -1294,6 +1311,90 @@ ck_session_run_programs (CkSession  *session,
         }
 }
 
+static void
+snapshot_value_free (GValue *value)
+{
+        g_value_unset (value);
+        g_free (value);
+}
+
+static void
+snapshot_add_string (GHashTable *props,
+                     const char *name,
+                     const char *str)
+{
+        GValue *value;
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, G_TYPE_STRING);
+        g_value_set_string (value, NONULL_STRING (str));
+        g_hash_table_insert (props, g_strdup (name), value);
+}
+
+static void
+snapshot_add_boolean (GHashTable *props,
+                      const char *name,
+                      gboolean    b)
+{
+        GValue *value;
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, G_TYPE_BOOLEAN);
+        g_value_set_boolean (value, b);
+        g_hash_table_insert (props, g_strdup (name), value);
+}
+
+/* All the properties of the session in one a{sv} dictionary, named
+ * as for OpenSessionWithParameters. */
+GHashTable *
+ck_session_get_snapshot (CkSession *session)
+{
+        GHashTable *props;
+        GValue     *value;
+        char       *s;
+
+        g_return_val_if_fail (CK_IS_SESSION (session), NULL);
+
+        props = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) snapshot_value_free);
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, G_TYPE_UINT);
+        g_value_set_uint (value, session->priv->uid);
+        g_hash_table_insert (props, g_strdup ("unix-user"), value);
+
+        if (session->priv->seat_id != NULL) {
+                value = g_new0 (GValue, 1);
+                g_value_init (value, DBUS_TYPE_G_OBJECT_PATH);
+                g_value_set_boxed (value, session->priv->seat_id);
+                g_hash_table_insert (props, g_strdup ("seat-id"), value);
+        }
+
+        snapshot_add_string (props, "session-type", session->priv->session_type);
+        snapshot_add_string (props, "login-session-id", session->priv->login_session_id);
+        snapshot_add_string (props, "display-device", session->priv->display_device);
+        snapshot_add_string (props, "x11-display-device", session->priv->x11_display_device);
+        snapshot_add_string (props, "x11-display", session->priv->x11_display);
+        snapshot_add_string (props, "remote-host-name", session->priv->remote_host_name);
+        snapshot_add_boolean (props, "active", session->priv->active);
+        snapshot_add_boolean (props, "is-local", session->priv->is_local);
+        snapshot_add_boolean (props, "idle-hint", session->priv->idle_hint);
+
+        s = _g_time_val_to_iso8601 (&session->priv->creation_time);
+        snapshot_add_string (props, "creation-time", s);
+        g_free (s);
+
+        if (session->priv->idle_hint) {
+                s = _g_time_val_to_iso8601 (&session->priv->idle_since_hint);
+                snapshot_add_string (props, "idle-since-hint", s);
+                g_free (s);
+        }
+
+        return props;
+}
+
 void
 ck_session_dump (CkSession *session,
                  GKeyFile  *key_file)
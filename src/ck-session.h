@@ -76,6 +76,7 @@ CkSession         * ck_session_new_with_parameters    (const char            *ss
 
 void                ck_session_dump                   (CkSession             *session,
                                                        GKeyFile              *key_file);
+GHashTable        * ck_session_get_snapshot           (CkSession             *session);
 void                ck_session_run_programs           (CkSession             *session,
                                                        const char            *action);
 
@@ -117,6 +118,9 @@ gboolean            ck_session_set_session_type       (CkSession             *se
                                                        const char            *type,
                                                        GError               **error);
 
+const char *        ck_session_peek_id                (CkSession             *session);
+const char *        ck_session_peek_login_session_id  (CkSession             *session);
+
 /* Exported methods */
 
 /* Authoritative properties */
@@ -0,0 +1,336 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "ck-stats.h"
+
+#define CK_INTERFACE_PREFIX "org.freedesktop.ConsoleKit."
+
+/* Upper bounds of the latency buckets in microseconds; the last
+ * bucket catches everything slower. */
+static const guint bucket_bounds[] = {
+        10, 20, 50, 100, 200, 500,
+        1000, 2000, 5000, 10000, 20000, 50000,
+        100000, 200000, 500000, 1000000,
+};
+
+#define N_BUCKETS (G_N_ELEMENTS (bucket_bounds) + 1)
+
+typedef struct
+{
+        guint calls;
+        guint errors;
+        guint buckets[N_BUCKETS];
+} MethodStats;
+
+typedef struct
+{
+        const char *method;
+        GTimeVal    start;
+} PendingCall;
+
+/* Calls are counted as they come in off the bus, which covers every
+ * method.  Latency and errors are recorded for the asynchronous
+ * methods, from the moment the handler starts until it replies. */
+static GHashTable       *method_stats = NULL;
+static GHashTable       *pending_calls = NULL;
+static CkStatsGaugeFunc  gauge_func = NULL;
+static gpointer          gauge_data = NULL;
+
+static MethodStats *
+get_method_stats (const char *method)
+{
+        MethodStats *stats;
+
+        if (method_stats == NULL) {
+                method_stats = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      g_free);
+        }
+
+        stats = g_hash_table_lookup (method_stats, method);
+        if (stats == NULL) {
+                stats = g_new0 (MethodStats, 1);
+                g_hash_table_insert (method_stats, g_strdup (method), stats);
+        }
+
+        return stats;
+}
+
+static DBusHandlerResult
+stats_filter (DBusConnection *connection,
+              DBusMessage    *message,
+              void           *user_data)
+{
+        const char *interface;
+        const char *member;
+        char       *method;
+
+        if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL) {
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        }
+
+        interface = dbus_message_get_interface (message);
+        member = dbus_message_get_member (message);
+        if (interface == NULL
+            || member == NULL
+            || ! g_str_has_prefix (interface, CK_INTERFACE_PREFIX)) {
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        }
+
+        method = g_strdup_printf ("%s.%s",
+                                  interface + strlen (CK_INTERFACE_PREFIX),
+                                  member);
+        get_method_stats (method)->calls++;
+        g_free (method);
+
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void
+ck_stats_install_filter (DBusGConnection *connection)
+{
+        g_return_if_fail (connection != NULL);
+
+        dbus_connection_add_filter (dbus_g_connection_get_connection (connection),
+                                    stats_filter,
+                                    NULL,
+                                    NULL);
+}
+
+/* method must be a static string */
+void
+ck_stats_call_begin (DBusGMethodInvocation *context,
+                     const char            *method)
+{
+        PendingCall *call;
+
+        if (pending_calls == NULL) {
+                pending_calls = g_hash_table_new_full (g_direct_hash,
+                                                       g_direct_equal,
+                                                       NULL,
+                                                       g_free);
+        }
+
+        /* a call may be handed on to another object; keep the first */
+        if (g_hash_table_lookup (pending_calls, context) != NULL) {
+                return;
+        }
+
+        call = g_new0 (PendingCall, 1);
+        call->method = method;
+        g_get_current_time (&call->start);
+
+        g_hash_table_insert (pending_calls, context, call);
+}
+
+/* Ends the call and returns @context, so that every reply is sent
+ * through here:
+ *
+ *   dbus_g_method_return (ck_stats_reply (context, TRUE), ssid);
+ *   dbus_g_method_return_error (ck_stats_reply (context, FALSE), error);
+ */
+DBusGMethodInvocation *
+ck_stats_reply (DBusGMethodInvocation *context,
+                gboolean               success)
+{
+        PendingCall *call;
+        MethodStats *stats;
+        GTimeVal     now;
+        glong        usec;
+        guint        i;
+
+        if (pending_calls == NULL) {
+                return context;
+        }
+
+        call = g_hash_table_lookup (pending_calls, context);
+        if (call == NULL) {
+                return context;
+        }
+
+        g_get_current_time (&now);
+        usec = (now.tv_sec - call->start.tv_sec) * G_USEC_PER_SEC
+                + (now.tv_usec - call->start.tv_usec);
+        if (usec < 0) {
+                usec = 0;
+        }
+
+        stats = get_method_stats (call->method);
+        if (! success) {
+                stats->errors++;
+        }
+
+        for (i = 0; i < G_N_ELEMENTS (bucket_bounds); i++) {
+                if (usec < bucket_bounds[i]) {
+                        break;
+                }
+        }
+        stats->buckets[i]++;
+
+        g_hash_table_remove (pending_calls, context);
+
+        return context;
+}
+
+/* Forgets a call that will never be replied to, such as one whose
+ * caller has gone away */
+void
+ck_stats_call_drop (DBusGMethodInvocation *context)
+{
+        if (pending_calls == NULL) {
+                return;
+        }
+
+        g_hash_table_remove (pending_calls, context);
+}
+
+void
+ck_stats_set_gauge_func (CkStatsGaugeFunc func,
+                         gpointer         data)
+{
+        gauge_func = func;
+        gauge_data = data;
+}
+
+static void
+add_method_to_table (const char  *method,
+                     MethodStats *stats,
+                     GHashTable  *table)
+{
+        GArray *array;
+        guint   value;
+        guint   i;
+
+        array = g_array_sized_new (FALSE, FALSE, sizeof (guint), N_BUCKETS + 2);
+        g_array_append_val (array, stats->calls);
+        g_array_append_val (array, stats->errors);
+        for (i = 0; i < N_BUCKETS; i++) {
+                value = stats->buckets[i];
+                g_array_append_val (array, value);
+        }
+
+        g_hash_table_insert (table, g_strdup (method), array);
+}
+
+static void
+free_array (GArray *array)
+{
+        g_array_free (array, TRUE);
+}
+
+/* method -> [calls, errors, bucket 0, ... bucket N] */
+GHashTable *
+ck_stats_get_methods (void)
+{
+        GHashTable *table;
+
+        table = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) free_array);
+        if (method_stats != NULL) {
+                g_hash_table_foreach (method_stats, (GHFunc) add_method_to_table, table);
+        }
+
+        return table;
+}
+
+GArray *
+ck_stats_get_bucket_bounds (void)
+{
+        GArray *array;
+
+        array = g_array_sized_new (FALSE, FALSE, sizeof (guint), G_N_ELEMENTS (bucket_bounds));
+        g_array_append_vals (array, bucket_bounds, G_N_ELEMENTS (bucket_bounds));
+
+        return array;
+}
+
+/* gauge name -> current value */
+GHashTable *
+ck_stats_get_gauges (void)
+{
+        GHashTable *gauges;
+
+        gauges = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        if (gauge_func != NULL) {
+                gauge_func (gauges, gauge_data);
+        }
+
+        return gauges;
+}
+
+static void
+log_method (const char  *method,
+            MethodStats *stats,
+            gpointer     data)
+{
+        GString *str;
+        guint    i;
+
+        str = g_string_new (NULL);
+        for (i = 0; i < N_BUCKETS; i++) {
+                if (stats->buckets[i] == 0) {
+                        continue;
+                }
+                if (i < G_N_ELEMENTS (bucket_bounds)) {
+                        g_string_append_printf (str, " <%uus:%u", bucket_bounds[i], stats->buckets[i]);
+                } else {
+                        g_string_append_printf (str, " slower:%u", stats->buckets[i]);
+                }
+        }
+
+        g_message ("%s: calls=%u errors=%u%s", method, stats->calls, stats->errors, str->str);
+        g_string_free (str, TRUE);
+}
+
+static void
+log_gauge (const char *name,
+           gpointer    value,
+           gpointer    data)
+{
+        g_message ("%s=%u", name, GPOINTER_TO_UINT (value));
+}
+
+void
+ck_stats_log (void)
+{
+        GHashTable *gauges;
+
+        g_message ("Statistics:");
+
+        gauges = ck_stats_get_gauges ();
+        g_hash_table_foreach (gauges, (GHFunc) log_gauge, NULL);
+        g_hash_table_destroy (gauges);
+
+        if (method_stats != NULL) {
+                g_hash_table_foreach (method_stats, (GHFunc) log_method, NULL);
+        }
+}
@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_STATS_H
+#define __CK_STATS_H
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+G_BEGIN_DECLS
+
+/* Fills in name -> value for each gauge */
+typedef void  (* CkStatsGaugeFunc)          (GHashTable  *gauges,
+                                             gpointer     data);
+
+void                ck_stats_install_filter                   (DBusGConnection       *connection);
+
+void                ck_stats_call_begin                       (DBusGMethodInvocation *context,
+                                                               const char            *method);
+DBusGMethodInvocation * ck_stats_reply                        (DBusGMethodInvocation *context,
+                                                               gboolean               success);
+void                ck_stats_call_drop                        (DBusGMethodInvocation *context);
+
+void                ck_stats_set_gauge_func                   (CkStatsGaugeFunc       func,
+                                                               gpointer               data);
+
+GHashTable *        ck_stats_get_methods                      (void);
+GArray *            ck_stats_get_bucket_bounds                (void);
+GHashTable *        ck_stats_get_gauges                       (void);
+
+void                ck_stats_log                              (void);
+
+G_END_DECLS
+
+#endif /* __CK_STATS_H */
@@ -85,6 +85,15 @@ ck_process_stat_get_ppid (CkProcessStat *stat)
         return proc_stat_pid (stat->ps);
 }
 
+guint64
+ck_process_stat_get_start_time (CkProcessStat *stat)
+{
+        g_return_val_if_fail (stat != NULL, 0);
+
+        /* not available; callers treat 0 as unknown */
+        return 0;
+}
+
 char *
 ck_process_stat_get_cmd (CkProcessStat *stat)
 {
@@ -98,6 +98,8 @@ typedef struct tty_map_node {
 } tty_map_node;
 
 static tty_map_node *tty_map = NULL;
+/* session info may be collected from worker threads */
+G_LOCK_DEFINE_STATIC (tty_map);
 
 /* adapted from procps */
 /* Load /proc/tty/drivers for device name mapping use. */
@@ -184,9 +186,11 @@ driver_name (guint maj,
         tty_map_node *tmn;
         char         *tty;
 
+        G_LOCK (tty_map);
         if (! tty_map) {
                 load_drivers ();
         }
+        G_UNLOCK (tty_map);
         if (tty_map == (tty_map_node *) - 1) {
                 return 0;
         }
@@ -280,6 +284,14 @@ ck_process_stat_get_ppid (CkProcessStat *stat)
         return stat->ppid;
 }
 
+guint64
+ck_process_stat_get_start_time (CkProcessStat *stat)
+{
+        g_return_val_if_fail (stat != NULL, 0);
+
+        return stat->start_time;
+}
+
 char *
 ck_process_stat_get_cmd (CkProcessStat *stat)
 {
@@ -102,6 +102,14 @@ ck_process_stat_get_ppid (CkProcessStat *stat)
         return stat->ppid;
 }
 
+guint64
+ck_process_stat_get_start_time (CkProcessStat *stat)
+{
+        g_return_val_if_fail (stat != NULL, 0);
+
+        return stat->start_time;
+}
+
 char *
 ck_process_stat_get_cmd (CkProcessStat *stat)
 {
@@ -33,6 +33,7 @@ gboolean     ck_process_stat_new_for_unix_pid (pid_t           pid,
                                                CkProcessStat **stat,
                                                GError        **error);
 pid_t        ck_process_stat_get_ppid         (CkProcessStat  *stat);
+guint64      ck_process_stat_get_start_time   (CkProcessStat  *stat);
 char        *ck_process_stat_get_tty          (CkProcessStat  *stat);
 char        *ck_process_stat_get_cmd          (CkProcessStat  *stat);
 void         ck_process_stat_free             (CkProcessStat  *stat);
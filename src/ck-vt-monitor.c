@@ -84,6 +84,7 @@ G_LOCK_DEFINE_STATIC (hash_lock);
 G_LOCK_DEFINE_STATIC (schedule_lock);
 
 static gpointer vt_object = NULL;
+static volatile gint n_vt_threads = 0;
 
 GQuark
 ck_vt_monitor_error_quark (void)
@@ -340,6 +341,7 @@ vt_thread_start (ThreadData *data)
         }
         G_UNLOCK (hash_lock);
 
+        g_atomic_int_add (&n_vt_threads, -1);
         g_thread_exit (NULL);
         thread_data_free (data);
 
@@ -370,6 +372,7 @@ vt_add_watch_unlocked (CkVtMonitor *vt_monitor,
                 g_error_free (error);
         } else {
                 g_hash_table_insert (vt_monitor->priv->vt_thread_hash, id, thread);
+                g_atomic_int_inc (&n_vt_threads);
         }
 }
 
@@ -428,6 +431,12 @@ vt_add_watches (CkVtMonitor *vt_monitor)
 #endif
 }
 
+guint
+ck_vt_monitor_get_n_threads (void)
+{
+        return (guint) g_atomic_int_get (&n_vt_threads);
+}
+
 static void
 ck_vt_monitor_class_init (CkVtMonitorClass *klass)
 {
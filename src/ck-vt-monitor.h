@@ -66,6 +66,8 @@ gboolean            ck_vt_monitor_get_active          (CkVtMonitor    *vt_monito
                                                        guint32        *num,
                                                        GError        **error);
 
+guint               ck_vt_monitor_get_n_threads       (void);
+
 G_END_DECLS
 
 #endif /* __CK_VT_MONITOR_H */
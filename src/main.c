@@ -39,7 +39,10 @@
 
 #include "ck-sysdeps.h"
 #include "ck-manager.h"
+#include "ck-run-programs.h"
 #include "ck-log.h"
+#include "ck-stats.h"
+#include "ck-event-logger.h"
 
 #define CK_DBUS_NAME         "org.freedesktop.ConsoleKit"
 
@@ -161,7 +164,11 @@ debug_log_io_cb (GIOChannel  *io,
         while (read (debug_log_pipes[0], &a, 1) != 1)
                 ;
 
-        ck_log_toggle_debug ();
+        if (a == 's') {
+                ck_stats_log ();
+        } else {
+                ck_log_toggle_debug ();
+        }
 
         return TRUE;
 }
@@ -173,6 +180,13 @@ sigusr1_handler (int sig)
                 ;
 }
 
+static void
+sigusr2_handler (int sig)
+{
+        while (write (debug_log_pipes[1], "s", 1) != 1)
+                ;
+}
+
 static void
 setup_debug_log_signals (void)
 {
@@ -190,6 +204,9 @@ setup_debug_log_signals (void)
         sigemptyset (&sa.sa_mask);
         sa.sa_flags = 0;
         sigaction (SIGUSR1, &sa, NULL);
+
+        sa.sa_handler = sigusr2_handler;
+        sigaction (SIGUSR2, &sa, NULL);
 }
 
 static void
@@ -248,13 +265,30 @@ main (int    argc,
         GError          *error;
         int              ret;
         gboolean         res;
+        CkEventLoggerOverflow overflow;
         static gboolean     debug            = FALSE;
         static gboolean     no_daemon        = FALSE;
         static gboolean     do_timed_exit    = FALSE;
+        static gboolean     test_mode        = FALSE;
+        static int          log_sync_interval = -1;
+        static gboolean     log_binary       = FALSE;
+        static int          log_queue_depth  = 512;
+        static char        *log_overflow     = NULL;
+        static gboolean     log_no_file      = FALSE;
+        static char        *log_socket       = NULL;
+        static int          log_memory       = 0;
         static GOptionEntry entries []   = {
                 { "debug", 0, 0, G_OPTION_ARG_NONE, &debug, N_("Enable debugging code"), NULL },
                 { "no-daemon", 0, 0, G_OPTION_ARG_NONE, &no_daemon, N_("Don't become a daemon"), NULL },
                 { "timed-exit", 0, 0, G_OPTION_ARG_NONE, &do_timed_exit, N_("Exit after a time - for debugging"), NULL },
+                { "test-mode", 0, 0, G_OPTION_ARG_NONE, &test_mode, N_("Run unprivileged on a private bus without callouts - for testing"), NULL },
+                { "log-sync-interval", 0, 0, G_OPTION_ARG_INT, &log_sync_interval, N_("Sync the history log at most every MSEC milliseconds, 0 after every write, -1 never"), N_("MSEC") },
+                { "log-binary", 0, 0, G_OPTION_ARG_NONE, &log_binary, N_("Write the history log in the binary format"), NULL },
+                { "log-queue-depth", 0, 0, G_OPTION_ARG_INT, &log_queue_depth, N_("Number of events that may wait to be written to the history log"), N_("N") },
+                { "log-overflow", 0, 0, G_OPTION_ARG_STRING, &log_overflow, N_("What to do when the history log queue is full: drop-newest (the default), drop-oldest, or grow to keep every event in memory, with no limit"), N_("POLICY") },
+                { "log-no-file", 0, 0, G_OPTION_ARG_NONE, &log_no_file, N_("Don't write the history log file"), NULL },
+                { "log-socket", 0, 0, G_OPTION_ARG_FILENAME, &log_socket, N_("Send each event to a local datagram or seqpacket socket"), N_("PATH") },
+                { "log-memory", 0, 0, G_OPTION_ARG_INT, &log_memory, N_("Keep the last N events in memory for GetRecentEvents"), N_("N") },
                 { NULL }
         };
 
@@ -266,11 +300,6 @@ main (int    argc,
         dbus_g_thread_init ();
         g_type_init ();
 
-        if (! ck_is_root_user ()) {
-                g_warning ("Must be run as root");
-                exit (1);
-        }
-
         if (debug) {
                 g_setenv ("G_DEBUG", "fatal_criticals", FALSE);
                 g_log_set_always_fatal (G_LOG_LEVEL_CRITICAL);
@@ -287,6 +316,44 @@ main (int    argc,
                 goto out;
         }
 
+        /* In test mode we talk to whatever DBUS_SYSTEM_BUS_ADDRESS
+         * points at; refuse root so the state files and callouts of
+         * the real daemon are never touched. */
+        if (test_mode) {
+                if (ck_is_root_user ()) {
+                        g_warning ("Test mode must not be run as root");
+                        exit (1);
+                }
+                ck_run_programs_set_enabled (FALSE);
+        } else if (! ck_is_root_user ()) {
+                g_warning ("Must be run as root");
+                exit (1);
+        }
+
+        if (log_queue_depth <= 0) {
+                g_warning ("The history log queue depth must be positive");
+                exit (1);
+        }
+
+        if (log_overflow == NULL || strcmp (log_overflow, "drop-newest") == 0) {
+                overflow = CK_EVENT_LOGGER_OVERFLOW_DROP_NEWEST;
+        } else if (strcmp (log_overflow, "drop-oldest") == 0) {
+                overflow = CK_EVENT_LOGGER_OVERFLOW_DROP_OLDEST;
+        } else if (strcmp (log_overflow, "grow") == 0) {
+                overflow = CK_EVENT_LOGGER_OVERFLOW_GROW;
+        } else {
+                g_warning ("Unknown history log overflow policy: %s", log_overflow);
+                exit (1);
+        }
+
+        ck_event_logger_set_default_sync_interval (log_sync_interval);
+        ck_event_logger_set_default_binary_format (log_binary);
+        ck_event_logger_set_default_queue_depth (log_queue_depth);
+        ck_event_logger_set_default_overflow (overflow);
+        ck_event_logger_set_default_write_file (! log_no_file);
+        ck_event_logger_set_default_socket_path (log_socket);
+        ck_event_logger_set_default_memory_events (log_memory);
+
         if (! no_daemon && daemon (0, 0)) {
                 g_error ("Could not daemonize: %s", g_strerror (errno));
         }
@@ -317,7 +384,9 @@ main (int    argc,
                 goto out;
         }
 
-        create_pid_file ();
+        if (! test_mode) {
+                create_pid_file ();
+        }
 
         loop = g_main_loop_new (NULL, FALSE);
 
@@ -0,0 +1,380 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Encodes events in binary blocks and reads them back, alone and in a
+ * history stream mixed with text lines, then damages the stream in a
+ * few ways and checks that the reader skips only the damaged part. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ck-log-event.h"
+#include "ck-log-event-block.h"
+#include "ck-log-event-reader.h"
+
+#define N_EVENTS 11
+
+static int n_failed = 0;
+
+static void
+check (gboolean    condition,
+       const char *what)
+{
+        if (! condition) {
+                g_print ("FAILED: %s\n", what);
+                n_failed++;
+        }
+}
+
+static void
+make_event (CkLogEvent *event,
+            guint       n)
+{
+        CkLogSeatSessionAddedEvent *e;
+
+        memset (event, 0, sizeof (CkLogEvent));
+
+        event->timestamp.tv_sec = 1200000000 + n;
+        event->timestamp.tv_usec = n * 1000;
+
+        switch (n % 5) {
+        case 0:
+                event->type = CK_LOG_EVENT_SEAT_SESSION_ADDED;
+                e = (CkLogSeatSessionAddedEvent *) event;
+                e->seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                e->session_id = "/org/freedesktop/ConsoleKit/Session1";
+                e->session_type = "";
+                e->session_x11_display = ":0";
+                e->session_x11_display_device = "/dev/tty7";
+                e->session_display_device = "";
+                e->session_remote_host_name = "";
+                e->session_is_local = TRUE;
+                e->session_unix_user = 500 + n;
+                e->session_creation_time = "2008-01-10T21:33:14.546154Z";
+                break;
+        case 1:
+                event->type = CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED;
+                event->event.seat_active_session_changed.seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                event->event.seat_active_session_changed.session_id = "/org/freedesktop/ConsoleKit/Session1";
+                break;
+        case 2:
+                event->type = CK_LOG_EVENT_SEAT_DEVICE_ADDED;
+                event->event.seat_device_added.seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                event->event.seat_device_added.device_type = "drm";
+                event->event.seat_device_added.device_id = "/dev/dri/card0";
+                break;
+        case 3:
+                event->type = CK_LOG_EVENT_SEAT_ADDED;
+                event->event.seat_added.seat_id = "/org/freedesktop/ConsoleKit/Seat2";
+                event->event.seat_added.seat_kind = 1;
+                break;
+        default:
+                event->type = CK_LOG_EVENT_EVENTS_LOST;
+                event->event.events_lost.n_events = n;
+                break;
+        }
+}
+
+static char *
+event_to_string (CkLogEvent *event)
+{
+        GString *str;
+
+        str = g_string_new (NULL);
+        ck_log_event_to_string (event, str);
+
+        return g_string_free (str, FALSE);
+}
+
+static void
+test_block (CkLogEvent **events,
+            char       **expected)
+{
+        GString   *str;
+        GPtrArray *decoded;
+        GTimeVal   first;
+        GTimeVal   last;
+        gsize      block_len;
+        guint      i;
+
+        str = g_string_new (NULL);
+        check (ck_log_event_block_append (str, events, N_EVENTS), "block is encoded");
+
+        check (ck_log_event_block_parse_header (str->str, str->len, &block_len, &first, &last),
+               "block header is parsed");
+        check (block_len == str->len, "block length");
+        check (first.tv_sec == events[0]->timestamp.tv_sec
+               && first.tv_usec == events[0]->timestamp.tv_usec,
+               "first timestamp");
+        check (last.tv_sec == events[N_EVENTS - 1]->timestamp.tv_sec
+               && last.tv_usec == events[N_EVENTS - 1]->timestamp.tv_usec,
+               "last timestamp");
+
+        decoded = g_ptr_array_new ();
+        check (ck_log_event_block_decode (str->str, str->len, decoded), "block is decoded");
+        check (decoded->len == N_EVENTS, "number of decoded events");
+        for (i = 0; i < decoded->len; i++) {
+                char *s;
+
+                s = event_to_string (g_ptr_array_index (decoded, i));
+                check (i < N_EVENTS && strcmp (s, expected[i]) == 0, "decoded event");
+                g_free (s);
+                ck_log_event_free (g_ptr_array_index (decoded, i));
+        }
+        g_ptr_array_set_size (decoded, 0);
+
+        /* a short block is refused but keeps what came before */
+        check (! ck_log_event_block_decode (str->str, str->len - 1, decoded), "short block is refused");
+        check (decoded->len == N_EVENTS - 1, "events before the damage are kept");
+        for (i = 0; i < decoded->len; i++) {
+                ck_log_event_free (g_ptr_array_index (decoded, i));
+        }
+        g_ptr_array_free (decoded, TRUE);
+
+        check (! ck_log_event_block_parse_header (str->str, CK_LOG_EVENT_BLOCK_HEADER_LEN - 1, &block_len, NULL, NULL),
+               "short header is refused");
+        str->str[1] = 'X';
+        check (! ck_log_event_block_parse_header (str->str, str->len, &block_len, NULL, NULL),
+               "bad magic is refused");
+
+        g_string_free (str, TRUE);
+}
+
+typedef struct
+{
+        const char *data;
+        gsize       len;
+        gsize       pos;
+} Stream;
+
+/* hands out a few bytes at a time to exercise the buffering */
+static gssize
+read_stream (Stream *stream,
+             char   *buf,
+             gsize   len)
+{
+        len = MIN (len, MIN (stream->len - stream->pos, 7));
+        memcpy (buf, stream->data + stream->pos, len);
+        stream->pos += len;
+
+        return len;
+}
+
+/* Returns the events of the stream as strings */
+static GPtrArray *
+read_all (const char *data,
+          gsize       len)
+{
+        CkLogEventReader *reader;
+        CkLogEvent       *event;
+        GPtrArray        *strings;
+        Stream            stream;
+
+        stream.data = data;
+        stream.len = len;
+        stream.pos = 0;
+
+        reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_stream, &stream);
+        strings = g_ptr_array_new ();
+        while ((event = ck_log_event_reader_next (reader)) != NULL) {
+                g_ptr_array_add (strings, event_to_string (event));
+                ck_log_event_free (event);
+        }
+        ck_log_event_reader_free (reader);
+
+        return strings;
+}
+
+static void
+free_strings (GPtrArray *strings)
+{
+        guint i;
+
+        for (i = 0; i < strings->len; i++) {
+                g_free (g_ptr_array_index (strings, i));
+        }
+        g_ptr_array_free (strings, TRUE);
+}
+
+/* Checks that the events read are the expected ones in order, with
+ * none made up, and that those from @first_needed on all came out */
+static void
+check_events (GPtrArray  *strings,
+              char      **expected,
+              guint       first_needed,
+              const char *what)
+{
+        gboolean ok;
+        guint    i;
+        guint    j;
+
+        ok = TRUE;
+        j = 0;
+        for (i = 0; i < strings->len; i++) {
+                while (j < N_EVENTS && strcmp (g_ptr_array_index (strings, i), expected[j]) != 0) {
+                        if (j >= first_needed) {
+                                ok = FALSE;
+                        }
+                        j++;
+                }
+                if (j == N_EVENTS) {
+                        ok = FALSE;
+                        break;
+                }
+                j++;
+        }
+        /* anything missing at the end */
+        if (j < N_EVENTS && first_needed < N_EVENTS) {
+                ok = FALSE;
+        }
+
+        check (ok, what);
+}
+
+/* text line, block, text line, block, text line; @offsets gets where
+ * the two blocks start */
+static GString *
+make_stream (CkLogEvent **events,
+             gsize       *offsets)
+{
+        GString *str;
+
+        str = g_string_new (NULL);
+
+        ck_log_event_to_string (events[0], str);
+        g_string_append_c (str, '\n');
+        offsets[0] = str->len;
+        ck_log_event_block_append (str, events + 1, 4);
+        ck_log_event_to_string (events[5], str);
+        g_string_append_c (str, '\n');
+        offsets[1] = str->len;
+        ck_log_event_block_append (str, events + 6, 4);
+        ck_log_event_to_string (events[10], str);
+        g_string_append_c (str, '\n');
+
+        return str;
+}
+
+static void
+test_reader (CkLogEvent **events,
+             char       **expected)
+{
+        GString   *str;
+        GPtrArray *strings;
+        gsize      offsets[2];
+        guint32    payload_len;
+
+        str = make_stream (events, offsets);
+        strings = read_all (str->str, str->len);
+        check (strings->len == N_EVENTS, "all events are read");
+        check_events (strings, expected, 0, "mixed stream");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* the reader resumes at the next block after a bad header */
+        str = make_stream (events, offsets);
+        str->str[offsets[0] + 1] = 'X';
+        strings = read_all (str->str, str->len);
+        check (strings->len > 0 && strcmp (g_ptr_array_index (strings, 0), expected[0]) == 0,
+               "events before a bad header are read");
+        check_events (strings, expected, 6, "bad magic");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* a length past the end of the stream */
+        str = make_stream (events, offsets);
+        payload_len = GUINT32_TO_LE (1024 * 1024);
+        memcpy (str->str + offsets[0] + 4, &payload_len, sizeof (payload_len));
+        strings = read_all (str->str, str->len);
+        check_events (strings, expected, 6, "length past the end");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* a length too large to be believed */
+        str = make_stream (events, offsets);
+        payload_len = GUINT32_TO_LE (0xffffffff);
+        memcpy (str->str + offsets[0] + 4, &payload_len, sizeof (payload_len));
+        strings = read_all (str->str, str->len);
+        check_events (strings, expected, 6, "huge length");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* a length that is short by one, so the block doesn't decode */
+        str = make_stream (events, offsets);
+        memcpy (&payload_len, str->str + offsets[0] + 4, sizeof (payload_len));
+        payload_len = GUINT32_TO_LE (GUINT32_FROM_LE (payload_len) - 1);
+        memcpy (str->str + offsets[0] + 4, &payload_len, sizeof (payload_len));
+        strings = read_all (str->str, str->len);
+        check_events (strings, expected, 6, "short length");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* garbage between a line and a block costs nothing */
+        str = make_stream (events, offsets);
+        g_string_insert_len (str, offsets[0], "\0\0garbage\n", 10);
+        strings = read_all (str->str, str->len);
+        check (strings->len == N_EVENTS, "garbage is skipped");
+        check_events (strings, expected, 0, "garbage");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+
+        /* a stream cut short in the last block */
+        str = make_stream (events, offsets);
+        g_string_truncate (str, offsets[1] + CK_LOG_EVENT_BLOCK_HEADER_LEN + 4);
+        strings = read_all (str->str, str->len);
+        check (strings->len == 6, "events before a cut are read");
+        check_events (strings, expected, N_EVENTS, "cut stream");
+        free_strings (strings);
+        g_string_free (str, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+        CkLogEvent *events[N_EVENTS];
+        char       *expected[N_EVENTS];
+        guint       i;
+
+        for (i = 0; i < N_EVENTS; i++) {
+                events[i] = g_new (CkLogEvent, 1);
+                make_event (events[i], i);
+                expected[i] = event_to_string (events[i]);
+        }
+
+        test_block (events, expected);
+        test_reader (events, expected);
+
+        for (i = 0; i < N_EVENTS; i++) {
+                g_free (expected[i]);
+                g_free (events[i]);
+        }
+
+        if (n_failed > 0) {
+                g_print ("%d checks failed\n", n_failed);
+                return 1;
+        }
+
+        g_print ("All checks passed\n");
+
+        return 0;
+}
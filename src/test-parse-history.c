@@ -0,0 +1,257 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+
+/* Times reading a synthetic history log, by default a million lines,
+ * in the text and binary formats.  --regex-baseline also times the
+ * old approach of compiling a regex for every line, for comparison. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ck-log-event.h"
+#include "ck-log-event-block.h"
+#include "ck-log-event-reader.h"
+
+#define SESSION_REGEX "seat-id='(?P<seatid>[a-zA-Z0-9/]+)' session-id='(?P<sessionid>[a-zA-Z0-9/]+)' session-type='(?P<sessiontype>[a-zA-Z0-9 ]*)' session-x11-display='(?P<sessionx11display>[0-9a-zA-Z.:]*)' session-x11-display-device='(?P<sessionx11displaydevice>[^']*)' session-display-device='(?P<sessiondisplaydevice>[^']*)' session-remote-host-name='(?P<sessionremotehostname>[^']*)' session-is-local=(?P<sessionislocal>[a-zA-Z]*) session-unix-user=(?P<sessionunixuser>[0-9]*) session-creation-time='(?P<sessioncreationtime>[^']*)'"
+
+static void
+make_event (CkLogEvent *event,
+            guint       n)
+{
+        CkLogSeatSessionAddedEvent *e;
+
+        memset (event, 0, sizeof (CkLogEvent));
+
+        event->timestamp.tv_sec = 1200000000 + n;
+        event->timestamp.tv_usec = (n % 1000) * 1000;
+
+        switch (n % 4) {
+        case 0:
+        case 1:
+                event->type = (n % 4 == 0) ? CK_LOG_EVENT_SEAT_SESSION_ADDED : CK_LOG_EVENT_SEAT_SESSION_REMOVED;
+                e = (CkLogSeatSessionAddedEvent *) event;
+                e->seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                e->session_id = "/org/freedesktop/ConsoleKit/Session1";
+                e->session_type = "";
+                e->session_x11_display = ":0";
+                e->session_x11_display_device = "/dev/tty7";
+                e->session_display_device = "";
+                e->session_remote_host_name = "";
+                e->session_is_local = TRUE;
+                e->session_unix_user = 500 + n % 50;
+                e->session_creation_time = "2008-01-10T21:33:14.546154Z";
+                break;
+        case 2:
+                event->type = CK_LOG_EVENT_SEAT_ACTIVE_SESSION_CHANGED;
+                event->event.seat_active_session_changed.seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                event->event.seat_active_session_changed.session_id = "/org/freedesktop/ConsoleKit/Session1";
+                break;
+        default:
+                event->type = CK_LOG_EVENT_SEAT_DEVICE_ADDED;
+                event->event.seat_device_added.seat_id = "/org/freedesktop/ConsoleKit/Seat1";
+                event->event.seat_device_added.device_type = "drm";
+                event->event.seat_device_added.device_id = "/dev/dri/card0";
+                break;
+        }
+}
+
+static char *
+write_history (guint    n_lines,
+               gboolean binary)
+{
+        GString    *str;
+        GPtrArray  *events;
+        CkLogEvent *event;
+        GError     *error;
+        char       *filename;
+        int         fd;
+        FILE       *f;
+        guint       i;
+
+        error = NULL;
+        fd = g_file_open_tmp ("ck-history-XXXXXX", &filename, &error);
+        if (fd == -1) {
+                g_warning ("Unable to create history file: %s", error->message);
+                exit (1);
+        }
+        f = fdopen (fd, "w");
+
+        str = g_string_new (NULL);
+        events = g_ptr_array_new ();
+        for (i = 0; i < n_lines; i++) {
+                event = g_new (CkLogEvent, 1);
+                make_event (event, i);
+
+                if (binary) {
+                        g_ptr_array_add (events, event);
+                        if (events->len == 256 || i == n_lines - 1) {
+                                ck_log_event_block_append (str, (CkLogEvent **) events->pdata, events->len);
+                                while (events->len > 0) {
+                                        g_free (g_ptr_array_remove_index (events, events->len - 1));
+                                }
+                        }
+                } else {
+                        ck_log_event_to_string (event, str);
+                        g_string_append_c (str, '\n');
+                        g_free (event);
+                }
+
+                if (str->len > 65536 || i == n_lines - 1) {
+                        fwrite (str->str, 1, str->len, f);
+                        g_string_truncate (str, 0);
+                }
+        }
+        fclose (f);
+
+        g_ptr_array_free (events, TRUE);
+        g_string_free (str, TRUE);
+
+        return filename;
+}
+
+static gssize
+read_stream (FILE  *f,
+             char  *buf,
+             gsize  len)
+{
+        return fread (buf, 1, len, f);
+}
+
+static void
+time_reader (const char *name,
+             const char *filename,
+             guint       n_lines)
+{
+        CkLogEventReader *reader;
+        CkLogEvent       *event;
+        FILE             *f;
+        GTimer           *timer;
+        guint             n_events;
+        gdouble           elapsed;
+
+        f = g_fopen (filename, "r");
+        reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_stream, f);
+
+        timer = g_timer_new ();
+        n_events = 0;
+        while ((event = ck_log_event_reader_next (reader)) != NULL) {
+                n_events++;
+                ck_log_event_free (event);
+        }
+        elapsed = g_timer_elapsed (timer, NULL);
+
+        g_print ("%-16s %8u events in %7.3f s  %10.0f events/s\n",
+                 name, n_events, elapsed, n_events / elapsed);
+        if (n_events != n_lines) {
+                g_warning ("Expected %u events", n_lines);
+        }
+
+        g_timer_destroy (timer);
+        ck_log_event_reader_free (reader);
+        fclose (f);
+}
+
+static void
+time_regex_baseline (const char *filename,
+                     guint       n_lines)
+{
+        FILE    *f;
+        GTimer  *timer;
+        char     line[2048];
+        guint    n_matched;
+        gdouble  elapsed;
+
+        f = g_fopen (filename, "r");
+
+        timer = g_timer_new ();
+        n_matched = 0;
+        while (fgets (line, sizeof (line), f) != NULL) {
+                GRegex     *re;
+                GMatchInfo *match_info;
+
+                re = g_regex_new (SESSION_REGEX, 0, 0, NULL);
+                g_regex_match (re, line, 0, &match_info);
+                if (g_match_info_matches (match_info)) {
+                        n_matched++;
+                }
+                g_match_info_free (match_info);
+                g_regex_unref (re);
+        }
+        elapsed = g_timer_elapsed (timer, NULL);
+
+        g_print ("%-16s %8u lines  in %7.3f s  %10.0f lines/s\n",
+                 "regex per line", n_lines, elapsed, n_lines / elapsed);
+
+        g_timer_destroy (timer);
+        fclose (f);
+}
+
+int
+main (int argc, char **argv)
+{
+        GOptionContext     *context;
+        GError             *error;
+        char               *text_file;
+        char               *binary_file;
+        static int          n_lines = 1000000;
+        static gboolean     regex_baseline = FALSE;
+        static GOptionEntry entries [] = {
+                { "lines", 'n', 0, G_OPTION_ARG_INT, &n_lines, "Number of log lines", "N" },
+                { "regex-baseline", 0, 0, G_OPTION_ARG_NONE, &regex_baseline, "Also time compiling a regex per line", NULL },
+                { NULL }
+        };
+
+        context = g_option_context_new (NULL);
+        g_option_context_add_main_entries (context, entries, NULL);
+        error = NULL;
+        if (! g_option_context_parse (context, &argc, &argv, &error)) {
+                g_warning ("%s", error->message);
+                exit (1);
+        }
+        g_option_context_free (context);
+
+        if (n_lines <= 0) {
+                g_warning ("Number of lines must be positive");
+                exit (1);
+        }
+
+        text_file = write_history (n_lines, FALSE);
+        binary_file = write_history (n_lines, TRUE);
+
+        time_reader ("text", text_file, n_lines);
+        time_reader ("binary", binary_file, n_lines);
+        if (regex_baseline) {
+                time_regex_baseline (text_file, n_lines);
+        }
+
+        g_unlink (text_file);
+        g_unlink (binary_file);
+        g_free (text_file);
+        g_free (binary_file);
+
+        return 0;
+}
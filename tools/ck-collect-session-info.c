@@ -27,292 +27,13 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <pwd.h>
-#include <errno.h>
 
 #include <glib.h>
 
-#include "ck-sysdeps.h"
-
-typedef struct {
-        uid_t    uid;
-        pid_t    pid;
-        char    *login_session_id;
-        char    *display_device;
-        char    *x11_display_device;
-        char    *x11_display;
-        gboolean x11_can_connect;
-        char    *remote_host_name;
-        gboolean is_local;
-        gboolean is_local_is_set;
-} SessionInfo;
-
-static void
-session_info_free (SessionInfo *si)
-{
-        g_free (si->login_session_id);
-        g_free (si->display_device);
-        g_free (si->x11_display_device);
-        g_free (si->x11_display);
-        g_free (si->remote_host_name);
-        g_free (si);
-}
-
-static void
-setuid_child_setup_func (SessionInfo *si)
-{
-        int            res;
-        struct passwd *pwent;
-
-        errno = 0;
-        pwent = getpwuid (si->uid);
-        if (pwent == NULL) {
-                g_warning ("Unable to lookup UID: %s", g_strerror (errno));
-                exit (1);
-        }
-
-        /* set the group */
-        errno = 0;
-        res = setgid (pwent->pw_gid);
-        if (res == -1) {
-                g_warning ("Error performing setgid: %s", g_strerror (errno));
-                exit (1);
-        }
-
-        /* become the user */
-        errno = 0;
-        res = setuid (si->uid);
-        if (res == -1) {
-                g_warning ("Error performing setuid: %s", g_strerror (errno));
-                exit (1);
-        }
-}
-
-static GPtrArray *
-get_filtered_environment (pid_t pid)
-{
-        GPtrArray  *env;
-        GHashTable *hash;
-        int         i;
-        static const char *allowed_env_vars [] = {
-                "DISPLAY",
-                "XAUTHORITY",
-                "XAUTHLOCALHOSTNAME",
-                "SSH_CLIENT",
-                "SSH_CONNECTION",
-                "SSH_TTY",
-                "HOME",
-        };
-
-        env = g_ptr_array_new ();
-
-        g_ptr_array_add (env, g_strdup ("PATH=/bin:/usr/bin"));
-
-        hash = ck_unix_pid_get_env_hash (pid);
-
-        for (i = 0; i < G_N_ELEMENTS (allowed_env_vars); i++) {
-                const char *var;
-                const char *val;
-                var = allowed_env_vars [i];
-                val = g_hash_table_lookup (hash, var);
-                if (val != NULL) {
-                        char *str;
-                        str = g_strdup_printf ("%s=%s", var, val);
-                        g_ptr_array_add (env, str);
-                }
-        }
-
-        g_ptr_array_add (env, NULL);
-
-        g_hash_table_destroy (hash);
-
-        return env;
-}
-
-static void
-get_x11_server_pid (SessionInfo *si,
-                    gboolean    *can_connect,
-                    guint       *pid)
-{
-        gboolean   res;
-        char      *err;
-        char      *out;
-        int        status;
-        int        i;
-        GError    *error;
-        guint      num;
-        char      *argv[4];
-        GPtrArray *env;
-
-        if (can_connect != NULL) {
-                *can_connect = FALSE;
-        }
-        if (pid != NULL) {
-                *pid = 0;
-        }
-
-        /* get the applicable environment */
-        env = get_filtered_environment (si->pid);
-
-        num = 0;
-
-        argv[0] = LIBEXECDIR "/ck-get-x11-server-pid";
-        argv[1] = NULL;
-
-        error = NULL;
-        out = NULL;
-        err = NULL;
-        status = -1;
-        res = g_spawn_sync (NULL,
-                            argv,
-                            (char **)env->pdata,
-                            0,
-                            (GSpawnChildSetupFunc)setuid_child_setup_func,
-                            si,
-                            &out,
-                            &err,
-                            &status,
-                            &error);
-        for (i = 0; i < env->len; i++) {
-                g_free (g_ptr_array_index (env, i));
-        }
-        g_ptr_array_free (env, TRUE);
-
-        if (error != NULL) {
-                g_warning ("Unable to PID for x11 server: %s", error->message);
-                g_error_free (error);
-        }
-
-        if (status == 0) {
-                if (res && out != NULL) {
-                        guint v;
-                        char  c;
-
-                        if (1 == sscanf (out, "%u %c", &v, &c)) {
-                                num = v;
-                        }
-                }
-
-                if (can_connect != NULL) {
-                        *can_connect = TRUE;
-                }
-        }
-
-
-        if (err != NULL && err[0] != '\0') {
-                g_warning ("%s", err);
-        }
-
-        if (pid != NULL) {
-                *pid = num;
-        }
-
-        g_free (out);
-        g_free (err);
-}
-
-/* Looking at the XFree86_VT property on the root window
- * doesn't work very well because it is difficult to
- * distinguish local from remote systems and the value
- * can't necessarily be trusted.  So instead we connect
- * to the server and use peer credentials to find the
- * local PID and then find its tty.
- */
-static void
-fill_x11_info (SessionInfo *si)
-{
-        guint          xorg_pid;
-        gboolean       can_connect;
-        gboolean       res;
-        CkProcessStat *xorg_stat;
-        GError        *error;
-
-        /* assume this is true then check it */
-        si->x11_display = ck_unix_pid_get_env (si->pid, "DISPLAY");
-
-        if (si->x11_display == NULL) {
-                /* no point continuing */
-                si->x11_can_connect = FALSE;
-                return;
-        }
-
-        xorg_pid = 0;
-        can_connect = FALSE;
-        get_x11_server_pid (si, &can_connect, &xorg_pid);
-
-        si->x11_can_connect = can_connect;
-        if (! can_connect) {
-                g_free (si->x11_display);
-                si->x11_display = NULL;
-                return;
-        }
-
-        if (xorg_pid < 2) {
-                /* keep the tty value */
-                /* if we can connect but don't have a pid
-                 * then we're not local */
-
-                si->is_local = FALSE;
-                si->is_local_is_set = TRUE;
-
-                /* FIXME: get the remote hostname */
-
-                return;
-        }
-
-        error = NULL;
-        res = ck_process_stat_new_for_unix_pid (xorg_pid, &xorg_stat, &error);
-        if (! res) {
-                if (error != NULL) {
-                        g_warning ("stat on pid %d failed: %s", xorg_pid, error->message);
-                        g_error_free (error);
-                }
-                /* keep the tty value */
-                return;
-        }
-
-        si->x11_display_device = ck_process_stat_get_tty (xorg_stat);
-        ck_process_stat_free (xorg_stat);
-
-        /* don't set is-local here - let the daemon do that */
-
-        g_free (si->remote_host_name);
-        si->remote_host_name = NULL;
-}
-
-static gboolean
-fill_session_info (SessionInfo *si)
-{
-        CkProcessStat *stat;
-        GError        *error;
-        gboolean       res;
-
-        error = NULL;
-        res = ck_process_stat_new_for_unix_pid (si->pid, &stat, &error);
-        if (! res) {
-                if (error != NULL) {
-                        g_warning ("stat on pid %d failed: %s", si->pid, error->message);
-                        g_error_free (error);
-                }
-
-                return FALSE;
-        }
-
-        si->display_device = ck_process_stat_get_tty (stat);
-        ck_process_stat_free (stat);
-
-        fill_x11_info (si);
-
-        res = ck_unix_pid_get_login_session_id (si->pid, &si->login_session_id);
-        if (! res) {
-                si->login_session_id = NULL;
-        }
-
-        return TRUE;
-}
+#include "ck-session-info.h"
 
 static void
-print_session_info (SessionInfo *si)
+print_session_info (CkSessionInfo *si)
 {
         printf ("unix-user = %u\n", si->uid);
         if (si->x11_display != NULL) {
@@ -339,20 +60,17 @@ static gboolean
 collect_session_info (uid_t uid,
                       pid_t pid)
 {
-        SessionInfo *si;
-        gboolean     ret;
-
-        si = g_new0 (SessionInfo, 1);
+        CkSessionInfo *si;
+        gboolean       ret;
 
-        si->uid = uid;
-        si->pid = pid;
+        si = ck_session_info_new (uid, pid);
 
-        ret = fill_session_info (si);
+        ret = ck_session_info_collect (si);
         if (ret) {
                 print_session_info (si);
         }
 
-        session_info_free (si);
+        ck_session_info_free (si);
 
         return ret;
 }
@@ -0,0 +1,217 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <locale.h>
+#include <zlib.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "ck-log-event.h"
+#include "ck-log-event-block.h"
+#include "ck-log-event-reader.h"
+
+/* Events per block when writing the binary format */
+#define BLOCK_EVENTS 256
+
+static gssize
+read_gzstream (gzFile  f,
+               char   *buf,
+               gsize   len)
+{
+        return gzread (f, buf, len);
+}
+
+static gboolean
+write_string (FILE    *out,
+              GString *str)
+{
+        if (str->len > 0 && fwrite (str->str, 1, str->len, out) != str->len) {
+                g_warning ("Unable to write output: %s", g_strerror (errno));
+                return FALSE;
+        }
+
+        g_string_truncate (str, 0);
+
+        return TRUE;
+}
+
+static gboolean
+flush_block (FILE      *out,
+             GString   *str,
+             GPtrArray *events)
+{
+        guint i;
+
+        ck_log_event_block_append (str,
+                                   (CkLogEvent **) events->pdata,
+                                   events->len);
+
+        for (i = 0; i < events->len; i++) {
+                ck_log_event_free (g_ptr_array_index (events, i));
+        }
+        g_ptr_array_set_size (events, 0);
+
+        return write_string (out, str);
+}
+
+static gboolean
+convert (CkLogEventReader *reader,
+         FILE             *out,
+         gboolean          to_binary,
+         guint            *n_events)
+{
+        CkLogEvent *event;
+        GPtrArray  *events;
+        GString    *str;
+        gboolean    ret;
+
+        ret = FALSE;
+        events = g_ptr_array_new ();
+        str = g_string_new (NULL);
+
+        while ((event = ck_log_event_reader_next (reader)) != NULL) {
+                (*n_events)++;
+
+                if (to_binary) {
+                        g_ptr_array_add (events, event);
+                        if (events->len >= BLOCK_EVENTS && ! flush_block (out, str, events)) {
+                                goto out;
+                        }
+                        continue;
+                }
+
+                ck_log_event_to_string (event, str);
+                g_string_append_c (str, '\n');
+                ck_log_event_free (event);
+
+                if (str->len >= 65536 && ! write_string (out, str)) {
+                        goto out;
+                }
+        }
+
+        if (to_binary) {
+                if (! flush_block (out, str, events)) {
+                        goto out;
+                }
+        } else if (! write_string (out, str)) {
+                goto out;
+        }
+
+        ret = TRUE;
+ out:
+        while (events->len > 0) {
+                ck_log_event_free (g_ptr_array_remove_index (events, events->len - 1));
+        }
+        g_ptr_array_free (events, TRUE);
+        g_string_free (str, TRUE);
+
+        return ret;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        GOptionContext     *context;
+        gboolean            retval;
+        GError             *error = NULL;
+        CkLogEventReader   *reader;
+        gzFile              in;
+        FILE               *out;
+        guint               n_events;
+        static gboolean     to_text = FALSE;
+        static char       **files = NULL;
+        static GOptionEntry entries [] = {
+                { "text", 't', 0, G_OPTION_ARG_NONE, &to_text, N_("Write the text format instead of the binary format"), NULL },
+                { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, N_("INPUT OUTPUT") },
+                { NULL }
+        };
+
+        setlocale (LC_ALL, "");
+
+        context = g_option_context_new (NULL);
+        g_option_context_set_summary (context, _("Converts a ConsoleKit history log between the text and binary formats.  The input may be in either format and may be compressed."));
+        g_option_context_add_main_entries (context, entries, NULL);
+        retval = g_option_context_parse (context, &argc, &argv, &error);
+
+        g_option_context_free (context);
+
+        if (! retval) {
+                g_warning ("%s", error->message);
+                g_error_free (error);
+                exit (1);
+        }
+
+        if (files == NULL || g_strv_length (files) != 2) {
+                g_warning ("An input and an output file must be given");
+                exit (1);
+        }
+
+        /* gzopen reads uncompressed files as they are */
+        in = gzopen (files[0], "r");
+        if (in == NULL) {
+                g_warning ("Error opening %s (%s)",
+                           files[0],
+                           g_strerror (errno));
+                exit (1);
+        }
+
+        if (strcmp (files[1], "-") == 0) {
+                out = stdout;
+        } else {
+                out = g_fopen (files[1], "w");
+                if (out == NULL) {
+                        g_warning ("Error opening %s (%s)",
+                                   files[1],
+                                   g_strerror (errno));
+                        exit (1);
+                }
+        }
+
+        n_events = 0;
+        reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_gzstream, in);
+        retval = convert (reader, out, ! to_text, &n_events);
+        ck_log_event_reader_free (reader);
+        gzclose (in);
+
+        if (fclose (out) != 0) {
+                g_warning ("Error closing %s (%s)",
+                           files[1],
+                           g_strerror (errno));
+                retval = FALSE;
+        }
+
+        if (! retval) {
+                exit (1);
+        }
+
+        g_debug ("Converted %u events", n_events);
+
+        return 0;
+}
@@ -0,0 +1,476 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* An index of a history file is kept in the log directory, or in the
+ * user's cache directory when the log directory isn't writable.
+ * Rotation renames files, so an index is named after the device and
+ * inode of its file rather than the file name, and is only trusted for
+ * the modification time and size it was taken of; an uncompressed file
+ * that has only grown keeps the index of what it had.  Compressing a
+ * rotated file makes a new one, leaving the old index behind to be
+ * removed by ck_history_index_remove_stale(). */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ck-history-index.h"
+
+#define INDEX_GROUP "History Index"
+
+CkHistoryIndex *
+ck_history_index_new (void)
+{
+        CkHistoryIndex *index;
+
+        index = g_new0 (CkHistoryIndex, 1);
+        index->marks = g_array_new (FALSE, FALSE, sizeof (CkHistoryIndexMark));
+
+        return index;
+}
+
+void
+ck_history_index_free (CkHistoryIndex *index)
+{
+        if (index == NULL) {
+                return;
+        }
+
+        g_array_free (index->marks, TRUE);
+        g_free (index);
+}
+
+static char *
+get_index_name (struct stat *st)
+{
+        return g_strdup_printf ("ck-history-%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT ".idx",
+                                (guint64) st->st_dev,
+                                (guint64) st->st_ino);
+}
+
+static char *
+get_cache_dir (void)
+{
+        return g_build_filename (g_get_user_cache_dir (), "ConsoleKit", "history", NULL);
+}
+
+static char *
+get_sidecar_path (const char  *filename,
+                  struct stat *st)
+{
+        char *dir;
+        char *name;
+        char *path;
+
+        dir = g_path_get_dirname (filename);
+        name = get_index_name (st);
+        path = g_build_filename (dir, name, NULL);
+        g_free (name);
+        g_free (dir);
+
+        return path;
+}
+
+static char *
+get_cache_path (struct stat *st)
+{
+        char *dir;
+        char *name;
+        char *path;
+
+        dir = get_cache_dir ();
+        name = get_index_name (st);
+        path = g_build_filename (dir, name, NULL);
+        g_free (name);
+        g_free (dir);
+
+        return path;
+}
+
+static gboolean
+get_uint64 (GKeyFile   *key_file,
+            const char *key,
+            guint64    *value)
+{
+        char *str;
+        char *end;
+
+        str = g_key_file_get_string (key_file, INDEX_GROUP, key, NULL);
+        if (str == NULL) {
+                return FALSE;
+        }
+
+        *value = g_ascii_strtoull (str, &end, 10);
+        if (end == str || *end != '\0') {
+                g_free (str);
+                return FALSE;
+        }
+
+        g_free (str);
+        return TRUE;
+}
+
+static void
+set_uint64 (GKeyFile   *key_file,
+            const char *key,
+            guint64     value)
+{
+        char *str;
+
+        str = g_strdup_printf ("%" G_GUINT64_FORMAT, value);
+        g_key_file_set_string (key_file, INDEX_GROUP, key, str);
+        g_free (str);
+}
+
+static CkHistoryIndex *
+load_index_file (const char  *path,
+                 struct stat *st,
+                 gboolean     compressed)
+{
+        GKeyFile       *key_file;
+        CkHistoryIndex *index;
+        char          **marks;
+        guint64         dev;
+        guint64         inode;
+        guint64         mtime;
+        guint64         size;
+        guint64         first;
+        guint64         last;
+        int             i;
+
+        index = NULL;
+        marks = NULL;
+
+        key_file = g_key_file_new ();
+        if (! g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL)) {
+                goto out;
+        }
+
+        if (! get_uint64 (key_file, "Device", &dev)
+            || ! get_uint64 (key_file, "Inode", &inode)
+            || ! get_uint64 (key_file, "MTime", &mtime)
+            || ! get_uint64 (key_file, "Size", &size)) {
+                goto out;
+        }
+
+        if (dev != (guint64) st->st_dev || inode != (guint64) st->st_ino) {
+                goto out;
+        }
+
+        index = ck_history_index_new ();
+        get_uint64 (key_file, "Indexed", &index->indexed);
+
+        if (mtime == (guint64) st->st_mtime
+            && size == (guint64) st->st_size
+            && (compressed || index->indexed == size)) {
+                index->complete = TRUE;
+        } else if (compressed || (guint64) st->st_size < index->indexed) {
+                /* rewritten, not appended to */
+                ck_history_index_free (index);
+                index = NULL;
+                goto out;
+        }
+
+        if (get_uint64 (key_file, "First", &first)
+            && get_uint64 (key_file, "Last", &last)) {
+                index->have_events = TRUE;
+                index->first = first;
+                index->last = last;
+        }
+
+        marks = g_key_file_get_string_list (key_file, INDEX_GROUP, "Marks", NULL, NULL);
+        for (i = 0; marks != NULL && marks[i] != NULL; i++) {
+                CkHistoryIndexMark mark;
+                char              *end;
+
+                mark.time = strtol (marks[i], &end, 10);
+                if (*end != ':') {
+                        break;
+                }
+                mark.offset = g_ascii_strtoull (end + 1, NULL, 10);
+                g_array_append_val (index->marks, mark);
+        }
+
+ out:
+        g_strfreev (marks);
+        g_key_file_free (key_file);
+
+        return index;
+}
+
+/**
+ * ck_history_index_load:
+ * @filename: a history file
+ *
+ * Returns: the index of @filename, or %NULL if there isn't one that
+ * still applies to it
+ */
+CkHistoryIndex *
+ck_history_index_load (const char *filename)
+{
+        CkHistoryIndex *index;
+        struct stat     st;
+        gboolean        compressed;
+        char           *path;
+
+        if (g_stat (filename, &st) != 0) {
+                return NULL;
+        }
+
+        compressed = g_str_has_suffix (filename, ".gz");
+
+        path = get_sidecar_path (filename, &st);
+        index = load_index_file (path, &st, compressed);
+        g_free (path);
+
+        if (index == NULL) {
+                path = get_cache_path (&st);
+                index = load_index_file (path, &st, compressed);
+                g_free (path);
+        }
+
+        return index;
+}
+
+/* Records the file as it is now, so the caller should have read it
+ * up to index->indexed first */
+gboolean
+ck_history_index_save (CkHistoryIndex *index,
+                       const char     *filename)
+{
+        GKeyFile   *key_file;
+        struct stat st;
+        char      **marks;
+        char       *data;
+        gsize       len;
+        char       *path;
+        char       *dir;
+        gboolean    ret;
+        guint       i;
+
+        g_return_val_if_fail (index != NULL, FALSE);
+
+        if (g_stat (filename, &st) != 0) {
+                return FALSE;
+        }
+
+        key_file = g_key_file_new ();
+        set_uint64 (key_file, "Device", st.st_dev);
+        set_uint64 (key_file, "Inode", st.st_ino);
+        set_uint64 (key_file, "MTime", st.st_mtime);
+        set_uint64 (key_file, "Size", st.st_size);
+        set_uint64 (key_file, "Indexed", index->indexed);
+        if (index->have_events) {
+                set_uint64 (key_file, "First", index->first);
+                set_uint64 (key_file, "Last", index->last);
+        }
+
+        if (index->marks->len > 0) {
+                marks = g_new0 (char *, index->marks->len + 1);
+                for (i = 0; i < index->marks->len; i++) {
+                        CkHistoryIndexMark *mark;
+
+                        mark = &g_array_index (index->marks, CkHistoryIndexMark, i);
+                        marks[i] = g_strdup_printf ("%ld:%" G_GUINT64_FORMAT,
+                                                    mark->time,
+                                                    mark->offset);
+                }
+                g_key_file_set_string_list (key_file,
+                                            INDEX_GROUP,
+                                            "Marks",
+                                            (const char * const *) marks,
+                                            index->marks->len);
+                g_strfreev (marks);
+        }
+
+        data = g_key_file_to_data (key_file, &len, NULL);
+        g_key_file_free (key_file);
+
+        path = get_sidecar_path (filename, &st);
+        ret = g_file_set_contents (path, data, len, NULL);
+        g_free (path);
+
+        if (! ret) {
+                path = get_cache_path (&st);
+                dir = g_path_get_dirname (path);
+                if (g_mkdir_with_parents (dir, 0700) == 0) {
+                        ret = g_file_set_contents (path, data, len, NULL);
+                }
+                if (! ret) {
+                        g_debug ("Unable to save history index %s", path);
+                }
+                g_free (dir);
+                g_free (path);
+        }
+
+        g_free (data);
+
+        return ret;
+}
+
+static void
+remove_stale_in_dir (const char *dir,
+                     GHashTable *names)
+{
+        GDir       *d;
+        const char *name;
+
+        d = g_dir_open (dir, 0, NULL);
+        if (d == NULL) {
+                return;
+        }
+
+        while ((name = g_dir_read_name (d)) != NULL) {
+                char *path;
+
+                if (! g_str_has_suffix (name, ".idx")
+                    || g_hash_table_lookup (names, name) != NULL) {
+                        continue;
+                }
+
+                path = g_build_filename (dir, name, NULL);
+                if (g_unlink (path) == 0) {
+                        g_debug ("Removed stale history index %s", path);
+                }
+                g_free (path);
+        }
+
+        g_dir_close (d);
+}
+
+/**
+ * ck_history_index_remove_stale:
+ * @filenames: every history file there is now
+ *
+ * Removes the indexes, in the log directory and the cache, that
+ * belong to none of @filenames, such as those of files rotated away or
+ * replaced by a compressed copy.
+ */
+void
+ck_history_index_remove_stale (GList *filenames)
+{
+        GHashTable *names;
+        GList      *l;
+        char       *dir;
+
+        if (filenames == NULL) {
+                return;
+        }
+
+        names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        for (l = filenames; l != NULL; l = l->next) {
+                struct stat st;
+
+                if (g_stat (l->data, &st) == 0) {
+                        g_hash_table_insert (names, get_index_name (&st), GINT_TO_POINTER (TRUE));
+                }
+        }
+
+        dir = g_path_get_dirname (filenames->data);
+        remove_stale_in_dir (dir, names);
+        g_free (dir);
+
+        dir = get_cache_dir ();
+        remove_stale_in_dir (dir, names);
+        g_free (dir);
+
+        g_hash_table_destroy (names);
+}
+
+void
+ck_history_index_add_time (CkHistoryIndex *index,
+                           glong           time)
+{
+        g_return_if_fail (index != NULL);
+
+        if (! index->have_events) {
+                index->have_events = TRUE;
+                index->first = time;
+                index->last = time;
+        } else {
+                index->first = MIN (index->first, time);
+                index->last = MAX (index->last, time);
+        }
+}
+
+/* Remembers @offset if it is far enough past the last mark and past
+ * what was already indexed */
+void
+ck_history_index_add_mark (CkHistoryIndex *index,
+                           guint64         offset,
+                           glong           time)
+{
+        CkHistoryIndexMark mark;
+
+        g_return_if_fail (index != NULL);
+
+        if (offset < index->indexed) {
+                return;
+        }
+
+        if (index->marks->len > 0) {
+                CkHistoryIndexMark *last;
+
+                last = &g_array_index (index->marks, CkHistoryIndexMark, index->marks->len - 1);
+                if (offset < last->offset + CK_HISTORY_INDEX_MARK_INTERVAL) {
+                        return;
+                }
+        }
+
+        mark.time = time;
+        mark.offset = offset;
+        g_array_append_val (index->marks, mark);
+}
+
+/**
+ * ck_history_index_lookup:
+ * @index: a #CkHistoryIndex
+ * @since: a time
+ *
+ * Returns: an offset to start reading at to find every event from
+ * @since on
+ */
+guint64
+ck_history_index_lookup (CkHistoryIndex *index,
+                         glong           since)
+{
+        guint64 offset;
+        guint   i;
+
+        g_return_val_if_fail (index != NULL, 0);
+
+        offset = 0;
+        for (i = 0; i < index->marks->len; i++) {
+                CkHistoryIndexMark *mark;
+
+                mark = &g_array_index (index->marks, CkHistoryIndexMark, i);
+                if (mark->time >= since) {
+                        break;
+                }
+                offset = mark->offset;
+        }
+
+        return offset;
+}
@@ -0,0 +1,70 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __CK_HISTORY_INDEX_H
+#define __CK_HISTORY_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Bytes of history between the offsets remembered in an index */
+#define CK_HISTORY_INDEX_MARK_INTERVAL (256 * 1024)
+
+typedef struct
+{
+        glong    time;
+        guint64  offset;
+} CkHistoryIndexMark;
+
+typedef struct
+{
+        /* TRUE if the file hasn't changed since it was indexed;
+         * otherwise it has only been appended to */
+        gboolean complete;
+
+        gboolean have_events;
+        glong    first;
+        glong    last;
+
+        /* bytes of the file covered, and where to start reading for
+         * a time; only kept for uncompressed files */
+        guint64  indexed;
+        GArray  *marks;
+} CkHistoryIndex;
+
+CkHistoryIndex     * ck_history_index_new          (void);
+void                 ck_history_index_free         (CkHistoryIndex *index);
+
+CkHistoryIndex     * ck_history_index_load         (const char     *filename);
+gboolean             ck_history_index_save         (CkHistoryIndex *index,
+                                                    const char     *filename);
+void                 ck_history_index_remove_stale (GList          *filenames);
+
+void                 ck_history_index_add_time     (CkHistoryIndex *index,
+                                                    glong           time);
+void                 ck_history_index_add_mark     (CkHistoryIndex *index,
+                                                    guint64         offset,
+                                                    glong           time);
+guint64              ck_history_index_lookup       (CkHistoryIndex *index,
+                                                    glong           since);
+
+G_END_DECLS
+
+#endif /* __CK_HISTORY_INDEX_H */
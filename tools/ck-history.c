@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <string.h>
@@ -37,6 +38,8 @@
 #include <glib/gstdio.h>
 
 #include "ck-log-event.h"
+#include "ck-log-event-reader.h"
+#include "ck-history-index.h"
 
 typedef enum {
         REPORT_TYPE_SUMMARY = 0,
@@ -58,129 +61,197 @@ typedef enum {
 } RecordStatus;
 
 #define DEFAULT_LOG_FILENAME LOCALSTATEDIR "/log/ConsoleKit/history"
-#define MAX_LINE_LEN 2048
 
 static GList *all_events = NULL;
 
-static CkLogEvent *
-parse_event_line (const char *line)
+static gssize
+read_gzstream (gzFile  f,
+               char   *buf,
+               gsize   len)
 {
-        GString    *str;
-        CkLogEvent *event;
-
-        str = g_string_new (line);
-        event = ck_log_event_new_from_string (str);
-        g_string_free (str, TRUE);
-
-        return event;
+        return gzread (f, buf, len);
 }
 
-static gboolean
-process_log_gzstream (gzFile   *fstream,
-                      GTimeVal *since)
+static gssize
+read_stream (FILE  *f,
+             char  *buf,
+             gsize  len)
 {
-        char     line[MAX_LINE_LEN];
-        gboolean hit_since;
-        GList   *events;
+        size_t n;
 
-        events = NULL;
-        hit_since = FALSE;
-        while (gzgets (fstream, line, sizeof (line)) != Z_NULL) {
-                CkLogEvent *event;
+        n = fread (buf, 1, len, f);
+        if (n == 0 && ferror (f)) {
+                return -1;
+        }
 
-                if (strlen (line) == sizeof (line) - 1) {
-                        g_warning ("Log line truncated");
-                }
+        return n;
+}
 
-                event = parse_event_line (line);
-                if (event == NULL) {
-                        continue;
-                }
+typedef struct {
+        FILE    *f;
+        guint64  remaining;
+} LimitedStream;
+
+static gssize
+read_limited_stream (LimitedStream *stream,
+                     char          *buf,
+                     gsize          len)
+{
+        gssize n;
 
-                if (since == NULL || event->timestamp.tv_sec >= since->tv_sec) {
-                        events = g_list_prepend (events, event);
-                } else {
-                        hit_since = TRUE;
-                }
+        if (len > stream->remaining) {
+                len = stream->remaining;
         }
 
-        all_events = g_list_concat (all_events, events);
+        n = read_stream (stream->f, buf, len);
+        if (n > 0) {
+                stream->remaining -= n;
+        }
 
-        return !hit_since;
+        return n;
 }
 
+/* Reads the events in the first @limit bytes of a file, in either
+ * format, onto @events oldest first.  Stops early once @cancelled is
+ * set from another thread.
+ *
+ * Whole files are indexed as they are read, so that later queries
+ * can skip files older than @since and seek past the start of an
+ * uncompressed one. */
 static gboolean
-process_log_stream (FILE     *fstream,
-                    GTimeVal *since)
+load_events (const char    *filename,
+             guint64        limit,
+             GTimeVal      *since,
+             volatile gint *cancelled,
+             GPtrArray     *events,
+             gboolean      *hit_since)
 {
-        char     line[MAX_LINE_LEN];
-        gboolean hit_since;
-        GList   *events;
-
-        events = NULL;
-        hit_since = FALSE;
-        while (fgets (line, sizeof (line), fstream) != NULL) {
-                CkLogEvent *event;
-
-                if (strlen (line) == sizeof (line) - 1) {
-                        g_warning ("Log line truncated");
+        CkLogEventReader *reader;
+        CkLogEvent       *event;
+        CkHistoryIndex   *index;
+        gboolean          compressed;
+        gboolean          update_index;
+        guint64           start;
+        gzFile            gz;
+        LimitedStream     stream;
+
+        *hit_since = FALSE;
+        compressed = g_str_has_suffix (filename, ".gz");
+        index = NULL;
+        update_index = FALSE;
+        start = 0;
+
+        if (limit == G_MAXUINT64) {
+                index = ck_history_index_load (filename);
+                if (index != NULL && index->complete && since != NULL) {
+                        if (! index->have_events) {
+                                ck_history_index_free (index);
+                                return TRUE;
+                        }
+                        if (index->last < since->tv_sec) {
+                                *hit_since = TRUE;
+                                ck_history_index_free (index);
+                                return TRUE;
+                        }
                 }
 
-                event = parse_event_line (line);
-                if (event == NULL) {
-                        continue;
+                if (index == NULL) {
+                        index = ck_history_index_new ();
                 }
+                update_index = ! index->complete;
 
-                if (since == NULL || event->timestamp.tv_sec >= since->tv_sec) {
-                        events = g_list_prepend (events, event);
-                } else {
-                        hit_since = TRUE;
+                if (since != NULL) {
+                        start = ck_history_index_lookup (index, since->tv_sec);
                 }
         }
 
-        all_events = g_list_concat (all_events, events);
-
-        return !hit_since;
-}
-
-static gboolean
-process_log_file (const char *filename,
-                  GTimeVal   *since)
-{
-        gboolean ret;
-
-        if (g_str_has_suffix (filename, ".gz")) {
-                gzFile *f;
-                f = gzopen (filename, "r");
-                if (f == NULL) {
-                        int         errnum;
-                        const char *errmsg;
-                        errmsg = gzerror (f, &errnum);
-                        if (errnum == Z_ERRNO) {
-                                errmsg = g_strerror (errno);
-                        }
+        gz = NULL;
+        stream.f = NULL;
+        if (compressed) {
+                gz = gzopen (filename, "r");
+                if (gz == NULL) {
                         g_warning ("Error opening %s (%s)\n",
                                    filename,
-                                   errmsg);
+                                   g_strerror (errno));
+                        ck_history_index_free (index);
                         return FALSE;
                 }
-                ret = process_log_gzstream (f, since);
-                gzclose (f);
+                reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_gzstream, gz);
         } else {
-                FILE    *f;
-
-                f = g_fopen (filename, "r");
-                if (f == NULL) {
+                stream.f = g_fopen (filename, "r");
+                if (stream.f == NULL) {
                         g_warning ("Error opening %s (%s)\n",
                                    filename,
                                    g_strerror (errno));
+                        ck_history_index_free (index);
                         return FALSE;
                 }
-                ret = process_log_stream (f, since);
-                fclose (f);
+                if (start > 0 && fseeko (stream.f, start, SEEK_SET) != 0) {
+                        start = 0;
+                }
+                stream.remaining = limit - start;
+                reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_limited_stream, &stream);
         }
 
-        return ret;
+        /* the index needs the times of the old events too */
+        if (! update_index) {
+                ck_log_event_reader_set_since (reader, since);
+        }
+
+        while (cancelled == NULL || ! g_atomic_int_get (cancelled)) {
+                guint64 offset;
+
+                offset = start + ck_log_event_reader_tell (reader);
+                event = ck_log_event_reader_next (reader);
+                if (event == NULL) {
+                        break;
+                }
+
+                if (update_index) {
+                        ck_history_index_add_time (index, event->timestamp.tv_sec);
+                        if (! compressed) {
+                                ck_history_index_add_mark (index, offset, event->timestamp.tv_sec);
+                        }
+
+                        if (since != NULL && event->timestamp.tv_sec < since->tv_sec) {
+                                *hit_since = TRUE;
+                                ck_log_event_free (event);
+                                continue;
+                        }
+                }
+
+                g_ptr_array_add (events, event);
+        }
+
+        if (update_index) {
+                if (cancelled == NULL || ! g_atomic_int_get (cancelled)) {
+                        index->indexed = start + ck_log_event_reader_tell (reader);
+                        ck_history_index_save (index, filename);
+                }
+        } else {
+                *hit_since = ck_log_event_reader_hit_since (reader);
+        }
+
+        ck_history_index_free (index);
+        ck_log_event_reader_free (reader);
+        if (gz != NULL) {
+                gzclose (gz);
+        } else {
+                fclose (stream.f);
+        }
+
+        return TRUE;
+}
+
+static void
+free_event_array (GPtrArray *events)
+{
+        guint i;
+
+        for (i = 0; i < events->len; i++) {
+                ck_log_event_free (g_ptr_array_index (events, i));
+        }
+        g_ptr_array_free (events, TRUE);
 }
 
 static GList *
@@ -219,109 +290,645 @@ get_log_file_list (void)
         return files;
 }
 
-static gboolean
-process_logs (GTimeVal *since)
+/* Files are read and parsed on a pool of threads, one per processor,
+ * at most that many files ahead of the one being reported on.  Jobs
+ * are waited for in file order, so events still come out in order. */
+
+typedef struct {
+        const char *filename;
+        GPtrArray  *events;
+        gboolean    hit_since;
+        gboolean    ok;
+        gboolean    finished;
+} LoadJob;
+
+typedef struct {
+        GThreadPool   *pool;
+        GMutex        *lock;
+        GCond         *cond;
+        guint          n_threads;
+        gboolean       use_since;
+        GTimeVal       since;
+        volatile gint  cancelled;
+} Loader;
+
+static void
+load_job_free (LoadJob *job)
 {
-        gboolean ret;
-        GList   *files;
-        GList   *l;
+        if (job->events != NULL) {
+                free_event_array (job->events);
+        }
+        g_free (job);
+}
 
-        ret = FALSE;
+static void
+loader_run_job (LoadJob *job,
+                Loader  *loader)
+{
+        GPtrArray *events;
+        gboolean   hit_since;
+        gboolean   ok;
 
-        files = get_log_file_list ();
+        events = g_ptr_array_new ();
+        hit_since = FALSE;
+        ok = load_events (job->filename,
+                          G_MAXUINT64,
+                          loader->use_since ? &loader->since : NULL,
+                          &loader->cancelled,
+                          events,
+                          &hit_since);
+
+        g_mutex_lock (loader->lock);
+        job->events = events;
+        job->hit_since = hit_since;
+        job->ok = ok;
+        job->finished = TRUE;
+        g_cond_broadcast (loader->cond);
+        g_mutex_unlock (loader->lock);
+}
+
+static guint
+get_n_processors (void)
+{
+        long n;
 
-        for (l = files; l != NULL; l = l->next) {
-                gboolean res;
-                char    *filename;
+        n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+        n = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
 
-                filename = l->data;
-                res = process_log_file (filename, since);
-                if (! res) {
-                        goto out;
+        return n > 0 ? n : 1;
+}
+
+static Loader *
+loader_new (GTimeVal *since)
+{
+        Loader *loader;
+        GError *error;
+
+        loader = g_new0 (Loader, 1);
+        loader->n_threads = get_n_processors ();
+        loader->lock = g_mutex_new ();
+        loader->cond = g_cond_new ();
+
+        if (since != NULL) {
+                loader->use_since = TRUE;
+                loader->since = *since;
+        }
+
+        error = NULL;
+        loader->pool = g_thread_pool_new ((GFunc) loader_run_job,
+                                          loader,
+                                          loader->n_threads,
+                                          FALSE,
+                                          &error);
+        if (loader->pool == NULL) {
+                g_warning ("Unable to start reader threads: %s", error->message);
+                g_error_free (error);
+        }
+
+        return loader;
+}
+
+/* Jobs not started yet are dropped; their owners still free them */
+static void
+loader_free (Loader *loader)
+{
+        g_atomic_int_set (&loader->cancelled, TRUE);
+        if (loader->pool != NULL) {
+                g_thread_pool_free (loader->pool, TRUE, TRUE);
+        }
+        g_cond_free (loader->cond);
+        g_mutex_free (loader->lock);
+        g_free (loader);
+}
+
+/* Without a pool the file is read before returning */
+static LoadJob *
+loader_queue (Loader     *loader,
+              const char *filename)
+{
+        LoadJob *job;
+
+        job = g_new0 (LoadJob, 1);
+        job->filename = filename;
+
+        if (loader->pool != NULL) {
+                g_thread_pool_push (loader->pool, job, NULL);
+        } else {
+                loader_run_job (job, loader);
+        }
+
+        return job;
+}
+
+static void
+loader_wait (Loader  *loader,
+             LoadJob *job)
+{
+        g_mutex_lock (loader->lock);
+        while (! job->finished) {
+                g_cond_wait (loader->cond, loader->lock);
+        }
+        g_mutex_unlock (loader->lock);
+}
+
+/* The last and frequent reports walk the history from the newest
+ * event back, so they can stop as soon as --since or --limit is
+ * reached without reading the rest of the files. */
+
+#define BACKWARD_CHUNK_SIZE 65536
+
+#define EVENT_MASK(type) (1 << (type))
+
+typedef struct {
+        GList     *files;       /* newest first */
+        GList     *file;        /* the file being read */
+        guint      mask;        /* the event types to parse */
+        gboolean   use_since;
+        GTimeVal   since;
+        gboolean   done;
+
+        /* plain files are read backwards, a chunk at a time; buf
+         * holds the unread bytes just before the file offset */
+        int        fd;
+        off_t      offset;
+        GString   *buf;
+
+        /* compressed files, and plain files with binary records in
+         * them, are read forwards and handed out from the end */
+        GPtrArray *loaded;
+        gboolean   loaded_hit_since;
+
+        /* compressed files are read ahead on the loader's threads,
+         * starting from the first one reached */
+        Loader    *loader;
+        GQueue    *jobs;
+        GList     *prefetch;    /* the next file to queue */
+        gboolean   prefetching;
+
+        gboolean   have_oldest;
+        GTimeVal   oldest;
+} HistoryCursor;
+
+static HistoryCursor *
+history_cursor_new (GList    *files,
+                    guint     mask,
+                    GTimeVal *since)
+{
+        HistoryCursor *cursor;
+
+        cursor = g_new0 (HistoryCursor, 1);
+        cursor->files = files;
+        cursor->file = files;
+        cursor->mask = mask;
+        cursor->fd = -1;
+        cursor->buf = g_string_new (NULL);
+        cursor->loader = loader_new (since);
+        cursor->jobs = g_queue_new ();
+
+        if (since != NULL) {
+                cursor->use_since = TRUE;
+                cursor->since = *since;
+        }
+
+        return cursor;
+}
+
+static void
+history_cursor_close_file (HistoryCursor *cursor)
+{
+        if (cursor->fd != -1) {
+                close (cursor->fd);
+                cursor->fd = -1;
+        }
+        g_string_truncate (cursor->buf, 0);
+
+        if (cursor->loaded != NULL) {
+                free_event_array (cursor->loaded);
+                cursor->loaded = NULL;
+        }
+}
+
+static void
+history_cursor_free (HistoryCursor *cursor)
+{
+        LoadJob *job;
+
+        /* wait for the threads before freeing their jobs */
+        loader_free (cursor->loader);
+        while ((job = g_queue_pop_head (cursor->jobs)) != NULL) {
+                load_job_free (job);
+        }
+        g_queue_free (cursor->jobs);
+
+        history_cursor_close_file (cursor);
+        g_string_free (cursor->buf, TRUE);
+        g_free (cursor);
+}
+
+static void
+history_cursor_prefetch (HistoryCursor *cursor)
+{
+        const char *filename;
+
+        while (cursor->prefetch != NULL
+               && g_queue_get_length (cursor->jobs) < cursor->loader->n_threads) {
+                filename = cursor->prefetch->data;
+                if (g_str_has_suffix (filename, ".gz")) {
+                        g_queue_push_tail (cursor->jobs, loader_queue (cursor->loader, filename));
                 }
+                cursor->prefetch = cursor->prefetch->next;
         }
+}
 
-        ret = TRUE;
+static gboolean
+history_cursor_open_compressed_file (HistoryCursor *cursor)
+{
+        LoadJob *job;
+        gboolean ok;
 
- out:
-        g_list_foreach (files, (GFunc)g_free, NULL);
-        g_list_free (files);
+        if (! cursor->prefetching) {
+                cursor->prefetch = cursor->file;
+                cursor->prefetching = TRUE;
+        }
+        history_cursor_prefetch (cursor);
 
-        return ret;
+        job = g_queue_pop_head (cursor->jobs);
+        g_assert (job != NULL && job->filename == cursor->file->data);
+
+        loader_wait (cursor->loader, job);
+        ok = job->ok;
+        cursor->loaded = job->events;
+        cursor->loaded_hit_since = job->hit_since;
+        job->events = NULL;
+        load_job_free (job);
+
+        history_cursor_prefetch (cursor);
+
+        return ok;
+}
+
+static gboolean
+history_cursor_open_file (HistoryCursor *cursor)
+{
+        const char *filename;
+
+        filename = cursor->file->data;
+
+        if (g_str_has_suffix (filename, ".gz")) {
+                return history_cursor_open_compressed_file (cursor);
+        }
+
+        cursor->fd = g_open (filename, O_RDONLY, 0);
+        if (cursor->fd == -1) {
+                g_warning ("Error opening %s (%s)\n",
+                           filename,
+                           g_strerror (errno));
+                return FALSE;
+        }
+
+        cursor->offset = lseek (cursor->fd, 0, SEEK_END);
+        if (cursor->offset == (off_t) -1) {
+                g_warning ("Error reading %s (%s)\n",
+                           filename,
+                           g_strerror (errno));
+                close (cursor->fd);
+                cursor->fd = -1;
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/* Returns the last unread line of the current file, or NULL once the
+ * start of the file is reached or a binary record is found, in which
+ * case @binary is set and nothing before it has been consumed */
+static GString *
+history_cursor_read_line_backward (HistoryCursor *cursor,
+                                   gboolean      *binary)
+{
+        GString *line;
+        char    *chunk;
+        gsize    i;
+        gsize    n;
+
+        *binary = FALSE;
+
+        while (TRUE) {
+                /* drop the newline ending the last line */
+                while (cursor->buf->len > 0 && cursor->buf->str[cursor->buf->len - 1] == '\n') {
+                        g_string_truncate (cursor->buf, cursor->buf->len - 1);
+                }
+
+                for (i = cursor->buf->len; i > 0; i--) {
+                        if (cursor->buf->str[i - 1] == '\n') {
+                                line = g_string_new_len (cursor->buf->str + i, cursor->buf->len - i);
+                                g_string_truncate (cursor->buf, i - 1);
+                                return line;
+                        }
+                }
+
+                if (cursor->offset == 0) {
+                        if (cursor->buf->len == 0) {
+                                return NULL;
+                        }
+                        line = g_string_new_len (cursor->buf->str, cursor->buf->len);
+                        g_string_truncate (cursor->buf, 0);
+                        return line;
+                }
+
+                n = MIN (BACKWARD_CHUNK_SIZE, cursor->offset);
+                chunk = g_malloc (n);
+                if (pread (cursor->fd, chunk, n, cursor->offset - n) != (gssize) n) {
+                        g_warning ("Error reading %s (%s)\n",
+                                   (char *) cursor->file->data,
+                                   g_strerror (errno));
+                        g_free (chunk);
+                        return NULL;
+                }
+
+                if (memchr (chunk, '\0', n) != NULL) {
+                        *binary = TRUE;
+                        g_free (chunk);
+                        return NULL;
+                }
+
+                cursor->offset -= n;
+                g_string_prepend_len (cursor->buf, chunk, n);
+                g_free (chunk);
+        }
 }
 
 static void
-generate_report_summary (int         uid,
-                         const char *seat,
-                         const char *session_type)
+history_cursor_note_time (HistoryCursor  *cursor,
+                          const GTimeVal *timestamp)
 {
+        cursor->have_oldest = TRUE;
+        cursor->oldest = *timestamp;
 }
 
+static void
+history_cursor_next_file (HistoryCursor *cursor)
+{
+        history_cursor_close_file (cursor);
+
+        cursor->file = cursor->file->next;
+        if (cursor->file == NULL) {
+                cursor->done = TRUE;
+        }
+}
+
+/* Returns the next older event of one of the wanted types, or NULL
+ * once the history or the --since time has been reached.  Other
+ * events are only parsed as far as their type and time. */
 static CkLogEvent *
-find_first_matching_remove_event (GList                      *events,
-                                  CkLogSeatSessionAddedEvent *event)
+history_cursor_next (HistoryCursor *cursor)
 {
-        CkLogEvent *revent;
-        GList      *l;
+        CkLogEvent     *event;
+        CkLogEventType  type;
+        GTimeVal        timestamp;
+        GString        *line;
+        gboolean        binary;
+
+        while (! cursor->done && cursor->file != NULL) {
+                if (cursor->loaded != NULL) {
+                        if (cursor->loaded->len == 0) {
+                                if (cursor->loaded_hit_since) {
+                                        cursor->done = TRUE;
+                                } else {
+                                        history_cursor_next_file (cursor);
+                                }
+                                continue;
+                        }
+
+                        event = g_ptr_array_remove_index (cursor->loaded, cursor->loaded->len - 1);
+                        history_cursor_note_time (cursor, &event->timestamp);
+                        if ((cursor->mask & EVENT_MASK (event->type)) == 0) {
+                                ck_log_event_free (event);
+                                continue;
+                        }
 
-        revent = NULL;
+                        return event;
+                }
 
-        for (l = events; l != NULL; l = l->next) {
-                CkLogEventType etype;
+                if (cursor->fd == -1) {
+                        if (! history_cursor_open_file (cursor)) {
+                                cursor->done = TRUE;
+                        }
+                        continue;
+                }
 
-                etype = ((CkLogEvent *)l->data)->type;
-                /* skip all non removal events */
-                if (! (etype == CK_LOG_EVENT_SEAT_SESSION_REMOVED
-                       || etype == CK_LOG_EVENT_SYSTEM_START
-                       || etype == CK_LOG_EVENT_SYSTEM_STOP
-                       || etype == CK_LOG_EVENT_SYSTEM_RESTART)) {
+                line = history_cursor_read_line_backward (cursor, &binary);
+                if (binary) {
+                        guint64 limit;
+
+                        limit = cursor->offset + cursor->buf->len;
+                        close (cursor->fd);
+                        cursor->fd = -1;
+                        g_string_truncate (cursor->buf, 0);
+
+                        cursor->loaded = g_ptr_array_new ();
+                        if (! load_events (cursor->file->data,
+                                           limit,
+                                           cursor->use_since ? &cursor->since : NULL,
+                                           NULL,
+                                           cursor->loaded,
+                                           &cursor->loaded_hit_since)) {
+                                cursor->done = TRUE;
+                        }
                         continue;
                 }
 
-                if (etype == CK_LOG_EVENT_SEAT_SESSION_REMOVED) {
-                        CkLogSeatSessionRemovedEvent *e;
-                        e = l->data;
+                if (line == NULL) {
+                        history_cursor_next_file (cursor);
+                        continue;
+                }
 
-                        if (e->session_id != NULL
-                            && event->session_id != NULL
-                            && strcmp (e->session_id, event->session_id) == 0) {
-                                revent = (CkLogEvent *)l->data;
-                                break;
-                        }
-                } else {
-                        revent = (CkLogEvent *)l->data;
+                if (! ck_log_event_parse_header (line, &type, &timestamp)) {
+                        g_string_free (line, TRUE);
+                        continue;
+                }
+
+                if (cursor->use_since && timestamp.tv_sec < cursor->since.tv_sec) {
+                        g_string_free (line, TRUE);
+                        cursor->done = TRUE;
                         break;
                 }
+
+                history_cursor_note_time (cursor, &timestamp);
+                if ((cursor->mask & EVENT_MASK (type)) == 0) {
+                        g_string_free (line, TRUE);
+                        continue;
+                }
+
+                event = ck_log_event_new_from_string (line);
+                g_string_free (line, TRUE);
+                if (event != NULL) {
+                        return event;
+                }
         }
 
-        return revent;
+        return NULL;
 }
 
-static CkLogEvent *
-find_first_matching_system_stop_event (GList                      *events,
-                                       CkLogSeatSessionAddedEvent *event)
+/* Finds the time of the oldest event from --since on, reading
+ * forwards from the oldest file.  Files whose index shows nothing
+ * from --since on are skipped, and an uncompressed file is read from
+ * the indexed offset nearest before --since. */
+static gboolean
+find_log_begin (GList    *files,
+                GTimeVal *since,
+                GTimeVal *begin)
 {
-        CkLogEvent *revent;
-        GList      *l;
+        GList   *l;
+        gboolean found;
+
+        found = FALSE;
+        for (l = g_list_last (files); l != NULL && ! found; l = l->prev) {
+                CkLogEventReader *reader;
+                CkLogEvent       *event;
+                CkHistoryIndex   *index;
+                guint64           start;
+                gzFile            f;
+
+                start = 0;
+                if (since != NULL) {
+                        index = ck_history_index_load (l->data);
+                        if (index != NULL) {
+                                if (index->complete
+                                    && (! index->have_events || index->last < since->tv_sec)) {
+                                        ck_history_index_free (index);
+                                        continue;
+                                }
+                                if (! g_str_has_suffix (l->data, ".gz")) {
+                                        start = ck_history_index_lookup (index, since->tv_sec);
+                                }
+                                ck_history_index_free (index);
+                        }
+                }
 
-        revent = NULL;
+                /* gzopen reads uncompressed files as they are */
+                f = gzopen (l->data, "r");
+                if (f == NULL) {
+                        continue;
+                }
+
+                if (start > 0 && gzseek (f, start, SEEK_SET) == -1) {
+                        gzrewind (f);
+                }
 
-        for (l = events; l != NULL; l = l->next) {
-                CkLogEventType etype;
+                reader = ck_log_event_reader_new ((CkLogEventReadFunc) read_gzstream, f);
+                ck_log_event_reader_set_since (reader, since);
+                event = ck_log_event_reader_next (reader);
+                if (event != NULL) {
+                        *begin = event->timestamp;
+                        found = TRUE;
+                        ck_log_event_free (event);
+                }
+                ck_log_event_reader_free (reader);
+                gzclose (f);
+        }
 
-                etype = ((CkLogEvent *)l->data)->type;
+        return found;
+}
 
-                /* skip all non removal events */
-                if (! (etype == CK_LOG_EVENT_SYSTEM_STOP
-                       || etype == CK_LOG_EVENT_SYSTEM_RESTART)) {
-                        continue;
+static gboolean
+process_logs (GTimeVal *since)
+{
+        gboolean  ret;
+        GList    *files;
+        GList    *next;
+        Loader   *loader;
+        GQueue   *jobs;
+        LoadJob  *job;
+
+        ret = FALSE;
+
+        files = get_log_file_list ();
+        loader = loader_new (since);
+        jobs = g_queue_new ();
+
+        next = files;
+        while (TRUE) {
+                GList   *events;
+                gboolean hit_since;
+                guint    i;
+
+                while (next != NULL && g_queue_get_length (jobs) < loader->n_threads) {
+                        g_queue_push_tail (jobs, loader_queue (loader, next->data));
+                        next = next->next;
                 }
 
-                revent = (CkLogEvent *)l->data;
-                break;
+                job = g_queue_pop_head (jobs);
+                if (job == NULL) {
+                        break;
+                }
+
+                loader_wait (loader, job);
+                if (! job->ok) {
+                        load_job_free (job);
+                        goto out;
+                }
+
+                /* all_events is newest first until the report starts */
+                events = NULL;
+                for (i = 0; i < job->events->len; i++) {
+                        events = g_list_prepend (events, g_ptr_array_index (job->events, i));
+                }
+                all_events = g_list_concat (all_events, events);
+                g_ptr_array_set_size (job->events, 0);
+
+                hit_since = job->hit_since;
+                load_job_free (job);
+                if (hit_since) {
+                        goto out;
+                }
+        }
+
+        ret = TRUE;
+
+ out:
+        loader_free (loader);
+        while ((job = g_queue_pop_head (jobs)) != NULL) {
+                load_job_free (job);
+        }
+        g_queue_free (jobs);
+
+        ck_history_index_remove_stale (files);
+
+        g_list_foreach (files, (GFunc)g_free, NULL);
+        g_list_free (files);
+
+        return ret;
+}
+
+static void
+generate_report_summary (int         uid,
+                         const char *seat,
+                         const char *session_type)
+{
+}
+
+static gboolean
+session_matches (CkLogSeatSessionAddedEvent *e,
+                 int                         uid,
+                 const char                 *seat,
+                 const char                 *session_type)
+{
+        if (uid >= 0 && e->session_unix_user != uid) {
+                return FALSE;
         }
 
-        return revent;
+        if (seat != NULL && e->seat_id != NULL && strcmp (e->seat_id, seat) != 0) {
+                return FALSE;
+        }
+
+        if (session_type != NULL && e->session_type != NULL && strcmp (e->session_type, session_type) != 0) {
+                return FALSE;
+        }
+
+        return TRUE;
 }
 
 static char *
@@ -420,16 +1027,21 @@ get_user_name_for_event (CkLogEvent *event)
 static char *
 get_host_for_event (CkLogEvent *event)
 {
-        char *name;
+        CkLogSeatSessionAddedEvent *e;
+        char                       *name;
 
         name = NULL;
 
         switch (event->type) {
         case CK_LOG_EVENT_SEAT_SESSION_ADDED:
-                name = g_strdup (((CkLogSeatSessionAddedEvent *)event)->session_remote_host_name);
-                if (name == NULL) {
-                        /* If not set then use the display value */
-                        name = g_strdup (((CkLogSeatSessionAddedEvent *)event)->session_x11_display);
+                e = (CkLogSeatSessionAddedEvent *)event;
+                /* text history has '' where binary history has no
+                 * value at all; if not set then use the display value */
+                if (e->session_remote_host_name != NULL
+                    && e->session_remote_host_name[0] != '\0') {
+                        name = g_strdup (e->session_remote_host_name);
+                } else {
+                        name = g_strdup (e->session_x11_display);
                 }
                 break;
         case CK_LOG_EVENT_SYSTEM_START:
@@ -497,8 +1109,8 @@ get_duration (CkLogEvent *event,
 }
 
 static void
-print_last_report_record (GList      *list,
-                          CkLogEvent *event,
+print_last_report_record (CkLogEvent *event,
+                          CkLogEvent *remove_event,
                           gboolean    legacy_compat)
 {
         GString                    *str;
@@ -512,20 +1124,11 @@ print_last_report_record (GList      *list,
         char                       *session_id;
         char                       *seat_id;
         CkLogSeatSessionAddedEvent *e;
-        CkLogEvent                 *remove_event;
         RecordStatus                status;
 
-        if (event->type != CK_LOG_EVENT_SEAT_SESSION_ADDED
-            && event->type != CK_LOG_EVENT_SYSTEM_START) {
-                return;
-        }
-
-        remove_event = NULL;
-
         if (event->type == CK_LOG_EVENT_SEAT_SESSION_ADDED) {
                 e = (CkLogSeatSessionAddedEvent *)event;
 
-                remove_event = find_first_matching_remove_event (list->next, e);
                 status = get_event_record_status (remove_event);
 
                 session_type = e->session_type;
@@ -533,7 +1136,6 @@ print_last_report_record (GList      *list,
                 seat_id = e->seat_id;
         } else {
                 status = RECORD_STATUS_REBOOT;
-                remove_event = find_first_matching_system_stop_event (list->next, e);
 
                 session_type = "";
                 session_id = "";
@@ -621,90 +1223,171 @@ print_last_report_record (GList      *list,
         g_free (duration);
 }
 
+/* Pairs each session with the event that ended it in a single pass.
+ * Events are fed newest first, so a session ends at the nearest later
+ * removal of it or, failing that, the nearest later system start or
+ * stop.  Removals from before a system start or stop can't be the
+ * nearest for anything older, so only the sessions since the last one
+ * are remembered. */
+typedef struct {
+        GHashTable *removals;     /* session id -> removal event */
+        CkLogEvent *system_event; /* nearest later start, stop or restart */
+        CkLogEvent *stop_event;   /* nearest later stop or restart */
+} PairingIndex;
+
 static void
-generate_report_last (int         uid,
-                      const char *seat,
-                      const char *session_type)
+replace_event (CkLogEvent **slot,
+               CkLogEvent  *event)
 {
-        GList      *oldest;
-        CkLogEvent *oldest_event;
-        GList      *l;
-
-        /* print events in reverse time order */
-
-        for (l = g_list_last (all_events); l != NULL; l = l->prev) {
-                CkLogEvent *event;
+        if (*slot != NULL) {
+                ck_log_event_free (*slot);
+        }
+        *slot = event;
+}
 
-                event = l->data;
+static void
+pairing_index_init (PairingIndex *pairing)
+{
+        pairing->removals = g_hash_table_new_full (g_str_hash,
+                                                 g_str_equal,
+                                                 NULL,
+                                                 (GDestroyNotify) ck_log_event_free);
+        pairing->system_event = NULL;
+        pairing->stop_event = NULL;
+}
 
-                if (event->type == CK_LOG_EVENT_SEAT_SESSION_ADDED) {
-                        CkLogSeatSessionAddedEvent *e;
-                        e = (CkLogSeatSessionAddedEvent *)event;
+static void
+pairing_index_clear (PairingIndex *pairing)
+{
+        g_hash_table_destroy (pairing->removals);
+        replace_event (&pairing->system_event, NULL);
+        replace_event (&pairing->stop_event, NULL);
+}
 
-                        if (uid >= 0 && e->session_unix_user != uid) {
-                                continue;
-                        }
+/* Returns the event ending a session added or a system start, or NULL
+ * if it hasn't ended */
+static CkLogEvent *
+pairing_index_lookup (PairingIndex *pairing,
+                      CkLogEvent   *event)
+{
+        CkLogSeatSessionAddedEvent *e;
+        CkLogEvent                 *remove_event;
 
-                        if (seat != NULL && e->seat_id != NULL && strcmp (e->seat_id, seat) != 0) {
-                                continue;
-                        }
+        if (event->type == CK_LOG_EVENT_SYSTEM_START) {
+                return pairing->stop_event;
+        }
 
-                        if (session_type != NULL && e->session_type != NULL && strcmp (e->session_type, session_type) != 0) {
-                                continue;
-                        }
-                }
+        g_assert (event->type == CK_LOG_EVENT_SEAT_SESSION_ADDED);
 
-                print_last_report_record (l, event, FALSE);
+        e = (CkLogSeatSessionAddedEvent *)event;
+        remove_event = NULL;
+        if (e->session_id != NULL) {
+                remove_event = g_hash_table_lookup (pairing->removals, e->session_id);
         }
-
-        oldest = g_list_first (all_events);
-        if (oldest != NULL) {
-                oldest_event = oldest->data;
-                g_print ("\nLog begins %s", ctime (&oldest_event->timestamp.tv_sec));
+        if (remove_event == NULL) {
+                remove_event = pairing->system_event;
         }
+
+        return remove_event;
 }
 
+/* Takes ownership of @event */
 static void
-generate_report_last_compat (int         uid,
-                             const char *seat,
-                             const char *session_type)
+pairing_index_add (PairingIndex *pairing,
+                   CkLogEvent   *event)
 {
-        GList      *oldest;
-        CkLogEvent *oldest_event;
-        GList      *l;
-
-        /* print events in reverse time order */
+        CkLogSeatSessionRemovedEvent *e;
 
-        for (l = g_list_last (all_events); l != NULL; l = l->prev) {
-                CkLogEvent *event;
+        switch (event->type) {
+        case CK_LOG_EVENT_SEAT_SESSION_REMOVED:
+                e = (CkLogSeatSessionRemovedEvent *)event;
+                if (e->session_id == NULL) {
+                        ck_log_event_free (event);
+                        break;
+                }
+                /* the key belongs to the event */
+                g_hash_table_replace (pairing->removals, e->session_id, event);
+                break;
+        case CK_LOG_EVENT_SYSTEM_STOP:
+        case CK_LOG_EVENT_SYSTEM_RESTART:
+                replace_event (&pairing->stop_event, ck_log_event_copy (event));
+                /* fall through */
+        case CK_LOG_EVENT_SYSTEM_START:
+                g_hash_table_remove_all (pairing->removals);
+                replace_event (&pairing->system_event, event);
+                break;
+        default:
+                ck_log_event_free (event);
+                break;
+        }
+}
 
-                event = l->data;
+static void
+generate_report_last (int         uid,
+                      const char *seat,
+                      const char *session_type,
+                      GTimeVal   *since,
+                      int         limit,
+                      gboolean    legacy_compat)
+{
+        GList         *files;
+        HistoryCursor *cursor;
+        CkLogEvent    *event;
+        PairingIndex   pairing;
+        GTimeVal       begin;
+        gboolean       have_begin;
+        int            n_records;
 
+        files = get_log_file_list ();
+        cursor = history_cursor_new (files,
+                                     EVENT_MASK (CK_LOG_EVENT_SEAT_SESSION_ADDED)
+                                     | EVENT_MASK (CK_LOG_EVENT_SEAT_SESSION_REMOVED)
+                                     | EVENT_MASK (CK_LOG_EVENT_SYSTEM_START)
+                                     | EVENT_MASK (CK_LOG_EVENT_SYSTEM_STOP)
+                                     | EVENT_MASK (CK_LOG_EVENT_SYSTEM_RESTART),
+                                     since);
+        pairing_index_init (&pairing);
+        n_records = 0;
+
+        while ((limit <= 0 || n_records < limit)
+               && (event = history_cursor_next (cursor)) != NULL) {
                 if (event->type == CK_LOG_EVENT_SEAT_SESSION_ADDED) {
-                        CkLogSeatSessionAddedEvent *e;
-                        e = (CkLogSeatSessionAddedEvent *)event;
-
-                        if (uid >= 0 && e->session_unix_user != uid) {
-                                continue;
-                        }
-
-                        if (seat != NULL && e->seat_id != NULL && strcmp (e->seat_id, seat) != 0) {
-                                continue;
+                        if (session_matches ((CkLogSeatSessionAddedEvent *)event, uid, seat, session_type)) {
+                                print_last_report_record (event,
+                                                          pairing_index_lookup (&pairing, event),
+                                                          legacy_compat);
+                                n_records++;
                         }
+                        ck_log_event_free (event);
+                        continue;
+                }
 
-                        if (session_type != NULL && e->session_type != NULL && strcmp (e->session_type, session_type) != 0) {
-                                continue;
-                        }
+                if (event->type == CK_LOG_EVENT_SYSTEM_START) {
+                        print_last_report_record (event,
+                                                  pairing_index_lookup (&pairing, event),
+                                                  legacy_compat);
+                        n_records++;
                 }
 
-                print_last_report_record (l, event, TRUE);
+                pairing_index_add (&pairing, event);
+        }
+
+        if (limit > 0 && n_records >= limit) {
+                have_begin = find_log_begin (files, since, &begin);
+        } else {
+                have_begin = cursor->have_oldest;
+                begin = cursor->oldest;
         }
 
-        oldest = g_list_first (all_events);
-        if (oldest != NULL) {
-                oldest_event = oldest->data;
-                g_print ("\nLog begins %s", ctime (&oldest_event->timestamp.tv_sec));
+        if (have_begin) {
+                g_print ("\nLog begins %s", ctime (&begin.tv_sec));
         }
+
+        pairing_index_clear (&pairing);
+        history_cursor_free (cursor);
+
+        g_list_foreach (files, (GFunc)g_free, NULL);
+        g_list_free (files);
 }
 
 typedef struct {
@@ -740,54 +1423,49 @@ counts_compare (CountData *a,
 static void
 generate_report_frequent (int         uid,
                           const char *seat,
-                          const char *session_type)
+                          const char *session_type,
+                          GTimeVal   *since)
 {
-        GHashTable *counts;
-        GList      *l;
-        GList      *user_counts;
-
-        /* FIXME: we can probably do this more efficiently */
+        GList         *files;
+        HistoryCursor *cursor;
+        CkLogEvent    *event;
+        GHashTable    *counts;
+        GList         *user_counts;
 
         counts = g_hash_table_new (NULL, NULL);
 
-        for (l = g_list_first (all_events); l != NULL; l = l->next) {
-                CkLogEvent                 *event;
+        files = get_log_file_list ();
+        cursor = history_cursor_new (files,
+                                     EVENT_MASK (CK_LOG_EVENT_SEAT_SESSION_ADDED),
+                                     since);
+
+        while ((event = history_cursor_next (cursor)) != NULL) {
                 CkLogSeatSessionAddedEvent *e;
                 guint                       count;
                 gpointer                    val;
 
-                event = l->data;
-
-                if (event->type != CK_LOG_EVENT_SEAT_SESSION_ADDED) {
-                        continue;
-                }
-
                 e = (CkLogSeatSessionAddedEvent *)event;
 
-                if (uid >= 0 && e->session_unix_user != uid) {
-                        continue;
-                }
-
-                if (seat != NULL && e->seat_id != NULL && strcmp (e->seat_id, seat) != 0) {
-                        continue;
-                }
-
-                if (session_type != NULL && e->session_type != NULL && strcmp (e->session_type, session_type) != 0) {
-                        continue;
-                }
+                if (session_matches (e, uid, seat, session_type)) {
+                        val = g_hash_table_lookup (counts, GINT_TO_POINTER (e->session_unix_user));
+                        if (val != NULL) {
+                                count = GPOINTER_TO_INT (val);
+                        } else {
+                                count = 0;
+                        }
 
-                val = g_hash_table_lookup (counts, GINT_TO_POINTER (e->session_unix_user));
-                if (val != NULL) {
-                        count = GPOINTER_TO_INT (val);
-                } else {
-                        count = 0;
+                        g_hash_table_insert (counts,
+                                             GINT_TO_POINTER (e->session_unix_user),
+                                             GUINT_TO_POINTER (count + 1));
                 }
 
-                g_hash_table_insert (counts,
-                                     GINT_TO_POINTER (e->session_unix_user),
-                                     GUINT_TO_POINTER (count + 1));
+                ck_log_event_free (event);
         }
 
+        history_cursor_free (cursor);
+        g_list_foreach (files, (GFunc)g_free, NULL);
+        g_list_free (files);
+
         user_counts = NULL;
         g_hash_table_foreach (counts, (GHFunc)listify_counts, &user_counts);
         g_hash_table_destroy (counts);
@@ -836,25 +1514,28 @@ static void
 generate_report (int         report_type,
                  int         uid,
                  const char *seat,
-                 const char *session_type)
+                 const char *session_type,
+                 GTimeVal   *since,
+                 int         limit)
 {
-
-        all_events = g_list_reverse (all_events);
-
         switch (report_type) {
         case REPORT_TYPE_SUMMARY:
+                process_logs (since);
+                all_events = g_list_reverse (all_events);
                 generate_report_summary (uid, seat, session_type);
                 break;
         case REPORT_TYPE_LAST:
-                generate_report_last (uid, seat, session_type);
+                generate_report_last (uid, seat, session_type, since, limit, FALSE);
                 break;
         case REPORT_TYPE_LAST_COMPAT:
-                generate_report_last_compat (uid, seat, session_type);
+                generate_report_last (uid, seat, session_type, since, limit, TRUE);
                 break;
         case REPORT_TYPE_FREQUENT:
-                generate_report_frequent (uid, seat, session_type);
+                generate_report_frequent (uid, seat, session_type, since);
                 break;
         case REPORT_TYPE_LOG:
+                process_logs (since);
+                all_events = g_list_reverse (all_events);
                 generate_report_log (uid, seat, session_type);
                 break;
         default:
@@ -889,6 +1570,7 @@ main (int    argc,
         static char        *seat = NULL;
         static char        *session_type = NULL;
         static char        *since = NULL;
+        static int          limit = 0;
         static GOptionEntry entries [] = {
                 { "version", 'V', 0, G_OPTION_ARG_NONE, &do_version, N_("Version of this application"), NULL },
                 { "frequent", 0, 0, G_OPTION_ARG_NONE, &report_frequent, N_("Show listing of frequent users"), NULL },
@@ -899,9 +1581,14 @@ main (int    argc,
                 { "session-type", 't', 0, G_OPTION_ARG_STRING, &session_type, N_("Show entries for the specified session type"), N_("TYPE") },
                 { "user", 'u', 0, G_OPTION_ARG_STRING, &username, N_("Show entries for the specified user"), N_("NAME") },
                 { "since", 0, 0, G_OPTION_ARG_STRING, &since, N_("Show entries since the specified time (ISO 8601 format)"), N_("DATETIME") },
+                { "limit", 'n', 0, G_OPTION_ARG_INT, &limit, N_("Show at most the specified number of entries in the last listings"), N_("N") },
                 { NULL }
         };
 
+        if (! g_thread_supported ()) {
+                g_thread_init (NULL);
+        }
+
         context = g_option_context_new (NULL);
         g_option_context_add_main_entries (context, entries, NULL);
         retval = g_option_context_parse (context, &argc, &argv, &error);
@@ -950,12 +1637,12 @@ main (int    argc,
                 uid = -1;
         }
 
-        if (use_since) {
-                process_logs (&timestamp);
-        } else {
-                process_logs (NULL);
-        }
-        generate_report (report_type, uid, seat, session_type);
+        generate_report (report_type,
+                         uid,
+                         seat,
+                         session_type,
+                         use_since ? &timestamp : NULL,
+                         limit);
         free_events ();
 
         return 0;
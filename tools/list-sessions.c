@@ -165,13 +165,65 @@ get_real_name (uid_t uid)
         return realname;
 }
 
+static void
+print_session (const char *ssid,
+               guint       uid,
+               const char *sid,
+               const char *lsid,
+               const char *session_type,
+               const char *x11_display,
+               const char *x11_display_device,
+               const char *display_device,
+               const char *remote_host_name,
+               gboolean    is_active,
+               gboolean    is_local,
+               const char *creation_time,
+               const char *idle_since_hint)
+{
+        char       *realname;
+        const char *short_sid;
+        const char *short_ssid;
+
+        realname = get_real_name (uid);
+
+        short_sid = sid;
+        short_ssid = ssid;
+
+        if (sid != NULL && g_str_has_prefix (sid, CK_PATH "/")) {
+                short_sid = sid + strlen (CK_PATH) + 1;
+        }
+        if (g_str_has_prefix (ssid, CK_PATH "/")) {
+                short_ssid = ssid + strlen (CK_PATH) + 1;
+        }
+
+        printf ("%s:\n\tunix-user = '%d'\n\trealname = '%s'\n\tseat = '%s'\n\tsession-type = '%s'\n\tactive = %s\n\tx11-display = '%s'\n\tx11-display-device = '%s'\n\tdisplay-device = '%s'\n\tremote-host-name = '%s'\n\tis-local = %s\n\ton-since = '%s'\n\tlogin-session-id = '%s'",
+                short_ssid,
+                uid,
+                realname,
+                short_sid,
+                session_type,
+                is_active ? "TRUE" : "FALSE",
+                x11_display,
+                x11_display_device,
+                display_device,
+                remote_host_name,
+                is_local ? "TRUE" : "FALSE",
+                creation_time,
+                lsid);
+        if (idle_since_hint != NULL && idle_since_hint[0] != '\0') {
+                printf ("\n\tidle-since-hint = '%s'", idle_since_hint);
+        }
+        printf ("\n");
+
+        g_free (realname);
+}
+
 static void
 list_session (DBusGConnection *connection,
               const char      *ssid)
 {
         DBusGProxy *proxy;
         guint       uid;
-        char       *realname;
         char       *sid;
         char       *lsid;
         char       *session_type;
@@ -183,8 +235,6 @@ list_session (DBusGConnection *connection,
         char       *idle_since_hint;
         gboolean    is_active;
         gboolean    is_local;
-        char       *short_sid;
-        const char *short_ssid;
 
         proxy = dbus_g_proxy_new_for_name (connection,
                                            CK_NAME,
@@ -217,41 +267,23 @@ list_session (DBusGConnection *connection,
         get_string (proxy, "GetCreationTime", &creation_time);
         get_string (proxy, "GetIdleSinceHint", &idle_since_hint);
 
-        realname = get_real_name (uid);
-
-        short_sid = sid;
-        short_ssid = ssid;
-
-        if (g_str_has_prefix (sid, CK_PATH "/")) {
-                short_sid = sid + strlen (CK_PATH) + 1;
-        }
-        if (g_str_has_prefix (ssid, CK_PATH "/")) {
-                short_ssid = ssid + strlen (CK_PATH) + 1;
-        }
-
-        printf ("%s:\n\tunix-user = '%d'\n\trealname = '%s'\n\tseat = '%s'\n\tsession-type = '%s'\n\tactive = %s\n\tx11-display = '%s'\n\tx11-display-device = '%s'\n\tdisplay-device = '%s'\n\tremote-host-name = '%s'\n\tis-local = %s\n\ton-since = '%s'\n\tlogin-session-id = '%s'",
-                short_ssid,
-                uid,
-                realname,
-                short_sid,
-                session_type,
-                is_active ? "TRUE" : "FALSE",
-                x11_display,
-                x11_display_device,
-                display_device,
-                remote_host_name,
-                is_local ? "TRUE" : "FALSE",
-                creation_time,
-                lsid);
-        if (idle_since_hint != NULL && idle_since_hint[0] != '\0') {
-                printf ("\n\tidle-since-hint = '%s'", idle_since_hint);
-        }
-        printf ("\n");
+        print_session (ssid,
+                       uid,
+                       sid,
+                       lsid,
+                       session_type,
+                       x11_display,
+                       x11_display_device,
+                       display_device,
+                       remote_host_name,
+                       is_active,
+                       is_local,
+                       creation_time,
+                       idle_since_hint);
 
         g_free (idle_since_hint);
         g_free (creation_time);
         g_free (remote_host_name);
-        g_free (realname);
         g_free (sid);
         g_free (lsid);
         g_free (session_type);
@@ -358,6 +390,168 @@ list_seats (DBusGConnection *connection)
         g_object_unref (proxy);
 }
 
+static const char *
+snapshot_get_string (GHashTable *props,
+                     const char *name)
+{
+        GValue *value;
+
+        value = g_hash_table_lookup (props, name);
+        if (value == NULL) {
+                return NULL;
+        }
+
+        if (G_VALUE_HOLDS_STRING (value)) {
+                return g_value_get_string (value);
+        }
+        if (G_VALUE_HOLDS (value, DBUS_TYPE_G_OBJECT_PATH)) {
+                return g_value_get_boxed (value);
+        }
+
+        return NULL;
+}
+
+static guint
+snapshot_get_uint (GHashTable *props,
+                   const char *name)
+{
+        GValue *value;
+
+        value = g_hash_table_lookup (props, name);
+        if (value == NULL || ! G_VALUE_HOLDS_UINT (value)) {
+                return 0;
+        }
+
+        return g_value_get_uint (value);
+}
+
+static gboolean
+snapshot_get_boolean (GHashTable *props,
+                      const char *name)
+{
+        GValue *value;
+
+        value = g_hash_table_lookup (props, name);
+        if (value == NULL || ! G_VALUE_HOLDS_BOOLEAN (value)) {
+                return FALSE;
+        }
+
+        return g_value_get_boolean (value);
+}
+
+static void
+list_snapshot_seat (const char *sid,
+                    GHashTable *seat_props,
+                    GHashTable *sessions)
+{
+        GValue     *value;
+        GPtrArray  *seat_sessions;
+        const char *seat_id;
+        int         i;
+
+        value = g_hash_table_lookup (seat_props, "sessions");
+        if (value == NULL || ! G_VALUE_HOLDS_BOXED (value)) {
+                return;
+        }
+
+        seat_sessions = g_value_get_boxed (value);
+        for (i = 0; i < seat_sessions->len; i++) {
+                const char *ssid;
+                GHashTable *props;
+
+                ssid = g_ptr_array_index (seat_sessions, i);
+                props = g_hash_table_lookup (sessions, ssid);
+                if (props == NULL) {
+                        continue;
+                }
+
+                seat_id = snapshot_get_string (props, "seat-id");
+                if (seat_id == NULL) {
+                        seat_id = sid;
+                }
+
+                print_session (ssid,
+                               snapshot_get_uint (props, "unix-user"),
+                               seat_id,
+                               snapshot_get_string (props, "login-session-id"),
+                               snapshot_get_string (props, "session-type"),
+                               snapshot_get_string (props, "x11-display"),
+                               snapshot_get_string (props, "x11-display-device"),
+                               snapshot_get_string (props, "display-device"),
+                               snapshot_get_string (props, "remote-host-name"),
+                               snapshot_get_boolean (props, "active"),
+                               snapshot_get_boolean (props, "is-local"),
+                               snapshot_get_string (props, "creation-time"),
+                               snapshot_get_string (props, "idle-since-hint"));
+        }
+}
+
+/* Fetches everything in one round trip; returns FALSE only if the
+ * daemon is too old to know GetSnapshot, so that the caller can fall
+ * back to asking for each seat and session. */
+static gboolean
+list_snapshot (DBusGConnection *connection)
+{
+        DBusGProxy    *proxy;
+        GError        *error;
+        gboolean       res;
+        gboolean       ret;
+        GHashTable    *seats;
+        GHashTable    *sessions;
+        GType          map_type;
+        GHashTableIter iter;
+        const char    *sid;
+        GHashTable    *seat_props;
+
+        proxy = dbus_g_proxy_new_for_name (connection,
+                                           CK_NAME,
+                                           CK_MANAGER_PATH,
+                                           CK_MANAGER_INTERFACE);
+        if (proxy == NULL) {
+                return FALSE;
+        }
+
+        map_type = dbus_g_type_get_map ("GHashTable",
+                                        G_TYPE_STRING,
+                                        dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE));
+
+        seats = NULL;
+        sessions = NULL;
+
+        ret = TRUE;
+
+        error = NULL;
+        res = dbus_g_proxy_call (proxy,
+                                 "GetSnapshot",
+                                 &error,
+                                 G_TYPE_INVALID,
+                                 map_type, &seats,
+                                 map_type, &sessions,
+                                 G_TYPE_INVALID);
+        if (! res) {
+                if (dbus_g_error_has_name (error, DBUS_ERROR_UNKNOWN_METHOD)) {
+                        g_debug ("GetSnapshot is not supported: %s", error->message);
+                        ret = FALSE;
+                } else {
+                        g_warning ("Unable to get the seats and sessions: %s", error->message);
+                }
+                g_error_free (error);
+                goto out;
+        }
+
+        g_hash_table_iter_init (&iter, seats);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&sid, (gpointer *)&seat_props)) {
+                list_snapshot_seat (sid, seat_props, sessions);
+        }
+
+        g_hash_table_destroy (seats);
+        g_hash_table_destroy (sessions);
+ out:
+        g_object_unref (proxy);
+
+        return ret;
+}
+
 int
 main (int    argc,
       char **argv)
@@ -400,7 +594,9 @@ main (int    argc,
                 exit (1);
         }
 
-        list_seats (connection);
+        if (! list_snapshot (connection)) {
+                list_seats (connection);
+        }
 
         return 0;
 }
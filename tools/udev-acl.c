@@ -25,6 +25,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "ck-database.h"
+
 static int debug;
 
 enum{
@@ -123,12 +125,42 @@ static int uid_in_list(GSList *list, uid_t uid)
         return 0;
 }
 
+/* the binary database keeps the local, active sessions in a precomputed list */
+static bool uids_from_database(const char *own_id, GSList **list)
+{
+        CkDatabase *db;
+        int n;
+        int i;
+
+        db = ck_database_open(NULL);
+        if (db == NULL)
+                return false;
+
+        n = ck_database_get_n_local_active(db);
+        for (i = 0; i < n; i++) {
+                CkDatabaseSession session;
+
+                if (!ck_database_get_session(db, ck_database_get_local_active_session(db, i), &session))
+                        continue;
+                if (own_id != NULL && g_str_has_suffix(session.id, own_id))
+                        continue;
+                if (session.uid > 0 && !uid_in_list(*list, session.uid))
+                        *list = g_slist_prepend(*list, GUINT_TO_POINTER(session.uid));
+        }
+        ck_database_close(db);
+
+        return true;
+}
+
 /* return list of current uids of local active sessions */
 static GSList *uids_with_local_active_session(const char *own_id)
 {
         GSList *list = NULL;
         GKeyFile *keyfile;
 
+        if (uids_from_database(own_id, &list))
+                return list;
+
         keyfile = g_key_file_new();
         if (g_key_file_load_from_file(keyfile, "/var/run/ConsoleKit/database", 0, NULL)) {
                 gchar **groups;